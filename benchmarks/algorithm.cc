@@ -0,0 +1,134 @@
+/* Compares the generic range loops of the basic algorithms with their
+ * raw memory paths for contiguous ranges.
+ *
+ * This file is part of libostd. See COPYING.md for futher information.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <ostd/range.hh>
+#include <ostd/algorithm.hh>
+#include <ostd/io.hh>
+
+#include "bench.hh"
+
+using namespace ostd;
+
+/* hides the contiguity of a range so that the generic loops are used */
+template<typename R>
+struct generic_range: input_range<generic_range<R>> {
+    using range_category = finite_random_access_range_tag;
+    using value_type = range_value_t<R>;
+    using reference = range_reference_t<R>;
+    using size_type = range_size_t<R>;
+
+    generic_range(R r): p_range(r) {}
+
+    bool empty() const { return p_range.empty(); }
+    void pop_front() { p_range.pop_front(); }
+    reference front() const { return p_range.front(); }
+    void pop_back() { p_range.pop_back(); }
+    reference back() const { return p_range.back(); }
+    size_type size() const { return p_range.size(); }
+    reference operator[](size_type i) const { return p_range[i]; }
+
+    generic_range slice(size_type start, size_type end) const {
+        return generic_range{p_range.slice(start, end)};
+    }
+
+    generic_range slice(size_type start) const {
+        return slice(start, size());
+    }
+
+    void put(value_type const &v) { p_range.put(v); }
+
+private:
+    R p_range;
+};
+
+template<typename R>
+static generic_range<R> generic(R r) {
+    return generic_range<R>{r};
+}
+
+template<typename F1, typename F2>
+static void bench(
+    char const *algo, char const *tname, std::size_t n,
+    F1 generic_func, F2 dispatched_func
+) {
+    double g = bench_ns(n, generic_func);
+    double d = bench_ns(n, dispatched_func);
+    writefln(
+        "%-24s %-6s %8d  generic: %7.3f ns/elem  contiguous: %7.3f ns/elem"
+        "  (%.1fx)", algo, tname, n, g, d, g / d
+    );
+}
+
+template<typename T>
+static void bench_type(char const *tname, std::size_t n) {
+    std::vector<T> v(n), w(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        v[i] = T(i % 100);
+    }
+    /* the value searched for is only at the very end */
+    v.back() = T(101);
+    w = v;
+
+    bench("find", tname, n, [&v]() {
+        return find(generic(iter(v)), T(101)).size();
+    }, [&v]() {
+        return find(iter(v), T(101)).size();
+    });
+    bench("count", tname, n, [&v]() {
+        return count(generic(iter(v)), T(7));
+    }, [&v]() {
+        return count(iter(v), T(7));
+    });
+    bench("equal", tname, n, [&v, &w]() {
+        return equal(generic(iter(v)), generic(iter(w)));
+    }, [&v, &w]() {
+        return equal(iter(v), iter(w));
+    });
+    bench("copy", tname, n, [&v, &w]() {
+        return copy(generic(iter(v)), generic(iter(w))).size();
+    }, [&v, &w]() {
+        return copy(iter(v), iter(w)).size();
+    });
+    bench("fill", tname, n, [&w]() {
+        fill(generic(iter(w)), T(3));
+        return w[0];
+    }, [&w]() {
+        fill(iter(w), T(3));
+        return w[0];
+    });
+    bench("reverse", tname, n, [&w]() {
+        reverse(generic(iter(w)));
+        return w[0];
+    }, [&w]() {
+        reverse(iter(w));
+        return w[0];
+    });
+}
+
+static void bench_lexcmp(std::size_t n) {
+    std::vector<unsigned char> a(n, 'a'), b(n, 'a');
+    b.back() = 'b';
+    bench("lexicographical_compare", "uchar", n, [&a, &b]() {
+        return lexicographical_compare(generic(iter(a)), generic(iter(b)));
+    }, [&a, &b]() {
+        return lexicographical_compare(iter(a), iter(b));
+    });
+}
+
+int main() {
+    for (std::size_t n: { 64, 4096, 1 << 20 }) {
+        bench_type<unsigned char>("uchar", n);
+        bench_type<std::uint16_t>("u16", n);
+        bench_type<int>("int", n);
+        bench_type<std::uint64_t>("u64", n);
+        bench_lexcmp(n);
+        writeln();
+    }
+}
@@ -0,0 +1,38 @@
+/* The timing loop shared by the benchmarks.
+ *
+ * This file is part of libostd. See COPYING.md for futher information.
+ */
+
+#ifndef OSTD_BENCHMARKS_BENCH_HH
+#define OSTD_BENCHMARKS_BENCH_HH
+
+#include <cstddef>
+#include <chrono>
+#include <type_traits>
+
+/* results go here, so that the work cannot be optimized out */
+static volatile std::size_t bench_sink;
+
+/* runs func repeatedly for at least 50 milliseconds, returning the
+ * average time in nanoseconds per each of the n items it processes
+ */
+template<typename F>
+static double bench_ns(std::size_t n, F func) {
+    using clock = std::chrono::steady_clock;
+    std::size_t iters = 0;
+    auto start = clock::now();
+    auto end = start;
+    do {
+        if constexpr(std::is_void_v<decltype(func())>) {
+            func();
+        } else {
+            bench_sink = bench_sink + std::size_t(func());
+        }
+        ++iters;
+        end = clock::now();
+    } while ((end - start) < std::chrono::milliseconds(50));
+    auto ns = std::chrono::duration<double, std::nano>(end - start).count();
+    return ns / double(iters * n);
+}
+
+#endif
@@ -0,0 +1,110 @@
+/* Compares number formatting with the C library and std::to_chars, and
+ * formatting into strings with an appender and with format_to_string.
+ *
+ * This file is part of libostd. See COPYING.md for futher information.
+ */
+
+#include <cstddef>
+#include <cstdio>
+#include <charconv>
+#include <string>
+#include <vector>
+
+#include <ostd/format.hh>
+#include <ostd/io.hh>
+
+#include "bench.hh"
+
+using namespace ostd;
+
+/* the to_chars function gets the default (shortest) format, which
+ * is what the C format is expected to match
+ */
+template<typename T, typename F>
+static void bench(
+    char const *name, std::vector<T> const &vals, char const *cfmt,
+    char const *ofmt, F to_chars
+) {
+    char buf[64];
+    std::size_t n = vals.size();
+    double s = bench_ns(n, [&]() {
+        std::size_t ret = 0;
+        for (auto v: vals) {
+            ret += std::size_t(std::snprintf(buf, sizeof(buf), cfmt, v));
+        }
+        return ret;
+    });
+    double c = bench_ns(n, [&]() {
+        std::size_t ret = 0;
+        for (auto v: vals) {
+            ret += std::size_t(to_chars(buf, buf + sizeof(buf), v).ptr - buf);
+        }
+        return ret;
+    });
+    double o = bench_ns(n, [&]() {
+        std::size_t ret = 0;
+        for (auto v: vals) {
+            iterator_range<char *> r{buf, buf + sizeof(buf)};
+            format(r, ofmt, v);
+            ret += std::size_t(r.data() - buf);
+        }
+        return ret;
+    });
+    writefln(
+        "%-10s snprintf: %6.2f ns  to_chars: %6.2f ns  format: %6.2f ns",
+        name, s, c, o
+    );
+}
+
+int main() {
+    std::vector<int> small;
+    std::vector<int> mixed;
+    std::vector<long long> large;
+    std::vector<double> reals;
+    unsigned long long seed = 88172645463325252ULL;
+    for (std::size_t i = 0; i < 4096; ++i) {
+        /* xorshift, so that the digit counts vary unpredictably */
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        small.push_back(int(seed % 1000));
+        mixed.push_back(int(seed >> (seed % 64)) - int(seed % 3));
+        large.push_back(static_cast<long long>(seed >> 1));
+        reals.push_back(double(seed >> 11) / double(1ULL << (seed % 48)));
+    }
+    auto ints = [](char *b, char *e, auto v) {
+        return std::to_chars(b, e, v);
+    };
+    auto fixed = [](char *b, char *e, double v) {
+        return std::to_chars(b, e, v, std::chars_format::fixed, 6);
+    };
+    auto general = [](char *b, char *e, double v) {
+        return std::to_chars(b, e, v, std::chars_format::general, 6);
+    };
+    auto shortest = [](char *b, char *e, double v) {
+        return std::to_chars(b, e, v);
+    };
+    bench("small", small, "%d", "%d", ints);
+    bench("mixed", mixed, "%d", "%d", ints);
+    bench("large", large, "%lld", "%d", ints);
+    bench("fixed", reals, "%f", "%f", fixed);
+    bench("general", reals, "%g", "%g", general);
+    bench("shortest", reals, "%.17g", "%r", shortest);
+
+    /* a typical log or error message */
+    string_range msg = "failed to open '%s' for %s: error %d (%s)";
+    std::string path = "/usr/share/some/rather/long/path/to/a/file.txt";
+    double a = bench_ns(1, [&]() {
+        return format(
+            appender<std::string>(), msg, path, "reading", 2, "no such file"
+        ).get().size();
+    });
+    double t = bench_ns(1, [&]() {
+        return format_to_string(
+            msg, path, "reading", 2, "no such file"
+        ).size();
+    });
+    writefln(
+        "%-10s appender: %6.2f ns  format_to_string: %6.2f ns", "string", a, t
+    );
+}
@@ -0,0 +1,81 @@
+/* Measures rule resolution in the build system over a synthetic graph
+ * with many targets and many pattern and exact rules.
+ *
+ * This file is part of libostd. See COPYING.md for futher information.
+ */
+
+#include <cstddef>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <ostd/build/make.hh>
+#include <ostd/format.hh>
+#include <ostd/io.hh>
+
+using namespace ostd;
+
+/* every object is made from a source through one of the directory
+ * specific pattern rules, and every source is generated by a rule,
+ * so the whole graph is resolved without touching the file system
+ */
+static double bench_resolve(
+    std::size_t ntargets, std::size_t ndirs, std::size_t nexact, int threads
+) {
+    build::make mk{build::make_task_simple, threads};
+    for (std::size_t i = 0; i < ndirs; ++i) {
+        auto d = format_to_string("%d", i);
+        mk.rule(format_to_string("obj/d%s/%%.o", d))
+            .action(true)
+            .depend(format_to_string("src/d%s/%%.c", d))
+            .body([]() {});
+        mk.rule(format_to_string("src/d%s/%%.c", d))
+            .action(true)
+            .body([]() {});
+    }
+    std::vector<std::string> objs;
+    for (std::size_t i = 0; i < ntargets; ++i) {
+        auto t = format_to_string("obj/d%d/f%d.o", i % ndirs, i);
+        /* some objects also get an extra exact rule on top */
+        if (i < nexact) {
+            mk.rule(t).depend(format_to_string("src/d%d/f%d.h", i % ndirs, i));
+            mk.rule(format_to_string("src/d%d/f%d.h", i % ndirs, i))
+                .action(true)
+                .body([]() {});
+        }
+        objs.push_back(std::move(t));
+    }
+    mk.rule("all").depend(objs);
+
+    using clock = std::chrono::steady_clock;
+    auto start = clock::now();
+    mk.exec("all");
+    return std::chrono::duration<double, std::milli>(
+        clock::now() - start
+    ).count();
+}
+
+int main() {
+    /* the graph is expanded on all the threads of the build */
+    int nthr = std::max(int(std::thread::hardware_concurrency()), 1);
+    writefln(
+        "%-32s %10s %10s", "graph", "ms (1)", format_to_string("ms (%d)", nthr)
+    );
+    for (auto [t, d, e]: {
+        std::tuple{10000, 100, 1000},
+        std::tuple{100000, 100, 10000},
+        std::tuple{100000, 1000, 10000}
+    }) {
+        auto name = format_to_string(
+            "%d tgt, %d dir, %d exact", t, d, e
+        );
+        auto nt = std::size_t(t), nd = std::size_t(d), ne = std::size_t(e);
+        auto one = bench_resolve(nt, nd, ne, 1);
+        writefln(
+            "%-32s %10.1f %10.1f", name, one, bench_resolve(nt, nd, ne, nthr)
+        );
+    }
+}
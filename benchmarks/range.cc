@@ -0,0 +1,85 @@
+/* Compares consuming wrapper range chains element by element with the
+ * internal iteration done by the sinks.
+ *
+ * This file is part of libostd. See COPYING.md for futher information.
+ */
+
+#include <cstddef>
+#include <vector>
+
+#include <ostd/range.hh>
+#include <ostd/algorithm.hh>
+#include <ostd/io.hh>
+
+#include "bench.hh"
+
+using namespace ostd;
+
+/* the element by element loop the sinks used to do; both loops are kept
+ * out of line and opaque, so that neither their placement in main nor
+ * hoisting them out of the timing loop skews the results
+ */
+template<typename R>
+[[gnu::noipa]] static long sum_by_pop(R range) {
+    long ret = 0;
+    for (; !range.empty(); range.pop_front()) {
+        ret += range.front();
+    }
+    return ret;
+}
+
+template<typename R>
+[[gnu::noipa]] static long sum_by_traverse(R range) {
+    return foldl(range, 0L);
+}
+
+template<typename F>
+static void bench(char const *name, std::size_t n, F make_chain) {
+    double p = bench_ns(n, [&make_chain]() {
+        return sum_by_pop(make_chain());
+    });
+    double t = bench_ns(n, [&make_chain]() {
+        return sum_by_traverse(make_chain());
+    });
+    writefln(
+        "%-16s %8d  pop: %7.3f ns/elem  traverse: %7.3f ns/elem  (%.1fx)",
+        name, n, p, t, p / t
+    );
+}
+
+int main() {
+    for (std::size_t n: { 64, 4096, 1 << 20 }) {
+        std::vector<int> v(n), w(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            v[i] = int(i % 1000);
+            w[i] = int(i % 7);
+        }
+        int const *vp = v.data();
+        int const *wp = w.data();
+        bench("map", n, [vp, n]() {
+            return iter(vp, vp + n) | map([](int i) { return i * 3; });
+        });
+        bench("filter+map", n, [vp, n]() {
+            return iter(vp, vp + n)
+                | filter([](int i) { return i & 1; })
+                | map([](int i) { return i * 3; });
+        });
+        bench("take", n, [vp, n]() {
+            return iter(vp, vp + n).take(n - 1)
+                | map([](int i) { return i + 1; });
+        });
+        bench("zip+map", n, [vp, wp, n]() {
+            return iter(vp, vp + n).zip(iter(wp, wp + n))
+                | map([](auto p) { return p.first * p.second; });
+        });
+        bench("join", n, [vp, wp, n]() {
+            return iter(vp, vp + n / 2).join(
+                iter(wp, wp + n / 4), iter(vp + n / 2, vp + n)
+            );
+        });
+        bench("range+map", n, [n]() {
+            return range(int(n)) | map([](int i) { return i ^ 5; });
+        });
+        writeln();
+    }
+}
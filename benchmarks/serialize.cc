@@ -0,0 +1,106 @@
+/* Compares binary serialization with text formatting into a stream.
+ *
+ * This file is part of libostd. See COPYING.md for futher information.
+ */
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <ostd/serialize.hh>
+#include <ostd/io.hh>
+
+#include "bench.hh"
+
+using namespace ostd;
+
+/* copies everything written into it into a wrapping buffer */
+struct sink_stream: stream {
+    std::size_t written = 0;
+
+    void close() {}
+    bool end() const { return false; }
+
+    void write_bytes(void const *buf, std::size_t n) {
+        auto *p = static_cast<unsigned char const *>(buf);
+        written += n;
+        while (n) {
+            std::size_t c = std::min(n, sizeof(p_data) - p_pos);
+            std::memcpy(p_data + p_pos, p, c);
+            p_pos = (p_pos + c) % sizeof(p_data);
+            p += c;
+            n -= c;
+        }
+    }
+
+private:
+    unsigned char p_data[1 << 20];
+    std::size_t p_pos = 0;
+};
+
+struct record {
+    std::uint32_t id;
+    double value;
+    std::string name;
+    std::vector<float> samples;
+};
+
+namespace ostd {
+    template<>
+    struct serialize_traits<record> {
+        static void serialize(binary_writer &w, record const &r) {
+            w.put(r.id, r.value, r.name, r.samples);
+        }
+    };
+}
+
+int main() {
+    std::vector<record> recs;
+    for (std::uint32_t i = 0; i < 1024; ++i) {
+        recs.push_back(record{
+            i, i * 0.25, "record" + std::to_string(i),
+            std::vector<float>(16, float(i))
+        });
+    }
+    auto s = std::make_unique<sink_stream>();
+    auto text = [&]() {
+        for (auto &r: recs) {
+            s->writef(
+                "%d %f %s %(%f %)\n", r.id, r.value, r.name, r.samples
+            );
+        }
+    };
+    auto binary = [&]() {
+        binary_writer w{*s};
+        for (auto &r: recs) {
+            w.put(r);
+        }
+    };
+    /* the sizes of a single pass */
+    text();
+    std::size_t tbytes = s->written;
+    binary();
+    std::size_t bbytes = s->written - tbytes;
+    double t = bench_ns(recs.size(), text);
+    double b = bench_ns(recs.size(), binary);
+    writefln(
+        "records   text: %7.1f ns (%d bytes)  binary: %7.1f ns (%d bytes)"
+        "  (%.1fx)", t, tbytes, b, bbytes, t / b
+    );
+
+    std::vector<double> bulk(1 << 16, 1.5);
+    double bt = bench_ns(bulk.size(), [&]() {
+        s->writef("%(%f %)", bulk);
+    });
+    double bb = bench_ns(bulk.size(), [&]() {
+        binary_writer w{*s};
+        w.put(bulk);
+    });
+    writefln(
+        "bulk      text: %7.2f ns/value  binary: %7.2f ns/value  (%.1fx)",
+        bt, bb, bt / bb
+    );
+}
@@ -0,0 +1,95 @@
+/* Compares the string slice search kernels with the generic algorithms
+ * and the standard string views.
+ *
+ * This file is part of libostd. See COPYING.md for futher information.
+ */
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#include <ostd/string.hh>
+#include <ostd/algorithm.hh>
+#include <ostd/io.hh>
+
+#include "bench.hh"
+
+using namespace ostd;
+
+template<typename F1, typename F2>
+static void bench(
+    char const *name, std::size_t n, F1 base_func, F2 kernel_func
+) {
+    double b = bench_ns(n, base_func);
+    double k = bench_ns(n, kernel_func);
+    writefln(
+        "%-16s %8d  baseline: %7.3f ns/byte  kernel: %7.3f ns/byte  (%.1fx)",
+        name, n, b, k, b / k
+    );
+}
+
+int main() {
+    /* something that looks like a log */
+    std::string line = "2024-01-01T12:00:00Z host service[1234]: "
+                       "request handled in 12ms status=200 path=/index\n";
+    for (std::size_t n: { 256, 16384, 1 << 22 }) {
+        std::string log;
+        while (log.size() < n) {
+            log += line;
+        }
+        log.resize(n);
+        log += "status=500";
+        string_range s{log};
+        std::string_view sv{log};
+
+        bench("find", n, [sv]() {
+            return sv.find("status=500");
+        }, [s]() {
+            return s.find("status=500").size();
+        });
+        bench("rfind", n, [sv]() {
+            return sv.rfind("status=404");
+        }, [s]() {
+            return s.rfind("status=404").size();
+        });
+        bench("find_first_of", n, [sv]() {
+            return sv.find_first_of("|#");
+        }, [s]() {
+            return s.find_first_of(byte_set{"|#"}).size();
+        });
+        bench("find_first_of/6", n, [s]() {
+            return find_one_of(s, string_range{"|#^~`$"}).size();
+        }, [s]() {
+            return s.find_first_of(byte_set{"|#^~`$"}).size();
+        });
+        bench("count", n, [s]() {
+            std::size_t ret = 0;
+            for (char c: s) {
+                ret += (c == '\n');
+            }
+            return ret;
+        }, [s]() {
+            return s.count('\n');
+        });
+        bench("split", n, [sv]() {
+            std::size_t ret = 0;
+            for (std::size_t pos = 0;;) {
+                auto q = sv.find('\n', pos);
+                if (q == std::string_view::npos) {
+                    ret += sv.size() - pos;
+                    break;
+                }
+                ret += q - pos;
+                pos = q + 1;
+            }
+            return ret;
+        }, [s]() {
+            std::size_t ret = 0;
+            for (auto part: s.split("\n")) {
+                ret += part.size();
+            }
+            return ret;
+        });
+        writeln();
+    }
+}
@@ -1,7 +1,7 @@
 /** @example concurrency.cc
  *
  * A simple example of the concurrency module usage, explaining schdulers,
- * ostd::spawn(), ostd::tid as well as ostd::channel.
+ * ostd::spawn(), ostd::tid, ostd::when_all() as well as ostd::channel.
  */
 
 #include <ostd/io.hh>
@@ -54,6 +54,27 @@ static void test_tid(Slice first_half, Slice second_half) {
     writefln("    %s + %s = %s", a, b, a + b);
 }
 
+/* tids can also be combined without blocking any task: when_all gives
+ * a tid that becomes ready once all the inputs are ready, and then lets
+ * you attach a continuation that gets spawned once its input is ready;
+ * the continuation receives the finished tid, so get() never waits
+ */
+template<typename Slice>
+static void test_when_all(Slice first_half, Slice second_half) {
+    auto f = [](auto half) {
+        return foldl(half, 0);
+    };
+    auto t = when_all(
+        spawn(f, first_half), spawn(f, second_half)
+    ).then([](auto all) {
+        auto [t1, t2] = all.get();
+        int a = t1.get();
+        int b = t2.get();
+        writefln("    %s + %s = %s", a, b, a + b);
+    });
+    t.get();
+}
+
 static void test_all() {
     /* have an array, split it in two halves and sum each half in a separate
      * task, which may or may not run in parallel with the other one depending
@@ -68,6 +89,8 @@ static void test_all() {
     test_channel(first_half, second_half);
     writeln("  testing futures...");
     test_tid(first_half, second_half);
+    writeln("  testing combinators...");
+    test_when_all(first_half, second_half);
 }
 
 int main() {
@@ -111,6 +134,8 @@ int main() {
     356 + 233 = 589
   testing futures...
     356 + 233 = 589
+  testing combinators...
+    356 + 233 = 589
 (1) 1:1 scheduler: finishing...
 
 (2) N:1 scheduler: starting...
@@ -118,6 +143,8 @@ int main() {
     356 + 233 = 589
   testing futures...
     356 + 233 = 589
+  testing combinators...
+    356 + 233 = 589
 (2) N:1 scheduler: finishing...
 
 (3) M:N scheduler: starting...
@@ -125,5 +152,7 @@ int main() {
     356 + 233 = 589
   testing futures...
     356 + 233 = 589
+  testing combinators...
+    356 + 233 = 589
 (3) M:N scheduler: finishing...
 */
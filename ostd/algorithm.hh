@@ -12,6 +12,12 @@
  * `algorithm`, with many of the algorithms being just range-based versions
  * of the iterator ones, but it also provides different custom algorithms.
  *
+ * Some of the basic algorithms (copying, finding, counting, comparing and
+ * filling with bytes) detect contiguous ranges of trivially copyable
+ * elements at compile time and work on the raw memory in that case, using
+ * the C memory functions or vectorized loops instead of going element by
+ * element through the range interface.
+ *
  * @copyright See COPYING.md in the project tree for further information.
  */
 
@@ -21,13 +27,21 @@
 #include <ostd/unit_test.hh>
 
 #include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <utility>
 #include <functional>
 #include <type_traits>
 #include <algorithm>
-
-#ifdef OSTD_BUILD_TESTS
+#include <iterator>
 #include <vector>
+#include <string>
+
+#include <ostd/platform.hh>
+
+#if defined(__SSE2__) && defined(OSTD_TOOLCHAIN_GNU)
+#include <emmintrin.h>
 #endif
 
 #include <ostd/range.hh>
@@ -399,6 +413,230 @@ inline auto max_element_cmp(Compare &&compare) {
     };
 }
 
+/* lowering of contiguous ranges to memory functions and vector kernels */
+
+namespace detail {
+    /* iterator ranges over the standard contiguous containers are not
+     * contiguous ranges as their iterators are not pointers, but their
+     * memory is still contiguous, so recognize the common ones
+     */
+    template<typename V, bool = std::is_trivially_copyable_v<V>>
+    struct algo_std_contiguous {
+        template<typename It>
+        static constexpr bool check = false;
+    };
+
+    template<typename V>
+    struct algo_std_contiguous<V, true> {
+        template<typename C, typename It>
+        static constexpr bool is_iter =
+            std::is_same_v<It, typename C::iterator> ||
+            std::is_same_v<It, typename C::const_iterator>;
+
+        template<typename It>
+        static constexpr bool check = [] {
+            if constexpr(std::is_same_v<V, bool>) {
+                return false;
+            } else if constexpr(
+                std::is_same_v<V, char> || std::is_same_v<V, wchar_t> ||
+                std::is_same_v<V, char16_t> || std::is_same_v<V, char32_t>
+            ) {
+                return is_iter<std::vector<V>, It> ||
+                       is_iter<std::basic_string<V>, It>;
+            } else {
+                return is_iter<std::vector<V>, It>;
+            }
+        }();
+    };
+
+    template<typename R>
+    inline constexpr bool algo_contiguous = is_contiguous_range<R>;
+
+    template<typename It>
+    inline constexpr bool algo_contiguous<iterator_range<It>> =
+        std::is_pointer_v<It> || algo_std_contiguous<
+            typename std::iterator_traits<It>::value_type
+        >::template check<It>;
+
+    /* contiguous ranges of trivially copyable elements accessed by lvalue
+     * reference, which can be handled as raw memory from the address of
+     * the front element
+     */
+    template<typename R, bool = algo_contiguous<R>>
+    inline constexpr bool algo_trivial_range = false;
+
+    template<typename R>
+    inline constexpr bool algo_trivial_range<R, true> =
+        std::is_lvalue_reference_v<range_reference_t<R>> &&
+        std::is_trivially_copyable_v<range_value_t<R>>;
+
+    template<typename R>
+    using algo_elem_t = std::remove_cv_t<range_value_t<R>>;
+
+    /* types whose equality is the same as equality of their bytes */
+    template<typename T>
+    inline constexpr bool algo_bytewise_eq = (
+        std::is_integral_v<T> || std::is_enum_v<T> || std::is_pointer_v<T>
+    ) && ((sizeof(T) == 1) || (sizeof(T) == 2) ||
+          (sizeof(T) == 4) || (sizeof(T) == 8));
+
+    /* searching for a value of the same type in such a range */
+    template<typename R, typename V>
+    inline constexpr bool algo_bytewise_search =
+        algo_trivial_range<R> &&
+        algo_bytewise_eq<algo_elem_t<R>> &&
+        std::is_same_v<algo_elem_t<R>, std::remove_cv_t<V>>;
+
+    template<typename T>
+    using algo_uint_t = std::conditional_t<
+        sizeof(T) == 1, std::uint8_t, std::conditional_t<
+            sizeof(T) == 2, std::uint16_t, std::conditional_t<
+                sizeof(T) == 4, std::uint32_t, std::uint64_t
+            >
+        >
+    >;
+
+    template<typename T>
+    inline algo_uint_t<T> algo_bits(T const &v) noexcept {
+        algo_uint_t<T> ret;
+        std::memcpy(&ret, &v, sizeof(T));
+        return ret;
+    }
+
+#if defined(__SSE2__) && defined(OSTD_TOOLCHAIN_GNU)
+    /* the lanes of `p` that are equal to `v` set to all ones, the other
+     * lanes to zero; sse2 only has compares up to 32 bits
+     */
+    template<std::size_t N>
+    inline __m128i algo_eq(unsigned char const *p, __m128i v) noexcept {
+        __m128i d = _mm_loadu_si128(reinterpret_cast<__m128i const *>(p));
+        if constexpr(N == 1) {
+            return _mm_cmpeq_epi8(d, v);
+        } else if constexpr(N == 2) {
+            return _mm_cmpeq_epi16(d, v);
+        } else {
+            return _mm_cmpeq_epi32(d, v);
+        }
+    }
+
+    template<typename U>
+    inline __m128i algo_splat(U v) noexcept {
+        if constexpr(sizeof(U) == 1) {
+            return _mm_set1_epi8(static_cast<char>(v));
+        } else if constexpr(sizeof(U) == 2) {
+            return _mm_set1_epi16(static_cast<short>(v));
+        } else {
+            return _mm_set1_epi32(static_cast<int>(v));
+        }
+    }
+
+    /* adds the per-lane match counts in `acc` */
+    template<std::size_t N>
+    inline std::size_t algo_lane_sum(__m128i acc) noexcept {
+        if constexpr(N == 1) {
+            __m128i s = _mm_sad_epu8(acc, _mm_setzero_si128());
+            return std::size_t(_mm_cvtsi128_si32(s)) +
+                std::size_t(_mm_cvtsi128_si32(_mm_srli_si128(s, 8)));
+        } else {
+            using U = std::conditional_t<
+                N == 2, std::uint16_t, std::uint32_t
+            >;
+            U lanes[16 / N];
+            std::memcpy(lanes, &acc, sizeof(lanes));
+            std::size_t ret = 0;
+            for (U l: lanes) {
+                ret += l;
+            }
+            return ret;
+        }
+    }
+#endif
+
+    /* index of the first element equal to v, or n */
+    template<typename T>
+    inline std::size_t algo_find(
+        T const *p, std::size_t n, T const &v
+    ) noexcept {
+        if constexpr(sizeof(T) == 1) {
+            if (!n) {
+                return 0;
+            }
+            auto *r = std::memchr(p, algo_bits(v), n);
+            if (!r) {
+                return n;
+            }
+            return std::size_t(
+                static_cast<unsigned char const *>(r) -
+                reinterpret_cast<unsigned char const *>(p)
+            );
+        } else {
+            auto bv = algo_bits(v);
+            std::size_t i = 0;
+#if defined(__SSE2__) && defined(OSTD_TOOLCHAIN_GNU)
+            if constexpr(sizeof(T) <= 4) {
+                constexpr std::size_t lanes = 16 / sizeof(T);
+                __m128i sv = algo_splat(bv);
+                auto *bp = reinterpret_cast<unsigned char const *>(p);
+                for (; (i + lanes) <= n; i += lanes) {
+                    auto m = static_cast<unsigned int>(_mm_movemask_epi8(
+                        algo_eq<sizeof(T)>(bp + i * sizeof(T), sv)
+                    ));
+                    if (m) {
+                        return i + std::size_t(__builtin_ctz(m)) / sizeof(T);
+                    }
+                }
+            }
+#endif
+            for (; i < n; ++i) {
+                if (algo_bits(p[i]) == bv) {
+                    break;
+                }
+            }
+            return i;
+        }
+    }
+
+    /* number of elements equal to v */
+    template<typename T>
+    inline std::size_t algo_count(
+        T const *p, std::size_t n, T const &v
+    ) noexcept {
+        auto bv = algo_bits(v);
+        std::size_t ret = 0, i = 0;
+#if defined(__SSE2__) && defined(OSTD_TOOLCHAIN_GNU)
+        if constexpr(sizeof(T) <= 4) {
+            /* a matching lane of the compare is -1, so subtracting it
+             * counts the matches per lane; the lanes are summed up before
+             * they can overflow
+             */
+            constexpr std::size_t lanes = 16 / sizeof(T);
+            constexpr std::size_t block = (sizeof(T) == 1) ? 255 : 65535;
+            __m128i sv = algo_splat(bv);
+            auto *bp = reinterpret_cast<unsigned char const *>(p);
+            while ((i + lanes) <= n) {
+                std::size_t e = std::min(n - i, block * lanes) / lanes;
+                __m128i acc = _mm_setzero_si128();
+                for (; e; --e, i += lanes) {
+                    __m128i m = algo_eq<sizeof(T)>(bp + i * sizeof(T), sv);
+                    if constexpr(sizeof(T) == 1) {
+                        acc = _mm_sub_epi8(acc, m);
+                    } else if constexpr(sizeof(T) == 2) {
+                        acc = _mm_sub_epi16(acc, m);
+                    } else {
+                        acc = _mm_sub_epi32(acc, m);
+                    }
+                }
+                ret += algo_lane_sum<sizeof(T)>(acc);
+            }
+        }
+#endif
+        for (; i < n; ++i) {
+            ret += (algo_bits(p[i]) == bv);
+        }
+        return ret;
+    }
+}
+
 /* lexicographical compare */
 
 /** @brief Like std::lexicographical_compare(), but for ranges.
@@ -410,6 +648,24 @@ inline auto max_element_cmp(Compare &&compare) {
  */
 template<typename InputRange1, typename InputRange2>
 inline bool lexicographical_compare(InputRange1 range1, InputRange2 range2) {
+    using T = detail::algo_elem_t<InputRange1>;
+    if constexpr(
+        detail::algo_trivial_range<InputRange1> &&
+        detail::algo_trivial_range<InputRange2> &&
+        std::is_same_v<T, detail::algo_elem_t<InputRange2>> &&
+        std::is_integral_v<T> && std::is_unsigned_v<T> && (sizeof(T) == 1)
+    ) {
+        /* memcmp compares unsigned bytes, which is exactly this */
+        std::size_t n1 = range1.size(), n2 = range2.size();
+        std::size_t n = std::min(n1, n2);
+        if (n) {
+            int c = std::memcmp(&range1.front(), &range2.front(), n);
+            if (c) {
+                return c < 0;
+            }
+        }
+        return n1 < n2;
+    }
     while (!range1.empty() && !range2.empty()) {
         if (range1.front() < range2.front()) {
             return true;
@@ -481,13 +737,16 @@ inline auto lexicographical_compare_cmp(InputRange &&range, Compare &&compare) {
  * The `func` is called like `func(range.front())`. The algorithm is
  * not multi-pass, so an ostd::input_range_tag is perfectly fine.
  *
+ * The iteration is done with ostd::range_traverse().
+ *
  * @returns The `func` by move.
  */
 template<typename InputRange, typename UnaryFunction>
 inline UnaryFunction for_each(InputRange range, UnaryFunction func) {
-    for (; !range.empty(); range.pop_front()) {
-        func(range.front());
-    }
+    range_traverse(range, [&func](auto &&v) {
+        func(std::forward<decltype(v)>(v));
+        return true;
+    });
     return func;
 }
 
@@ -599,6 +858,16 @@ inline auto none_of(Predicate &&pred) {
  */
 template<typename InputRange, typename Value>
 inline InputRange find(InputRange range, Value const &v) {
+    if constexpr(detail::algo_bytewise_search<InputRange, Value>) {
+        std::size_t n = range.size();
+        if (!n) {
+            return range;
+        }
+        std::size_t i = detail::algo_find(&range.front(), n, v);
+        return range.slice(
+            range_size_t<InputRange>(i), range_size_t<InputRange>(n)
+        );
+    }
     for (; !range.empty(); range.pop_front()) {
         if (range.front() == v) {
             break;
@@ -816,6 +1085,15 @@ inline auto find_one_of(ForwardRange &&values) {
  */
 template<typename InputRange, typename Value>
 inline range_size_t<InputRange> count(InputRange range, Value const &v) {
+    if constexpr(detail::algo_bytewise_search<InputRange, Value>) {
+        std::size_t n = range.size();
+        if (!n) {
+            return 0;
+        }
+        return range_size_t<InputRange>(
+            detail::algo_count(&range.front(), n, v)
+        );
+    }
     range_size_t<InputRange> ret = 0;
     for (; !range.empty(); range.pop_front()) {
         if (range.front() == v) {
@@ -907,6 +1185,19 @@ inline auto count_if_not(Predicate &&pred) {
  */
 template<typename InputRange>
 inline bool equal(InputRange range1, InputRange range2) {
+    if constexpr(
+        detail::algo_trivial_range<InputRange> &&
+        detail::algo_bytewise_eq<detail::algo_elem_t<InputRange>>
+    ) {
+        std::size_t n = range1.size();
+        if (n != std::size_t(range2.size())) {
+            return false;
+        }
+        return !n || !std::memcmp(
+            &range1.front(), &range2.front(),
+            n * sizeof(detail::algo_elem_t<InputRange>)
+        );
+    }
     for (; !range1.empty(); range1.pop_front()) {
         if (range2.empty() || !(range1.front() == range2.front())) {
             return false;
@@ -936,10 +1227,42 @@ inline auto equal(InputRange &&range) {
  * perform the copy. it respects ADL and therefore any per-type
  * overloads of ostd::range_put_all.
  *
+ * If both ranges are contiguous with the same trivially copyable element
+ * type and `orange` is big enough, the memory is copied directly. The
+ * returned range is then `orange` sliced past the copied elements, just
+ * like it would be after putting them one by one.
+ *
  * @see ostd::copy_if(), ostd::copy_if_not()
  */
 template<typename InputRange, typename OutputRange>
 inline OutputRange copy(InputRange irange, OutputRange orange) {
+    if constexpr(
+        detail::algo_trivial_range<InputRange> &&
+        detail::algo_trivial_range<OutputRange>
+    ) {
+        using T = detail::algo_elem_t<InputRange>;
+        if constexpr(
+            std::is_same_v<T, detail::algo_elem_t<OutputRange>> &&
+            !std::is_const_v<std::remove_reference_t<
+                range_reference_t<OutputRange>
+            >>
+        ) {
+            std::size_t n = irange.size();
+            std::size_t on = orange.size();
+            /* when it doesn't fit, fall back so the error is the same */
+            if (n <= on) {
+                if (n) {
+                    std::memmove(
+                        &orange.front(), &irange.front(), n * sizeof(T)
+                    );
+                }
+                return orange.slice(
+                    range_size_t<OutputRange>(n),
+                    range_size_t<OutputRange>(on)
+                );
+            }
+        }
+    }
     range_put_all(orange, irange);
     return orange;
 }
@@ -996,6 +1319,9 @@ inline OutputRange copy_if_not(
  *     using std::swap;
  *     swap(range.front(), range.back());
  *     range.pop_front();
+ *     if (range.empty()) {
+ *         break;
+ *     }
  *     range.pop_back();
  * }
  * ~~~
@@ -1012,6 +1338,10 @@ inline void reverse(BidirRange range) {
         using std::swap;
         swap(range.front(), range.back());
         range.pop_front();
+        /* the middle element of an odd range stays where it is */
+        if (range.empty()) {
+            break;
+        }
         range.pop_back();
     }
 }
@@ -1051,11 +1381,65 @@ inline OutputRange reverse_copy(BidirRange irange, OutputRange orange) {
  */
 template<typename InputRange, typename Value>
 inline void fill(InputRange range, Value const &v) {
+    using T = detail::algo_elem_t<InputRange>;
+    /* a byte fill is a memset, wider ones do as well with the plain loop */
+    if constexpr(
+        detail::algo_contiguous<InputRange> &&
+        std::is_lvalue_reference_v<range_reference_t<InputRange>> &&
+        (std::is_integral_v<T> || std::is_enum_v<T>) && (sizeof(T) == 1)
+    ) {
+        std::size_t n = range.size();
+        if (n) {
+            T bv = v;
+            std::memset(&range.front(), detail::algo_bits(bv), n);
+        }
+        return;
+    }
     for (; !range.empty(); range.pop_front()) {
         range.front() = v;
     }
 }
 
+#ifdef OSTD_BUILD_TESTS
+OSTD_UNIT_TEST {
+    using ostd::test::fail_if;
+    using ostd::test::fail_if_not;
+    /* these go through the raw memory paths, with enough elements
+     * to cover both the vector loops and their remainders
+     */
+    std::vector<int> v = {
+        4, 8, 15, 16, 23, 42, 8, 4, 8, 15, 16, 23, 42, 8, 1, 8, 9
+    };
+    fail_if(count(iter(v), 8) != 5);
+    fail_if(find(iter(v), 42).size() != (v.size() - 5));
+    fail_if(find(iter(v), 9).size() != 1);
+    fail_if_not(find(iter(v), 7).empty());
+    fail_if(count(iter(v), 7) != 0);
+    std::vector<long long> lv = { 1, 2, 3, 1LL << 40, 5 };
+    fail_if(find(iter(lv), 1LL << 40).size() != 2);
+    fail_if(find(iter(lv), 1LL << 41).size() != 0);
+    std::vector<int> w(v.size() + 2);
+    auto rest = copy(iter(v), iter(w));
+    fail_if(rest.size() != 2);
+    fail_if_not(equal(iter(v), iter(w).slice(0, v.size())));
+    fail_if(equal(iter(v), iter(w)));
+    reverse(iter(w));
+    fail_if((w[0] != 0) || (w[1] != 0) || (w[2] != 9) || (w.back() != 4));
+    fill(iter(w), 3);
+    fail_if(count(iter(w), 3) != w.size());
+    std::vector<unsigned char> a = { 1, 2, 3 }, b = { 1, 2, 200 };
+    fail_if_not(lexicographical_compare(iter(a), iter(b)));
+    fail_if(lexicographical_compare(iter(b), iter(a)));
+    fail_if_not(lexicographical_compare(iter(a).slice(0, 2), iter(a)));
+    fail_if(lexicographical_compare(iter(a), iter(a)));
+    std::vector<char> s(100);
+    fill(iter(s), 'x');
+    s[77] = 'y';
+    fail_if(find(iter(s), 'y').size() != 23);
+    fail_if(count(iter(s), 'x') != 99);
+}
+#endif
+
 /** @brief Fills the given input range with calls to `gen`.
  *
  * Iterates over `range` and assigns `gen()` to each element. The elements
@@ -1115,7 +1499,8 @@ inline void iota(InputRange range, Value value) {
  * element is added to `init` using the `+` operator. Once that is
  * done, `init` is returned.
  *
- * The `range` must be at least ostd::input_range_tag.
+ * The `range` must be at least ostd::input_range_tag. The iteration is
+ * done with ostd::range_traverse().
  *
  * A function-based version as well as right-folds are provided as well.
  *
@@ -1123,9 +1508,10 @@ inline void iota(InputRange range, Value value) {
  */
 template<typename InputRange, typename Value>
 inline Value foldl(InputRange range, Value init) {
-    for (; !range.empty(); range.pop_front()) {
-        init = init + range.front();
-    }
+    range_traverse(range, [&init](auto &&v) {
+        init = init + std::forward<decltype(v)>(v);
+        return true;
+    });
     return init;
 }
 
@@ -1135,7 +1521,8 @@ inline Value foldl(InputRange range, Value init) {
  * is assigned as `init = func(init, range.front())`. Once that is
  * done, `init` is returned.
  *
- * The `range` must be at least ostd::input_range_tag.
+ * The `range` must be at least ostd::input_range_tag. The iteration is
+ * done with ostd::range_traverse().
  *
  * A `+` operator-based version as well as right-folds are provided as well.
  *
@@ -1143,9 +1530,10 @@ inline Value foldl(InputRange range, Value init) {
  */
 template<typename InputRange, typename Value, typename BinaryFunction>
 inline Value foldl_f(InputRange range, Value init, BinaryFunction func) {
-    for (; !range.empty(); range.pop_front()) {
-        init = func(init, range.front());
-    }
+    range_traverse(range, [&init, &func](auto &&v) {
+        init = func(init, std::forward<decltype(v)>(v));
+        return true;
+    });
     return init;
 }
 
@@ -1276,6 +1664,13 @@ namespace detail {
             return p_func(p_range[idx]);
         }
 
+        template<typename FF>
+        bool traverse(FF &func) const {
+            return range_traverse(p_range, [this, &func](auto &&v) {
+                return func(p_func(std::forward<decltype(v)>(v)));
+            });
+        }
+
         map_range slice(size_type start, size_type end) const {
             return map_range(p_range.slice(start, end), p_func);
         }
@@ -1431,6 +1826,64 @@ inline auto filter(Predicate &&pred) {
     };
 }
 
+#ifdef OSTD_BUILD_TESTS
+OSTD_UNIT_TEST {
+    using ostd::test::fail_if;
+    /* the sinks traverse the chains internally, so compare them against
+     * the same chains consumed one element at a time
+     */
+    auto by_pop = [](auto r) {
+        std::vector<long> ret;
+        for (; !r.empty(); r.pop_front()) {
+            ret.push_back(long(r.front()));
+        }
+        return ret;
+    };
+    auto by_traverse = [](auto r) {
+        std::vector<long> ret;
+        for_each(r, [&ret](auto v) { ret.push_back(long(v)); });
+        return ret;
+    };
+    std::vector<int> v = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+    std::vector<int> e;
+    auto chain = iter(v) | filter([](int i) { return i % 2; })
+                         | map([](int i) { return i * 3; });
+    fail_if(by_pop(chain) != by_traverse(chain));
+    fail_if(by_traverse(chain) != std::vector<long>{ 3, 9, 15, 21, 27 });
+    fail_if(foldl(chain, 0) != 75);
+    fail_if(foldl(range(100) | map([](int i) { return i * 2; }), 0) != 9900);
+    auto taken = range(1000).take(4);
+    fail_if(by_traverse(taken) != std::vector<long>{ 0, 1, 2, 3 });
+    auto ptaken = iter(v).take(20);
+    fail_if(by_pop(ptaken) != by_traverse(ptaken));
+    auto joined = iter(e).join(iter(v).take(3), iter(e), range(7, 9));
+    fail_if(by_pop(joined) != by_traverse(joined));
+    fail_if(by_traverse(joined) != std::vector<long>{ 1, 2, 3, 7, 8 });
+    auto zipped = iter(v).zip(iter(v).slice(2)) | map([](auto p) {
+        return p.first * p.second;
+    });
+    fail_if(by_pop(zipped) != by_traverse(zipped));
+    fail_if(foldl(zipped, 0) != 276);
+    auto zipped2 = range(5).zip(iter(v)) | map([](auto p) {
+        return p.first + p.second;
+    });
+    fail_if(by_pop(zipped2) != by_traverse(zipped2));
+    std::size_t nchunks = 0;
+    for_each(iter(v).chunks(3), [&nchunks](auto ch) {
+        nchunks += foldl(ch, 0) ? 1 : 0;
+    });
+    fail_if(nchunks != 4);
+    fail_if(from_range<std::vector<long>>(chain) != by_pop(chain));
+    fail_if(from_range<std::vector<int>>(iter(v)) != v);
+    /* stopping early */
+    int seen = 0;
+    range_traverse(joined, [&seen](long) { return ++seen < 4; });
+    fail_if(seen != 4);
+    auto out = copy(chain, appender<std::vector<int>>());
+    fail_if(from_range<std::vector<long>>(iter(out.get())) != by_pop(chain));
+}
+#endif
+
 /** @} */
 
 } /* namespace ostd */
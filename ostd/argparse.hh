@@ -49,7 +49,7 @@ struct OSTD_EXPORT arg_error: std::runtime_error {
 
     template<typename ...A>
     arg_error(string_range fmt, A const &...args):
-        arg_error(format(appender<std::string>(), fmt, args...).get())
+        arg_error(format_to_string(fmt, args...))
     {}
 };
 
@@ -22,8 +22,12 @@
 #ifndef OSTD_BUILD_MAKE_HH
 #define OSTD_BUILD_MAKE_HH
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
 #include <list>
-#include <stack>
+#include <memory>
 #include <queue>
 #include <vector>
 #include <unordered_map>
@@ -31,16 +35,22 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <exception>
 #include <future>
 #include <stdexcept>
 #include <chrono>
 #include <type_traits>
 
+#include <ostd/unit_test.hh>
 #include <ostd/range.hh>
 #include <ostd/string.hh>
 #include <ostd/thread_pool.hh>
 #include <ostd/path.hh>
 #include <ostd/io.hh>
+#include <ostd/build/make_db.hh>
+#include <ostd/build/make_cache.hh>
+#include <ostd/build/make_jobserver.hh>
+#include <ostd/build/make_trace.hh>
 
 namespace ostd {
 namespace build {
@@ -55,7 +65,7 @@ struct make_error: std::runtime_error {
     template<typename ...A>
     make_error(string_range fmt, A const &...args):
         make_error(
-            ostd::format(ostd::appender<std::string>(), fmt, args...).get()
+            ostd::format_to_string(fmt, args...)
         )
     {}
 };
@@ -68,6 +78,17 @@ struct OSTD_EXPORT make_pattern {
 
     std::pair<std::size_t, std::size_t> match(string_range target);
     std::string replace(string_range dep) const;
+
+    /* like the above, but without keeping any state, so that several
+     * threads can match at once; the stem is put in sub, and replace()
+     * uses the buffer only when there is something to replace
+     */
+    std::pair<std::size_t, std::size_t> match(
+        string_range target, string_range &sub
+    ) const;
+    string_range replace(
+        string_range dep, string_range sub, std::string &buf
+    ) const;
 private:
     std::string p_target;
     std::vector<string_range> p_subs{};
@@ -132,6 +153,45 @@ struct make_rule {
         return *this;
     }
 
+    /* identifies what the body does for the build database, e.g. the
+     * command line, so that changing it results in a rebuild
+     */
+    make_rule &signature(
+        std::function<std::string(string_range)> sig_f
+    ) noexcept {
+        p_sig = std::move(sig_f);
+        return *this;
+    }
+
+    std::string signature(string_range target) const {
+        if (!p_sig) {
+            return std::string{};
+        }
+        return p_sig(target);
+    }
+
+    /* the dependency file the body writes, e.g. with the -MD option of a
+     * compiler; the dependencies in it are taken into account when
+     * checking whether the target is up to date on the next run, and with
+     * a database they're kept in it, so the file does not have to stay
+     */
+    make_rule &depfile(
+        std::function<std::string(string_range)> dep_f
+    ) noexcept {
+        p_depfile = std::move(dep_f);
+        return *this;
+    }
+
+    std::string depfile(string_range target) const {
+        if (!p_depfile) {
+            return std::string{};
+        }
+        return p_depfile(target);
+    }
+
+    /* the condition is checked while resolving the graph, which may be
+     * done on several threads at once, see make::serial_resolve()
+     */
     make_rule &cond(std::function<bool(string_range)> cond_f) noexcept {
         p_cond = std::move(cond_f);
         return *this;
@@ -148,15 +208,35 @@ struct make_rule {
         string_range tgt, std::function<void(string_range)> body
     ) const {
         auto app = appender<std::vector<std::string>>();
-        for (auto &f: p_deps) {
+        depends(tgt, app, body);
+    }
+
+    /* reuses the given appender for the dependency functions; the plain
+     * names are passed as they are, so that they're not copied
+     */
+    template<typename F>
+    void depends(
+        string_range tgt, decltype(appender<std::vector<std::string>>()) &app,
+        F &&body
+    ) const {
+        for (auto &d: p_deps) {
+            if (!d.func) {
+                body(string_range{d.name});
+                continue;
+            }
             app.clear();
-            f(tgt, app);
+            d.func(tgt, app);
             for (auto &s: app.get()) {
-                body(s);
+                body(string_range{s});
             }
         }
     }
 
+    /* the dependencies are plain names, lists of them or functions that
+     * put them in the given appender; functions are called while the
+     * graph is resolved, which may be done on several threads at once,
+     * see make::serial_resolve()
+     */
     template<typename ...A>
     make_rule &depend(A &&...args) {
         (add_depend(std::forward<A>(args)), ...);
@@ -177,12 +257,18 @@ private:
         void(string_range, iterator_range<string_range *>)
     >;
 
+    /* either a plain name or a function */
+    struct dep_entry {
+        std::string name;
+        depend_func func;
+    };
+
     template<typename R>
     void add_depend(R &&v) {
         if constexpr (std::is_constructible_v<std::string, R const &>) {
-            p_deps.push_back(make_depend_simple(v));
+            p_deps.push_back(dep_entry{std::string{v}, depend_func{}});
         } else if constexpr(std::is_constructible_v<depend_func, R &&>) {
-            p_deps.push_back(std::forward<R>(v));
+            p_deps.push_back(dep_entry{std::string{}, std::forward<R>(v)});
         } else {
             R mr{v};
             for (auto const &sv: mr) {
@@ -192,12 +278,17 @@ private:
     }
 
     make_pattern p_target;
-    std::vector<depend_func> p_deps{};
+    std::vector<dep_entry> p_deps{};
     body_func p_body{};
     std::function<bool(string_range)> p_cond{};
+    std::function<std::string(string_range)> p_sig{};
+    std::function<std::string(string_range)> p_depfile{};
     bool p_action = false;
 };
 
+/* a task is resumed once when it starts and then every time one of the
+ * tasks it pushed through make::push_task() finishes, until it's done
+ */
 struct OSTD_EXPORT make_task {
     make_task() {}
     virtual ~make_task();
@@ -266,6 +357,72 @@ inline make_task *make_task_simple(
     return new detail::make_task_simple{target, std::move(deps), rl};
 }
 
+namespace detail {
+    /* the rules that may match a target, so that rule lookup does not
+     * have to try every single rule; exact targets are hashed, while the
+     * patterns are put in a trie of reversed suffixes (the part after %),
+     * the nodes of which refer to tries of prefixes (the part before %)
+     */
+    struct OSTD_EXPORT make_rule_index {
+        void add(string_range pattern, std::size_t idx);
+
+        /* the candidates in the order the rules were added */
+        void find(string_range target, std::vector<std::size_t> &out) const;
+
+    private:
+        struct trie_node {
+            std::vector<std::pair<char, std::size_t>> next{};
+            std::vector<std::size_t> items{};
+        };
+        using trie = std::vector<trie_node>;
+
+        static std::size_t trie_insert(trie &t, string_range key, bool rev);
+        static std::size_t trie_next(trie const &t, std::size_t n, char c);
+
+        std::deque<std::string> p_names{};
+        std::unordered_map<
+            string_range, std::vector<std::size_t>
+        > p_exact{};
+        trie p_suffixes{trie_node{}};
+        std::vector<trie> p_prefixes{};
+    };
+}
+
+/* the statistics of the last make::exec() call */
+struct make_stats {
+    /* the targets in the dependency graph, or those of it that were
+     * checked again in watch mode
+     */
+    std::size_t targets = 0;
+    /* the targets whose body was run */
+    std::size_t executed = 0;
+    unsigned int threads = 0;
+    /* the time the whole build took */
+    std::chrono::nanoseconds wall{0};
+    /* the time spent running bodies and pushed tasks, on all threads */
+    std::chrono::nanoseconds busy{0};
+    /* the longest path through the graph as estimated before building,
+     * from the timings of previous runs; zero without a database
+     */
+    std::chrono::nanoseconds critical_path{0};
+    /* the targets restored from the action cache, those looked up there
+     * without success, and the outputs stored in it
+     */
+    std::size_t cache_hits = 0;
+    std::size_t cache_misses = 0;
+    std::size_t cache_stored = 0;
+
+    /* the average fraction of the threads that was kept busy */
+    double utilization() const noexcept {
+        if (!threads || !wall.count()) {
+            return 0.0;
+        }
+        return double(busy.count()) / (double(wall.count()) * threads);
+    }
+};
+
+struct make_watcher;
+
 struct OSTD_EXPORT make {
     using task_factory = std::function<
         make_task *(string_range, std::vector<string_range>, make_rule &)
@@ -277,12 +434,110 @@ struct OSTD_EXPORT make {
         p_tpool.start(threads);
     }
 
+    /* the whole dependency graph of the target is resolved first, then
+     * the targets are built as their dependencies finish, those with the
+     * longest path ahead of them first; with a database, the costs of the
+     * targets are estimated from their previous build times
+     *
+     * the graph is resolved on the threads of the pool unless disabled
+     * with serial_resolve(), so the conditions and dependency functions
+     * of the rules may be called concurrently
+     */
     void exec(string_range target);
 
+    /* build the target, and then keep building it again whenever its
+     * inputs change until the callback returns false; the callback gets
+     * the error the build failed with, if any, and may rethrow it to stop
+     *
+     * the graph is only resolved once, and only the targets downstream
+     * of the changed files are checked again; the files include those
+     * discovered through depfiles, and changes are collected until there
+     * are none for the given time, so that a batch of them results in a
+     * single build; files changed while a build is running are built
+     * again right after it; this is only supported on Linux
+     */
+    void watch(
+        string_range target, std::function<bool(std::exception_ptr)> on_build,
+        std::chrono::milliseconds quiet = std::chrono::milliseconds{50}
+    );
+
+    /* use a persistent build database with the given log file; targets
+     * are then rebuilt only when the contents of their dependencies or
+     * the signature of their rule change, rather than by timestamps
+     */
+    void database(string_range path) {
+        p_db = std::make_unique<make_db>(path);
+    }
+
+    make_db *database() const noexcept {
+        return p_db.get();
+    }
+
+    /* use a local action cache in the given directory, trimmed to the
+     * given size after every exec(); targets that would be rebuilt are
+     * then restored from it when they were built before with the same
+     * rule signature and inputs, without running their bodies, which
+     * requires a database
+     */
+    void cache(string_range dir, std::uint64_t max_size = 4ULL << 30) {
+        p_acache = std::make_unique<make_cache>(dir, max_size);
+    }
+
+    make_cache *cache() const noexcept {
+        return p_acache.get();
+    }
+
+    /* limit the tasks pushed with push_task() by the job tokens of a GNU
+     * make jobserver; that of a parent make is used if there is one and
+     * otherwise, unless the number of jobs is zero, a new one is created
+     * and passed on to the processes started by the tasks
+     */
+    void jobserver(unsigned int jobs) {
+        p_jobs = make_jobserver::connect();
+        if (!p_jobs && jobs) {
+            p_jobs = make_jobserver::create(jobs);
+        }
+    }
+
+    make_jobserver *jobserver() const noexcept {
+        return p_jobs.get();
+    }
+
+    /* write a trace of every exec() to the given file, in the format of
+     * the Chrome trace viewer; targets and pushed tasks are put on the
+     * threads they ran on, with the time they waited to run
+     */
+    void trace(string_range path) {
+        p_trace = std::make_unique<make_trace>(path);
+    }
+
+    make_trace *trace() const noexcept {
+        return p_trace.get();
+    }
+
+    /* resolve the graph on the calling thread alone, for rules whose
+     * conditions or dependency functions are not thread safe; by default
+     * the rules of large graphs are found on all threads of the pool
+     */
+    void serial_resolve(bool serial) noexcept {
+        p_serial = serial;
+    }
+
+    bool serial_resolve() const noexcept {
+        return p_serial;
+    }
+
+    make_stats const &stats() const noexcept {
+        return p_stats;
+    }
+
     std::shared_future<void> push_task(std::function<void()> func);
 
     make_rule &rule(string_range tgt) {
+        /* the found rules may change and the list may move */
+        p_cache.invalidate();
         p_rules.emplace_back(tgt);
+        p_index.add(tgt, p_rules.size() - 1);
         return p_rules.back();
     }
 
@@ -291,52 +546,271 @@ struct OSTD_EXPORT make {
     }
 
 private:
+    struct rule_list;
+
     struct rule_inst {
-        std::vector<std::string> deps;
+        /* the entries of the dependencies in p_cache */
+        std::vector<rule_list *> deps;
         make_rule *rule;
     };
 
-    OSTD_LOCAL void wait_rest(std::queue<std::unique_ptr<make_task>> &tasks);
+    /* the rules found for a target, kept across exec() calls */
+    struct rule_list {
+        string_range name{};
+        std::vector<rule_inst> rules{};
+        std::exception_ptr error{};
+        bool resolved = false;
+        /* taken by whoever finds the target first, to resolve it */
+        bool queued = false;
+    };
 
-    template<typename F>
-    void wait_for(F func) {
-        std::queue<std::unique_ptr<make_task>> tasks;
-        p_waiting.push(&tasks);
-        try {
-            func();
-        } catch (...) {
-            p_waiting.pop();
-            throw;
-        }
-        p_waiting.pop();
-        wait_rest(tasks);
-    }
+    /* the targets seen so far along with their rules; the names are
+     * stored once in blocks that never move, and spread over shards by
+     * their hashes so that several threads can look them up at once
+     */
+    struct OSTD_EXPORT rule_cache {
+        /* the entry of the name, added if there is none yet; `claimed`
+         * tells whether the caller is the first to take it for resolving
+         */
+        rule_list &get(string_range name, bool *claimed = nullptr);
+
+        /* forgets the found rules, but keeps the names */
+        void invalidate();
+
+    private:
+        static constexpr std::size_t nshards = 16;
+
+        struct shard {
+            std::mutex mtx{};
+            std::unordered_map<string_range, rule_list> lists{};
+            std::vector<std::unique_ptr<char[]>> blocks{};
+            char *cur = nullptr;
+            std::size_t left = 0;
+        };
+
+        shard p_shards[nshards];
+        /* whether any entry was taken since the last invalidate() */
+        std::atomic<bool> p_taken{false};
+    };
+
+    /* reused by a resolving thread for every target */
+    struct resolve_buf {
+        decltype(appender<std::vector<std::string>>()) deps =
+            appender<std::vector<std::string>>();
+        std::vector<std::size_t> cands{};
+        std::string name{};
+        /* the dependencies taken for resolving */
+        std::vector<rule_list *> next{};
+    };
+
+    /* what to record in the database once a task is done */
+    struct db_pending {
+        std::string target;
+        make_db::target_entry entry;
+    };
+
+    /* a target in the graph of the current exec() call */
+    struct graph_node {
+        string_range name;
+        /* null for existing files with no rules */
+        std::vector<rule_inst> *rlist = nullptr;
+        std::vector<std::size_t> dependents{};
+        /* the dependencies that are not done yet */
+        std::size_t npending = 0;
+        /* the estimated cost and the longest path from here to the end */
+        double cost = 0.0, prio = 0.0;
+        /* when it became ready to build, only kept when tracing */
+        std::chrono::steady_clock::time_point ready{};
+        bool visiting = false;
+    };
+
+    /* a target whose task is in progress */
+    struct running_task {
+        std::size_t node;
+        std::unique_ptr<make_task> task{};
+        /* to record what was discovered in the build database */
+        std::string depfile{};
+        std::vector<string_range> deps{};
+        db_pending pend{};
+        /* the action cache key, zero when not caching */
+        std::uint64_t key = 0;
+        /* the row of the trace it's shown on */
+        std::size_t lane = 0;
+        bool rec = false;
+        std::chrono::steady_clock::time_point start{};
+        /* what the discovered dependencies' times are compared to */
+        fs::file_time_t stamp{};
+    };
 
-    OSTD_LOCAL void exec_rlist(
-        string_range tname, std::vector<rule_inst> const &rlist
+    /* the nodes to check again when an input changes */
+    using watch_map = std::unordered_map<
+        std::string, std::vector<std::size_t>
+    >;
+
+    OSTD_LOCAL void run_build(
+        string_range target, std::vector<bool> const *affected
+    );
+    OSTD_LOCAL void clear_graph();
+    OSTD_LOCAL void watch_inputs(
+        make_watcher &w, watch_map &inputs, std::vector<bool> const &affected,
+        std::vector<std::string> *fresh
+    );
+    OSTD_LOCAL std::size_t plan(rule_list &rl, string_range from);
+    OSTD_LOCAL void prioritize(std::vector<bool> const *affected);
+    OSTD_LOCAL void queue_nodes(std::vector<bool> const *affected);
+    OSTD_LOCAL void run_graph();
+    OSTD_LOCAL make_rule *body_rule(graph_node const &nd);
+    OSTD_LOCAL bool start_node(std::size_t idx, running_task &rt);
+    OSTD_LOCAL bool resume_task(running_task &rt);
+    OSTD_LOCAL void task_done(running_task &rt);
+    OSTD_LOCAL void record_done(
+        running_task &rt, std::vector<std::string> *found
+    );
+    OSTD_LOCAL bool cache_restore(
+        running_task &rt, std::vector<string_range> const &rdeps
+    );
+    OSTD_LOCAL void node_ready(std::size_t idx);
+    OSTD_LOCAL void node_done(std::size_t idx);
+    OSTD_LOCAL void wait_woken(std::vector<make_task *> &woken);
+
+    OSTD_LOCAL std::vector<std::string> const *found_deps(
+        string_range tname, string_range depfile,
+        std::vector<std::string> &buf
     );
 
-    OSTD_LOCAL void exec_rule(
-        string_range target, string_range from = nullptr
+    OSTD_LOCAL bool db_check(
+        string_range tname, std::vector<string_range> const &deps,
+        make_rule const &rl, db_pending &pend
     );
 
-    OSTD_LOCAL void find_rules(
-        string_range target, std::vector<rule_inst> &rlist
+    OSTD_LOCAL rule_list &resolve(string_range target);
+    OSTD_LOCAL void find_rules(rule_list &rl, resolve_buf &buf);
+    OSTD_LOCAL void find_rules_impl(
+        string_range target, std::vector<rule_inst> &rlist, resolve_buf &buf
     );
 
     std::vector<make_rule> p_rules{};
-    std::unordered_map<string_range, std::vector<rule_inst>> p_cache{};
+    detail::make_rule_index p_index{};
+    rule_cache p_cache{};
 
     thread_pool p_tpool{};
+    bool p_serial = false;
 
     std::mutex p_mtx{};
     std::condition_variable p_cond{};
-    std::stack<std::queue<std::unique_ptr<make_task>> *> p_waiting{};
     task_factory p_factory{};
+    std::unique_ptr<make_db> p_db{};
+    std::unique_ptr<make_jobserver> p_jobs{};
+    std::unique_ptr<make_cache> p_acache{};
+    std::unique_ptr<make_trace> p_trace{};
+
+    std::vector<graph_node> p_nodes{};
+    std::unordered_map<string_range, std::size_t> p_nodemap{};
+    /* the nodes with all dependencies before them */
+    std::vector<std::size_t> p_order{};
+    std::priority_queue<std::pair<double, std::ptrdiff_t>> p_ready{};
+
+    make_stats p_stats{};
+    std::atomic<std::int64_t> p_busy{0};
+    /* the trace lanes taken by running targets */
+    std::vector<bool> p_lanes{};
     make_task *p_current = nullptr;
-    bool p_avail = false;
+    string_range p_current_name{};
+    /* the tasks that had a pushed task finish and the number of pushed
+     * tasks that did not finish yet, protected by p_mtx
+     */
+    std::vector<make_task *> p_woken{};
+    std::size_t p_inflight = 0;
 };
 
+#ifdef OSTD_BUILD_TESTS
+#define OSTD_TEST_MODULE libostd_build_make
+
+namespace detail {
+    /* looks up target among the given patterns through the index and
+     * picks the rule like the make does, by the longest part after the
+     * stem and then the shortest stem; the candidates must be exactly the
+     * matching patterns in the order they were added, a tie gives -1
+     */
+    inline std::ptrdiff_t make_rule_index_pick(
+        std::initializer_list<char const *> pats, string_range target
+    ) {
+        using ostd::test::fail_if;
+        make_rule_index idx;
+        std::vector<make_pattern> mps;
+        for (char const *pat: pats) {
+            idx.add(pat, mps.size());
+            mps.emplace_back(pat);
+        }
+        std::vector<std::size_t> cands, matching;
+        idx.find(target, cands);
+        std::ptrdiff_t ret = -1;
+        bool tie = false;
+        std::size_t pfnl = 0, psubl = 0;
+        for (std::size_t i = 0; i < mps.size(); ++i) {
+            string_range sub;
+            auto [fnl, subl] = mps[i].match(target, sub);
+            if (!(fnl + subl)) {
+                continue;
+            }
+            matching.push_back(i);
+            if (matching.size() == 1) {
+                ret = std::ptrdiff_t(i);
+            } else if ((fnl == pfnl) && (subl == psubl)) {
+                tie = true;
+            } else if ((fnl > pfnl) || ((fnl == pfnl) && (subl < psubl))) {
+                ret = std::ptrdiff_t(i);
+            } else {
+                continue;
+            }
+            pfnl = fnl;
+            psubl = subl;
+        }
+        fail_if(cands != matching);
+        return tie ? -1 : ret;
+    }
+}
+
+OSTD_UNIT_TEST {
+    using ostd::test::fail_if;
+    /* exact targets win over the patterns matching them */
+    auto pats = {"%.o", "foo.o", "f%.o"};
+    fail_if(detail::make_rule_index_pick(pats, "foo.o") != 1);
+    fail_if(detail::make_rule_index_pick(pats, "bar.o") != 0);
+    fail_if(detail::make_rule_index_pick(pats, "fab.o") != 2);
+    fail_if(detail::make_rule_index_pick(pats, "foo.c") != -1);
+    fail_if(detail::make_rule_index_pick({"foo.o", "%.o"}, "foo.o") != 0);
+}
+
+OSTD_UNIT_TEST {
+    using ostd::test::fail_if;
+    /* the longest matching suffix wins, wherever its rule was added */
+    auto pats = {"%.o", "%.tab.o", "%b.o", "%.c"};
+    fail_if(detail::make_rule_index_pick(pats, "parse.tab.o") != 1);
+    fail_if(detail::make_rule_index_pick(pats, "x.b.o") != 2);
+    fail_if(detail::make_rule_index_pick(pats, "a.o") != 0);
+    fail_if(detail::make_rule_index_pick(pats, "a.h") != -1);
+    fail_if(detail::make_rule_index_pick({"%.tab.o", "%.o"}, "p.tab.o"));
+}
+
+OSTD_UNIT_TEST {
+    using ostd::test::fail_if;
+    /* the suffix goes first, a prefix only breaks ties between equal
+     * suffixes, and the same pattern twice is a tie
+     */
+    fail_if(detail::make_rule_index_pick({"lib%", "%.so"}, "libx.so") != 1);
+    fail_if(detail::make_rule_index_pick({"%.so", "libx%"}, "libx.so"));
+    fail_if(detail::make_rule_index_pick({"%.so", "lib%.so"}, "libx.so") != 1);
+    fail_if(detail::make_rule_index_pick({"li%.so", "l%.so"}, "libx.so"));
+    fail_if(detail::make_rule_index_pick({"lib%", "%.so"}, "libx.a") != 0);
+    fail_if(detail::make_rule_index_pick(
+        {"%.so", "lib%.so", "lib%.so"}, "libx.so"
+    ) != -1);
+}
+
+#undef OSTD_TEST_MODULE
+#endif
+
 /** @} */
 
 } /* namespace build */
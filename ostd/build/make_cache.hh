@@ -0,0 +1,144 @@
+/** @addtogroup Build
+ * @{
+ */
+
+/** @file make_cache.hh
+ *
+ * @brief A local content-addressed cache of build outputs.
+ *
+ * Switching between branches of a project makes the same targets get
+ * rebuilt from the same inputs over and over. The cache in this file
+ * remembers what each rule invocation produced, keyed by the hashes of
+ * its target, its rule signature and the contents of its inputs, so
+ * that when the same invocation comes up again, the output is simply
+ * restored and the rule body doesn't run at all.
+ *
+ * Outputs are stored in a directory under their content hashes, so
+ * identical outputs are only stored once. They're restored as reflinks
+ * where the file system supports it, hard links otherwise, and copies
+ * as the last resort. The cache is trimmed to its size limit by removing
+ * the least recently used entries.
+ *
+ * @copyright See COPYING.md in the project tree for further information.
+ */
+
+#ifndef OSTD_BUILD_MAKE_CACHE_HH
+#define OSTD_BUILD_MAKE_CACHE_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <ostd/platform.hh>
+#include <ostd/string.hh>
+#include <ostd/path.hh>
+#include <ostd/build/make_db.hh>
+
+namespace ostd {
+namespace build {
+
+/** @addtogroup Build
+ * @{
+ */
+
+/** @brief A local content-addressed cache of build outputs.
+ *
+ * The cache uses a ostd::build::make_db to hash files, and is used by
+ * ostd::build::make, see make::cache(). It's not thread safe, but any
+ * number of processes may share the same cache directory.
+ *
+ * Dependencies discovered while building (see make_rule::depfile()) are
+ * not known before the rule runs, so every invocation may have several
+ * cached results, one for each set of discovered dependencies seen with
+ * it; a result is used when the contents of all its discovered
+ * dependencies match.
+ */
+struct OSTD_EXPORT make_cache {
+    /** @brief Uses the given directory, with the given size limit in bytes.
+     *
+     * The directory is created if it doesn't exist.
+     *
+     * @throws ostd::fs::fs_error if the directory cannot be created.
+     */
+    make_cache(string_range dir, std::uint64_t max_size);
+
+    /** @brief Gets the cache directory. */
+    ostd::path const &directory() const noexcept {
+        return p_dir;
+    }
+
+    /** @brief Gets the size limit of the cache in bytes. */
+    std::uint64_t max_size() const noexcept {
+        return p_max;
+    }
+
+    /** @brief Restores the output of an invocation if it's cached.
+     *
+     * The `key` identifies the invocation. On success, the target file is
+     * replaced with the cached output and the dependencies discovered
+     * when it was built are put in `deps`.
+     *
+     * @returns True on a cache hit.
+     */
+    bool restore(
+        std::uint64_t key, make_db &db, string_range target,
+        std::vector<std::string> &deps
+    );
+
+    /** @brief Stores the output of an invocation in the cache.
+     *
+     * The `deps` are the dependencies discovered when building it. Errors
+     * are not fatal, as the cache is just an optimization.
+     *
+     * @returns True if the output was stored.
+     */
+    bool store(
+        std::uint64_t key, make_db &db, string_range target,
+        std::vector<std::string> const &deps
+    );
+
+    /** @brief Makes sure a target about to be rebuilt is not shared.
+     *
+     * A target restored as a hard link shares its contents with the cache,
+     * so it's removed when there is more than one link to it, to keep
+     * tools that write into existing files from altering the cache.
+     */
+    static void detach(string_range target);
+
+    /** @brief Trims the cache to its size limit.
+     *
+     * The least recently used entries are removed until the cache takes
+     * at most 90% of the limit, so that it's not trimmed all the time.
+     *
+     * @returns The number of bytes removed.
+     */
+    std::uint64_t trim();
+
+private:
+    struct entry {
+        std::vector<std::string> deps;
+        std::uint64_t deps_hash;
+        std::uint64_t output;
+    };
+
+    OSTD_LOCAL ostd::path object_path(std::uint64_t hash) const;
+    OSTD_LOCAL ostd::path manifest_path(std::uint64_t key) const;
+    OSTD_LOCAL std::string temp_name(ostd::path const &p);
+    OSTD_LOCAL bool read_manifest(
+        ostd::path const &p, std::vector<entry> &ents
+    );
+
+    ostd::path p_dir;
+    std::uint64_t p_max;
+    std::size_t p_ntemp = 0;
+};
+
+/** @} */
+
+} /* namespace build */
+} /* namespace ostd */
+
+#endif
+
+/** @} */
@@ -56,7 +56,7 @@ namespace detail {
             for (;;) {
                 auto fs = f.wait_for(std::chrono::seconds(0));
                 if (fs != std::future_status::ready) {
-                    /* keep yielding until ready */
+                    /* we only get resumed once the task has finished */
                     auto &cc = static_cast<coroutine<void()> &>(
                         *coroutine_context::current()
                     );
@@ -0,0 +1,402 @@
+/** @addtogroup Build
+ * @{
+ */
+
+/** @file make_db.hh
+ *
+ * @brief A persistent database of build state.
+ *
+ * The build system by default decides whether a target is out of date by
+ * comparing modification times, which has no memory between runs, so just
+ * touching a file or checking out a different revision with the same
+ * contents results in rebuilds. The database in this file keeps a log of
+ * content hashes of files as well as what each target was built from, so
+ * that targets are only rebuilt when something actually changed. It also
+ * keeps the time each target took to build, used for scheduling, and the
+ * dependencies discovered while building, such as the headers a compiler
+ * reports in a depfile.
+ *
+ * The log is mapped into memory and loaded in one go at startup and new
+ * records are appended to it while building. Content hashes are only
+ * computed when the size or modification time of a file changes.
+ *
+ * @copyright See COPYING.md in the project tree for further information.
+ */
+
+#ifndef OSTD_BUILD_MAKE_DB_HH
+#define OSTD_BUILD_MAKE_DB_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include <ostd/platform.hh>
+#include <ostd/unit_test.hh>
+#include <ostd/range.hh>
+#include <ostd/string.hh>
+#include <ostd/io.hh>
+#include <ostd/path.hh>
+#include <ostd/serialize.hh>
+
+namespace ostd {
+namespace build {
+
+/** @addtogroup Build
+ * @{
+ */
+
+/** @brief An incremental 64-bit hash of data.
+ *
+ * This implements the XXH64 algorithm, which is very fast and good enough
+ * to detect changes in files, though not cryptographically secure.
+ */
+struct OSTD_EXPORT make_hasher {
+    /** @brief Starts a new hash with the given seed. */
+    make_hasher(std::uint64_t seed = 0) noexcept;
+
+    /** @brief Feeds data into the hash. */
+    void update(void const *data, std::size_t size) noexcept;
+
+    /** @brief Feeds a string into the hash, including its length.
+     *
+     * Including the length makes sure that a sequence of strings hashes
+     * differently from the same strings split at other places.
+     */
+    void update(string_range s) noexcept {
+        std::uint64_t n = s.size();
+        update(&n, sizeof(n));
+        update(s.data(), s.size());
+    }
+
+    /** @brief Gets the hash of the data fed so far. */
+    std::uint64_t digest() const noexcept;
+
+private:
+    std::uint64_t p_acc[4];
+    std::uint64_t p_total = 0;
+    unsigned char p_buf[32];
+    std::size_t p_len = 0;
+};
+
+namespace detail {
+    OSTD_EXPORT void parse_depfile_impl(
+        string_range data, void (*func)(string_range, void *), void *fdata
+    );
+}
+
+/** @brief Parses a dependency file in Makefile syntax.
+ *
+ * This is the format written by compilers given `-MD` or similar, one or
+ * more rules with targets on the left side of a colon and dependencies
+ * on the right side, possibly continued on further lines with backslashes.
+ * Each dependency is given to `out`, which can be an output range taking
+ * ostd::string_range or a function taking one. Targets are skipped.
+ *
+ * The parser works in place; the ranges point into `data` unless a name
+ * contains escaped characters (such as `\ ` for a space or `$$` for
+ * a dollar sign), in which case they point to a temporary buffer, so
+ * they have to be copied if they're to be kept.
+ *
+ * @returns The forwarded `out`.
+ */
+template<typename Sink>
+Sink &&parse_depfile(Sink &&out, string_range data) {
+    detail::parse_depfile_impl(data, [](string_range val, void *outp) {
+        if constexpr(is_output_range<std::decay_t<Sink>>) {
+            static_cast<std::decay_t<Sink> *>(outp)->put(val);
+        } else {
+            (*static_cast<std::decay_t<Sink> *>(outp))(val);
+        }
+    }, &out);
+    return std::forward<Sink>(out);
+}
+
+/** @brief Reads the dependencies from a dependency file.
+ *
+ * The file is mapped into memory where possible and parsed with
+ * ostd::build::parse_depfile(); the dependencies are appended to `deps`.
+ *
+ * @returns False if the file could not be opened.
+ */
+OSTD_EXPORT bool read_depfile(
+    string_range path, std::vector<std::string> &deps
+);
+
+/** @brief A persistent database of build state.
+ *
+ * The database is used by ostd::build::make, see make::database(). It's
+ * not thread safe; the make object only uses it from the thread that
+ * calls make::exec().
+ */
+struct OSTD_EXPORT make_db {
+    /** @brief What a target was built from and what it resulted in. */
+    struct target_entry {
+        /** @brief The hash of the rule signature. */
+        std::uint64_t command;
+        /** @brief The hash of the names and contents of the inputs. */
+        std::uint64_t inputs;
+        /** @brief The content hash of the target file. */
+        std::uint64_t output;
+    };
+
+    /** @brief Creates a database with no log file, living in memory. */
+    make_db();
+
+    /** @brief Creates a database and opens the given log, see open(). */
+    make_db(string_range path);
+
+    make_db(make_db const &) = delete;
+    make_db &operator=(make_db const &) = delete;
+
+    /** @brief Closes the log, see close(). */
+    ~make_db();
+
+    /** @brief Loads the given log file and opens it for appending.
+     *
+     * A missing file results in an empty database. A log that's damaged,
+     * was written by an incompatible version or contains mostly outdated
+     * records is rewritten from the valid records.
+     *
+     * @throws ostd::stream_error when the log cannot be written.
+     */
+    void open(string_range path);
+
+    /** @brief Writes any buffered records and closes the log.
+     *
+     * The contents stay in memory.
+     */
+    void close();
+
+    /** @brief Writes any buffered records into the log.
+     *
+     * @throws ostd::stream_error on write failure.
+     */
+    void flush();
+
+    /** @brief Gets the content hash of a file.
+     *
+     * If the file size and modification time are the same as when it was
+     * last hashed, the stored hash is used. If the file does not exist or
+     * is not a regular file, the result is zero.
+     */
+    std::uint64_t file_hash(string_range path);
+
+    /** @brief Gets a hash of the names and contents of the given files.
+     *
+     * The `names` is a range of anything convertible to a string range,
+     * see file_hash().
+     */
+    template<typename R>
+    std::uint64_t files_hash(R const &names) {
+        make_hasher h;
+        for (auto const &name: names) {
+            string_range sname{name};
+            auto fh = file_hash(sname);
+            h.update(sname);
+            h.update(&fh, sizeof(fh));
+        }
+        return h.digest();
+    }
+
+    /** @brief Gets the last recorded entry for a target or null. */
+    target_entry const *target(string_range name) const;
+
+    /** @brief Records an entry for a target. */
+    void record(string_range name, target_entry const &e);
+
+    /** @brief Gets the last recorded build time of a target or zero. */
+    std::chrono::nanoseconds time(string_range name) const;
+
+    /** @brief Records the time it took to build a target. */
+    void record_time(string_range name, std::chrono::nanoseconds t);
+
+    /** @brief Gets the last recorded discovered dependencies or null. */
+    std::vector<std::string> const *deps(string_range name) const;
+
+    /** @brief Records the dependencies discovered while building a target.
+     *
+     * These are typically read from a depfile with read_depfile().
+     */
+    void record_deps(string_range name, std::vector<std::string> deps);
+
+private:
+    struct file_entry {
+        std::int64_t mtime;
+        std::uint64_t size;
+        std::uint64_t hash;
+    };
+
+    OSTD_LOCAL bool load(string_range data);
+    OSTD_LOCAL void rewrite();
+    OSTD_LOCAL void put_file(std::string const &name, file_entry const &e);
+    OSTD_LOCAL void put_target(
+        std::string const &name, target_entry const &e
+    );
+    OSTD_LOCAL void put_time(std::string const &name, std::int64_t t);
+    OSTD_LOCAL void put_deps(
+        std::string const &name, std::vector<std::string> const &deps
+    );
+
+    std::unordered_map<std::string, file_entry> p_files{};
+    std::unordered_map<std::string, target_entry> p_targets{};
+    std::unordered_map<std::string, std::int64_t> p_times{};
+    std::unordered_map<std::string, std::vector<std::string>> p_deps{};
+    std::string p_path{};
+    file_stream p_log{};
+    std::unique_ptr<binary_writer> p_writer{};
+    /* all records in the log, including the outdated ones */
+    std::size_t p_nrecords = 0;
+};
+
+#ifdef OSTD_BUILD_TESTS
+#define OSTD_TEST_MODULE libostd_build_make_db
+
+namespace detail {
+    /* hashes the data at once and then in pieces of every size from one
+     * up, which must give the same result
+     */
+    inline std::uint64_t make_hasher_check(
+        void const *data, std::size_t size, std::uint64_t seed
+    ) {
+        using ostd::test::fail_if;
+        make_hasher h{seed};
+        h.update(data, size);
+        auto *p = static_cast<unsigned char const *>(data);
+        for (std::size_t step = 1; step <= size; ++step) {
+            make_hasher hs{seed};
+            for (std::size_t i = 0; i < size; i += step) {
+                hs.update(p + i, std::min(step, size - i));
+            }
+            fail_if(hs.digest() != h.digest());
+        }
+        return h.digest();
+    }
+
+    inline std::vector<std::string> make_depfile_deps(string_range data) {
+        std::vector<std::string> ret;
+        parse_depfile([&ret](string_range dep) {
+            ret.emplace_back(dep);
+        }, data);
+        return ret;
+    }
+}
+
+OSTD_UNIT_TEST {
+    using ostd::test::fail_if;
+    /* the known answers of the reference implementation, on either side
+     * of the 32 byte blocks the hash works in
+     */
+    static char const nobody[] = "Nobody inspects the spammish repetition";
+    unsigned char data[100];
+    for (std::size_t i = 0; i < sizeof(data); ++i) {
+        data[i] = static_cast<unsigned char>(i * 7 + 3);
+    }
+    struct {
+        void const *data;
+        std::size_t size;
+        std::uint64_t h0, hs;
+    } const known[] = {
+        {"", 0, 0xEF46DB3751D8E999, 0x51E24C0E9077A48C},
+        {"abc", 3, 0x44BC2CF5AD770999, 0x1FC03EF74CEBAA7D},
+        {nobody, 39, 0xFBCEA83C8A378BF1, 0xE341C9D9AD9F3C0A},
+        {data, 31, 0xA2AA5F33CC4A6119, 0x6BA872E910FBCE5C},
+        {data, 32, 0x23C3C17EF790FD97, 0x25CC07DA699894A9},
+        {data, 100, 0xA61F8D4C170FE531, 0xFE1FCE732C97C212}
+    };
+    std::uint64_t seed = 0x0123456789ABCDEF;
+    for (auto &k: known) {
+        fail_if(detail::make_hasher_check(k.data, k.size, 0) != k.h0);
+        fail_if(detail::make_hasher_check(k.data, k.size, seed) != k.hs);
+    }
+    fail_if(make_hasher{}.digest() != 0xEF46DB3751D8E999);
+}
+
+OSTD_UNIT_TEST {
+    using ostd::test::fail_if;
+    using dl = std::vector<std::string>;
+    auto deps = &detail::make_depfile_deps;
+    /* continuations with either line ending, also at the very end */
+    fail_if(deps("a.o: a.c b.h \\\n  c.h\n") != dl{"a.c", "b.h", "c.h"});
+    fail_if(deps("a.o: a.c \\\r\n b.h\r\n") != dl{"a.c", "b.h"});
+    fail_if(deps("a.o \\\n b.o: a.c\n") != dl{"a.c"});
+    fail_if(deps("a.o: a.c \\") != dl{"a.c"});
+    /* escaped spaces, hashes and dollars, but not drive letters */
+    fail_if(deps(
+        "my\\ a.o: my\\ a.c cost$$.h no\\#.h C:\\inc\\a.h\n"
+    ) != dl{"my a.c", "cost$.h", "no#.h", "C:\\inc\\a.h"});
+    /* rules without dependencies, such as the phony ones of -MP */
+    fail_if(!deps("").empty());
+    fail_if(!deps("a.o:\n").empty());
+    fail_if(!deps("a.o: \\\n\n# a.h\n").empty());
+    fail_if(deps("a.o: a.h\n\na.h:\n") != dl{"a.h"});
+}
+
+OSTD_UNIT_TEST {
+    using ostd::test::fail_if;
+    /* a log cut at any byte has the records before the cut loaded whole
+     * and nothing of the one cut through, and is written back that way
+     */
+    auto tmp = fs::temp_path();
+    std::string full = (tmp / "libostd_test_make_db.log").string();
+    std::string cut = (tmp / "libostd_test_make_db_cut.log").string();
+    std::vector<std::string> deps1{"a.h", "b.h", "c.h"}, deps2{"d.h"};
+    {
+        make_db db{full};
+        db.record_deps("a.o", deps1);
+        db.record("a.o", make_db::target_entry{1, 2, 3});
+        db.record_time("a.o", std::chrono::nanoseconds{5});
+        db.record_deps("b.o", deps2);
+    }
+    std::string data;
+    {
+        file_stream f{full};
+        char buf[4096];
+        for (std::size_t n; (n = f.read_bytes(buf, sizeof(buf)));) {
+            data.append(buf, n);
+        }
+    }
+    auto check = [&](make_db const &db) {
+        auto *d1 = db.deps("a.o");
+        auto *d2 = db.deps("b.o");
+        auto *t = db.target("a.o");
+        auto tm = db.time("a.o").count();
+        fail_if(d1 && (*d1 != deps1));
+        fail_if(d2 && (*d2 != deps2));
+        fail_if(t && ((t->command != 1) || (t->inputs != 2)));
+        fail_if(t && (t->output != 3));
+        fail_if(tm && (tm != 5));
+        return int(!!d1) + int(!!d2) + int(!!t) + int(!!tm);
+    };
+    int prev = 0;
+    for (std::size_t n = 0; n <= data.size(); ++n) {
+        {
+            file_stream f{cut, stream_mode::WRITE};
+            f.write_bytes(data.data(), n);
+        }
+        int got = check(make_db{cut});
+        fail_if(got < prev);
+        fail_if(check(make_db{cut}) != got);
+        prev = got;
+    }
+    fail_if(prev != 4);
+    fs::remove(full);
+    fs::remove(cut);
+}
+
+#undef OSTD_TEST_MODULE
+#endif
+
+/** @} */
+
+} /* namespace build */
+} /* namespace ostd */
+
+#endif
+
+/** @} */
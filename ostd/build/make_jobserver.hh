@@ -0,0 +1,144 @@
+/** @addtogroup Build
+ * @{
+ */
+
+/** @file make_jobserver.hh
+ *
+ * @brief GNU make compatible jobserver support.
+ *
+ * Builds often nest; a build driver runs compilers and sub-builds which
+ * have parallelism of their own, and unless all of them agree on how many
+ * jobs can run at once, the machine ends up heavily oversubscribed. GNU
+ * make solves this with a jobserver, which is a pipe shared by all the
+ * processes of a build, with one byte in it for every job that may run
+ * besides the ones already running. A process reads a byte before it
+ * starts a job and writes it back when the job is done. Every process
+ * also has one implicit job it may run without reading anything.
+ *
+ * The jobserver is described to child processes in the `MAKEFLAGS`
+ * environment variable. This file implements both sides of the protocol,
+ * so that ostd::build::make can limit its jobs by those of a parent make
+ * as well as provide a jobserver to the processes it runs itself.
+ *
+ * @copyright See COPYING.md in the project tree for further information.
+ */
+
+#ifndef OSTD_BUILD_MAKE_JOBSERVER_HH
+#define OSTD_BUILD_MAKE_JOBSERVER_HH
+
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include <ostd/platform.hh>
+#include <ostd/string.hh>
+
+namespace ostd {
+namespace build {
+
+/** @addtogroup Build
+ * @{
+ */
+
+/** @brief A client or a server of a GNU make jobserver.
+ *
+ * The object is thread safe; any number of threads may acquire and
+ * release tokens at the same time. Jobservers are only supported on
+ * POSIX systems.
+ */
+struct OSTD_EXPORT make_jobserver {
+    /** @brief The token that stands for the implicit job. */
+    static constexpr int implicit_token = -1;
+
+    /** @brief Connects to the jobserver of a parent process.
+     *
+     * The jobserver is looked up in the `MAKEFLAGS` environment variable;
+     * both the pipe (`--jobserver-auth=R,W` and the older form of it
+     * `--jobserver-fds=R,W`) and the named pipe (`--jobserver-auth=fifo:P`)
+     * styles are supported. The file descriptors of the pipe style are only
+     * passed by make to the commands it knows to be recursive, so a missing
+     * or unusable jobserver results in null rather than an error.
+     *
+     * @returns The jobserver or null if there is none.
+     */
+    static std::unique_ptr<make_jobserver> connect();
+
+    /** @brief Creates a jobserver with the given number of jobs.
+     *
+     * The jobserver is exported in the `MAKEFLAGS` environment variable
+     * for the lifetime of the object, so that child processes started
+     * with ostd::subprocess (without an explicit environment) join it.
+     * Its pipe is inherited by child processes.
+     *
+     * @throws std::system_error when the pipe cannot be created.
+     */
+    static std::unique_ptr<make_jobserver> create(unsigned int jobs);
+
+    make_jobserver(make_jobserver const &) = delete;
+    make_jobserver &operator=(make_jobserver const &) = delete;
+
+    /** @brief Closes the jobserver.
+     *
+     * If this is the server, the previous `MAKEFLAGS` are restored.
+     */
+    ~make_jobserver();
+
+    /** @brief Acquires a token, blocking until one is available.
+     *
+     * The result is either ostd::build::make_jobserver::implicit_token or
+     * a token read from the jobserver, and has to be given back to
+     * release() once the job is done.
+     *
+     * @throws std::system_error when reading the jobserver fails.
+     */
+    int acquire();
+
+    /** @brief Gives back a token acquired with acquire(). */
+    void release(int token);
+
+    /** @brief Checks whether this is the server.
+     *
+     * This is true for jobservers made with create().
+     */
+    bool is_server() const noexcept {
+        return p_server;
+    }
+
+    /** @brief Gets the `MAKEFLAGS` value that describes the jobserver.
+     *
+     * This is useful for child processes started with an explicit
+     * environment.
+     */
+    std::string const &makeflags() const noexcept {
+        return p_flags;
+    }
+
+private:
+    make_jobserver(int rfd, int wfd, std::string flags);
+
+    std::string p_flags;
+    std::optional<std::string> p_oldflags{};
+    std::mutex p_mtx{};
+    int p_rfd, p_wfd;
+    /* the read end opened again in non-blocking mode, which unlike the
+     * shared descriptor does not affect the other processes; -1 where
+     * that is not possible
+     */
+    int p_nbfd = -1;
+    /* written to when the implicit token becomes available */
+    int p_wake[2] = {-1, -1};
+    bool p_implicit = true;
+    bool p_server = false;
+    /* the descriptors passed down by a parent stay open */
+    bool p_owned = false;
+};
+
+/** @} */
+
+} /* namespace build */
+} /* namespace ostd */
+
+#endif
+
+/** @} */
@@ -0,0 +1,130 @@
+/** @addtogroup Build
+ * @{
+ */
+
+/** @file make_trace.hh
+ *
+ * @brief Build tracing in the Chrome trace event format.
+ *
+ * A build log tells what was built, but not where the time went. This
+ * file implements a writer of traces in the JSON format of the Chrome
+ * trace viewer, which can be loaded into `about:tracing` or Perfetto to
+ * see every target and every task of a build on the thread it ran on,
+ * along with how long it waited to run.
+ *
+ * @copyright See COPYING.md in the project tree for further information.
+ */
+
+#ifndef OSTD_BUILD_MAKE_TRACE_HH
+#define OSTD_BUILD_MAKE_TRACE_HH
+
+#include <cstddef>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <ostd/platform.hh>
+#include <ostd/string.hh>
+#include <ostd/format.hh>
+#include <ostd/io.hh>
+
+namespace ostd {
+namespace build {
+
+/** @addtogroup Build
+ * @{
+ */
+
+/** @brief A writer of Chrome trace event files.
+ *
+ * Events are formatted into a buffer which is written out once it grows
+ * large enough, or on flush(). The file is written in the JSON array
+ * format, which the viewers accept even without the closing bracket, so
+ * a flushed trace can be viewed while it's still being written.
+ *
+ * The object is thread safe. Every thread that records events gets its
+ * own row in the viewer; the thread that created the trace is named
+ * `make` and the others `worker N`. Events that overlap on a single
+ * thread, such as the interleaved targets of ostd::build::make, can be
+ * put on numbered lanes instead, which are shown as rows of their own.
+ */
+struct OSTD_EXPORT make_trace {
+    /** @brief The clock the events are timed with. */
+    using clock = std::chrono::steady_clock;
+
+    /** @brief Creates the trace file at the given path.
+     *
+     * Times in the trace are relative to the moment it's created.
+     *
+     * @throws ostd::stream_error if the file cannot be opened.
+     */
+    make_trace(string_range path);
+
+    make_trace(make_trace const &) = delete;
+    make_trace &operator=(make_trace const &) = delete;
+
+    /** @brief Finishes the file. */
+    ~make_trace();
+
+    /** @brief Records an event that took place on the calling thread.
+     *
+     * The event became ready to run at `ready` and ran from `start` to
+     * `end`; the time it waited is put in the arguments of the event.
+     * The `cat` is the category, which the viewers can filter by.
+     */
+    void complete(
+        string_range cat, string_range name, clock::time_point ready,
+        clock::time_point start, clock::time_point end
+    );
+
+    /** @brief Records an event without a waiting time. */
+    void complete(
+        string_range cat, string_range name,
+        clock::time_point start, clock::time_point end
+    ) {
+        complete(cat, name, start, start, end);
+    }
+
+    /** @brief Records an event on the given lane.
+     *
+     * This is like the other complete(), except the event is put on the
+     * lane rather than the calling thread. The lane should not be used by
+     * another event at the same time.
+     */
+    void complete(
+        std::size_t lane, string_range cat, string_range name,
+        clock::time_point ready, clock::time_point start,
+        clock::time_point end
+    );
+
+    /** @brief Writes out the buffered events. */
+    void flush();
+
+private:
+    OSTD_LOCAL std::size_t thread_index();
+    OSTD_LOCAL void put_event(
+        int pid, std::size_t tid, string_range cat, string_range name,
+        clock::time_point ready, clock::time_point start,
+        clock::time_point end
+    );
+    OSTD_LOCAL void put_time(clock::duration d);
+    OSTD_LOCAL void put_string(string_range s);
+
+    std::mutex p_mtx{};
+    file_stream p_file;
+    format_buffer<> p_buf{};
+    clock::time_point p_start;
+    std::vector<std::thread::id> p_threads{};
+    std::size_t p_nlanes = 0;
+};
+
+/** @} */
+
+} /* namespace build */
+} /* namespace ostd */
+
+#endif
+
+/** @} */
@@ -0,0 +1,99 @@
+/** @addtogroup Build
+ * @{
+ */
+
+/** @file make_watcher.hh
+ *
+ * @brief File change notifications for incremental builds.
+ *
+ * Rebuilding after every edit by hand means checking the whole build
+ * graph every time, even though usually a single file has changed. This
+ * file implements a watcher which tells which of a set of files have
+ * changed, so that ostd::build::make can keep running and only look at
+ * what depends on them, see make::watch().
+ *
+ * @copyright See COPYING.md in the project tree for further information.
+ */
+
+#ifndef OSTD_BUILD_MAKE_WATCHER_HH
+#define OSTD_BUILD_MAKE_WATCHER_HH
+
+#include <chrono>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <ostd/platform.hh>
+#include <ostd/string.hh>
+
+namespace ostd {
+namespace build {
+
+/** @addtogroup Build
+ * @{
+ */
+
+/** @brief A watcher of changes to files.
+ *
+ * The directories of the files are watched rather than the files, so
+ * that files replaced by renaming a new version over them, as many
+ * editors do, are still watched afterwards. Watchers are only supported
+ * on Linux, where they use inotify.
+ *
+ * The object is not thread safe.
+ */
+struct OSTD_EXPORT make_watcher {
+    /** @brief Creates a watcher with no files.
+     *
+     * @throws std::system_error when watching is not possible.
+     */
+    make_watcher();
+
+    make_watcher(make_watcher const &) = delete;
+    make_watcher &operator=(make_watcher const &) = delete;
+
+    ~make_watcher();
+
+    /** @brief Starts watching a file.
+     *
+     * The file does not have to exist, but its directory does. Adding
+     * the same file again does nothing, unless its directory was removed
+     * since, in which case the directory is watched again.
+     *
+     * @returns False if the directory cannot be watched.
+     */
+    bool add(string_range file);
+
+    /** @brief Waits for some of the files to change.
+     *
+     * This blocks until a watched file is written, created, removed or
+     * renamed, and then keeps collecting changes until there are none
+     * for the given time, so that a batch of changes, such as a checkout
+     * or several files saved at once, is seen at once. The names of the
+     * changed files are put in `changed`, once each and in the form they
+     * were added in.
+     *
+     * @throws std::system_error when reading the changes fails.
+     */
+    void wait(
+        std::vector<std::string> &changed, std::chrono::milliseconds quiet
+    );
+
+private:
+    /* the names of the files in a watched directory */
+    using dir_files = std::unordered_map<
+        std::string, std::vector<std::string>
+    >;
+
+    std::unordered_map<int, dir_files> p_dirs{};
+    int p_fd = -1;
+};
+
+/** @} */
+
+} /* namespace build */
+} /* namespace ostd */
+
+#endif
+
+/** @} */
@@ -19,13 +19,14 @@
 #include <optional>
 #include <algorithm>
 #include <list>
+#include <chrono>
 #include <mutex>
-#include <condition_variable>
 #include <stdexcept>
 #include <memory>
 
 #include <ostd/platform.hh>
 #include <ostd/generic_condvar.hh>
+#include <ostd/mutex.hh>
 
 namespace ostd {
 
@@ -63,7 +64,7 @@ template<typename T>
 struct channel {
     /** @brief Constructs a default channel.
      *
-     * This uses std::condition_variable as its internal condition type,
+     * This uses a default ostd::mutex and ostd::condition internally,
      * so it will work with standard threads (raw or when used with C++'s
      * async APIs). You can also use channels with ostd's concurrency system
      * though - see ostd::make_channel() and channel(F).
@@ -72,9 +73,9 @@ struct channel {
 
     /** @brief Constructs a channel with a custom condition variable type.
      *
-     * Channels use #ostd::generic_condvar to store their condvars internally,
-     * so you can provide a custom type as well. This comes in handy for
-     * example when doing custom scheduling.
+     * Channels lock using ostd::mutex and ostd::condition, which park using
+     * an #ostd::generic_condvar, so you can provide a custom type as well.
+     * This comes in handy for example when doing custom scheduling.
      *
      * The condvar cannot be passed directly though, as it's not required to
      * be copy or move constructible, so it's passed in through a function
@@ -157,6 +158,42 @@ struct channel {
         return ret;
     }
 
+    /** @brief Waits for a value until a deadline.
+     *
+     * Like get(), but gives up once the given time point is reached. When
+     * the channel uses a scheduler's condvar, the waiting task is parked in
+     * the scheduler, so other tasks can run on the worker meanwhile.
+     *
+     * @returns The value or std::nullopt if the deadline was reached.
+     *
+     * @throws ostd::channel_error when the channel is closed.
+     *
+     * @see get_for(), get(), try_get()
+     */
+    std::optional<T> get_until(std::chrono::steady_clock::time_point tp) {
+        T ret;
+        if (!p_state->get_until(ret, tp)) {
+            return std::nullopt;
+        }
+        return ret;
+    }
+
+    /** @brief Waits for a value for at most the given duration.
+     *
+     * Same as get_until() with the deadline being now plus `d`.
+     *
+     * @returns The value or std::nullopt if the time ran out.
+     *
+     * @throws ostd::channel_error when the channel is closed.
+     */
+    template<typename Rep, typename Period>
+    std::optional<T> get_for(std::chrono::duration<Rep, Period> const &d) {
+        using sd = std::chrono::steady_clock::duration;
+        return get_until(
+            std::chrono::steady_clock::now() + std::chrono::ceil<sd>(d)
+        );
+    }
+
     /** @brief Gets a value from the queue if there is one.
      *
      * If a value is present in the queue, returns the value.
@@ -210,12 +247,12 @@ private:
         }
 
         template<typename F>
-        impl(F &func): p_lock(), p_cond(func()) {}
+        impl(F &func): p_lock(func), p_cond(func) {}
 
         template<typename U>
         void put(U &&val) {
             {
-                std::lock_guard<std::mutex> l{p_lock};
+                std::lock_guard<mutex> l{p_lock};
                 if (p_closed) {
                     throw channel_error{"put in a closed channel"};
                 }
@@ -227,7 +264,7 @@ private:
         template<typename ...A>
         void emplace(A &&...args) {
             {
-                std::lock_guard<std::mutex> l{p_lock};
+                std::lock_guard<mutex> l{p_lock};
                 if (p_closed) {
                     throw channel_error{"emplace in a closed channel"};
                 }
@@ -237,7 +274,7 @@ private:
         }
 
         bool get(T &val, bool w) {
-            std::unique_lock<std::mutex> l{p_lock};
+            std::unique_lock<mutex> l{p_lock};
             if (w) {
                 while (!p_closed && p_messages.empty()) {
                     p_cond.wait(l);
@@ -254,27 +291,45 @@ private:
             return true;
         }
 
+        bool get_until(T &val, std::chrono::steady_clock::time_point tp) {
+            std::unique_lock<mutex> l{p_lock};
+            while (!p_closed && p_messages.empty()) {
+                if (p_cond.wait_until(l, tp) == std::cv_status::timeout) {
+                    break;
+                }
+            }
+            if (p_messages.empty()) {
+                if (p_closed) {
+                    throw channel_error{"get from a closed channel"};
+                }
+                return false;
+            }
+            val = std::move(p_messages.front());
+            p_messages.pop_front();
+            return true;
+        }
+
         bool empty() const noexcept {
-            std::lock_guard<std::mutex> l{p_lock};
+            std::lock_guard<mutex> l{p_lock};
             return p_closed || p_messages.empty();
         }
 
         bool closed() const noexcept {
-            std::lock_guard<std::mutex> l{p_lock};
+            std::lock_guard<mutex> l{p_lock};
             return p_closed;
         }
 
         void close() noexcept {
             {
-                std::lock_guard<std::mutex> l{p_lock};
+                std::lock_guard<mutex> l{p_lock};
                 p_closed = true;
             }
             p_cond.notify_all();
         }
 
         std::list<T> p_messages;
-        mutable std::mutex p_lock;
-        generic_condvar p_cond;
+        mutable mutex p_lock;
+        condition p_cond;
         bool p_closed = false;
     };
 
@@ -0,0 +1,199 @@
+/** @addtogroup Streams
+ * @{
+ */
+
+/** @file compress.hh
+ *
+ * @brief Stream adapters for transparent compression.
+ *
+ * The streams in this file wrap another ostd::stream and compress the
+ * data written into them or decompress the data read from them. The
+ * wrapped stream is not owned, so it must stay alive for as long as the
+ * adapter does. Memory use is bounded regardless of the amount of data
+ * going through.
+ *
+ * The zstd adapter is available when libostd is built with zstd, which
+ * defines `OSTD_HAVE_ZSTD`, and the zlib adapter is available when it's
+ * built with zlib, which defines `OSTD_HAVE_ZLIB`. The build detects
+ * the libraries automatically, see the `zstd` and `zlib` build options.
+ *
+ * ~~~{.cc}
+ * ostd::file_stream f{"log.zst", ostd::stream_mode::WRITE};
+ * ostd::zstd_stream z{f, ostd::compress_mode::COMPRESS};
+ * z.writefln("hello %s", "world");
+ * z.close();
+ * ~~~
+ *
+ * @copyright See COPYING.md in the project tree for further information.
+ */
+
+#ifndef OSTD_COMPRESS_HH
+#define OSTD_COMPRESS_HH
+
+#include <cstddef>
+#include <memory>
+
+#include <ostd/platform.hh>
+#include <ostd/stream.hh>
+
+namespace ostd {
+
+/** @addtogroup Streams
+ * @{
+ */
+
+/** @brief Whether ostd::zstd_stream is available. */
+#ifdef OSTD_HAVE_ZSTD
+constexpr bool zstd_available = true;
+#else
+constexpr bool zstd_available = false;
+#endif
+
+/** @brief Whether ostd::zlib_stream is available. */
+#ifdef OSTD_HAVE_ZLIB
+constexpr bool zlib_available = true;
+#else
+constexpr bool zlib_available = false;
+#endif
+
+/** @brief The direction of a compression stream.
+ *
+ * A compressing stream can only be written into and a decompressing
+ * stream can only be read from.
+ */
+enum class compress_mode {
+    COMPRESS,  ///< Written data are compressed into the wrapped stream.
+    DECOMPRESS ///< Read data are decompressed from the wrapped stream.
+};
+
+#if defined(OSTD_HAVE_ZSTD) || defined(OSTD_GENERATING_DOC)
+
+namespace detail {
+    struct zstd_stream_impl;
+}
+
+/** @brief A stream adapter for the zstd format.
+ *
+ * When compressing, close() finishes the compressed frame, so it must be
+ * called (or the stream destroyed) before the output is complete; flush()
+ * ends the current block so that everything written so far can be
+ * decompressed, at some cost in compression ratio. When decompressing,
+ * concatenated frames are read as a single stream.
+ *
+ * Errors from the library are thrown as ostd::stream_error, with `EILSEQ`
+ * for corrupt or truncated input.
+ */
+struct OSTD_EXPORT zstd_stream: stream {
+    /** @brief Creates an adapter for `s`.
+     *
+     * The `level` is the zstd compression level, negative levels being
+     * the fast ones. If `threads` is not zero, compression happens in
+     * that many background threads, provided the library supports it;
+     * otherwise it falls back to the calling thread. Both are ignored
+     * when decompressing.
+     *
+     * @throws ostd::stream_error on failure.
+     */
+    zstd_stream(
+        stream &s, compress_mode mode, int level = 3, int threads = 0
+    );
+
+    zstd_stream(zstd_stream const &) = delete;
+    zstd_stream &operator=(zstd_stream const &) = delete;
+
+    /** @brief Calls close(), ignoring errors. */
+    ~zstd_stream();
+
+    /** @brief Finishes the output and releases the compression state.
+     *
+     * The wrapped stream is not closed. Any further use of this stream
+     * other than another close() is an error.
+     *
+     * @throws ostd::stream_error on write failure.
+     */
+    void close();
+
+    /** @brief Checks if the decompressed data have been exhausted. */
+    bool end() const;
+
+    /** @brief Ends the current block and flushes the wrapped stream. */
+    void flush();
+
+    /** @brief Reads decompressed data. */
+    std::size_t read_bytes(void *buf, std::size_t count);
+
+    /** @brief Writes data to be compressed. */
+    void write_bytes(void const *buf, std::size_t count);
+
+private:
+    std::unique_ptr<detail::zstd_stream_impl> p_impl;
+};
+
+#endif /* OSTD_HAVE_ZSTD */
+
+#if defined(OSTD_HAVE_ZLIB) || defined(OSTD_GENERATING_DOC)
+
+/** @brief The container of the deflate data in ostd::zlib_stream. */
+enum class zlib_format {
+    ZLIB, ///< The zlib format, i.e. deflate with a small header.
+    GZIP, ///< The gzip format, as used by the `gzip` tool.
+    RAW   ///< Raw deflate data with no header.
+};
+
+namespace detail {
+    struct zlib_stream_impl;
+}
+
+/** @brief A stream adapter for deflate based formats using zlib.
+ *
+ * It works the same as ostd::zstd_stream. When decompressing, the zlib
+ * and gzip formats are both recognized, and concatenated gzip members
+ * are read as a single stream.
+ */
+struct OSTD_EXPORT zlib_stream: stream {
+    /** @brief Creates an adapter for `s`.
+     *
+     * The `level` is the zlib compression level from 0 to 9 or -1 for
+     * the default. It's ignored when decompressing.
+     *
+     * @throws ostd::stream_error on failure.
+     */
+    zlib_stream(
+        stream &s, compress_mode mode, int level = -1,
+        zlib_format fmt = zlib_format::GZIP
+    );
+
+    zlib_stream(zlib_stream const &) = delete;
+    zlib_stream &operator=(zlib_stream const &) = delete;
+
+    /** @brief Calls close(), ignoring errors. */
+    ~zlib_stream();
+
+    /** @brief Like ostd::zstd_stream::close(). */
+    void close();
+
+    /** @brief Checks if the decompressed data have been exhausted. */
+    bool end() const;
+
+    /** @brief Like ostd::zstd_stream::flush(). */
+    void flush();
+
+    /** @brief Reads decompressed data. */
+    std::size_t read_bytes(void *buf, std::size_t count);
+
+    /** @brief Writes data to be compressed. */
+    void write_bytes(void const *buf, std::size_t count);
+
+private:
+    std::unique_ptr<detail::zlib_stream_impl> p_impl;
+};
+
+#endif /* OSTD_HAVE_ZLIB */
+
+/** @} */
+
+} /* namespace ostd */
+
+#endif
+
+/** @} */
@@ -41,11 +41,18 @@
 #define OSTD_CONCURRENCY_HH
 
 #include <cstddef>
+#include <cstdint>
 #include <vector>
 #include <list>
+#include <tuple>
 #include <thread>
 #include <utility>
 #include <memory>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <optional>
+#include <mutex>
 #include <stdexcept>
 #include <exception>
 #include <type_traits>
@@ -54,6 +61,10 @@
 #include <ostd/coroutine.hh>
 #include <ostd/channel.hh>
 #include <ostd/generic_condvar.hh>
+#include <ostd/mutex.hh>
+#include <ostd/topology.hh>
+#include <ostd/scheduler_stats.hh>
+#include <ostd/timer_wheel.hh>
 
 namespace ostd {
 
@@ -64,61 +75,139 @@ namespace ostd {
 struct scheduler;
 
 namespace detail {
+    /* a single continuation attached to a task's shared state */
+    struct tid_cont {
+        tid_cont(std::function<void()> &&func): p_func(std::move(func)) {}
+
+        std::function<void()> p_func;
+        tid_cont *p_next = nullptr;
+    };
+
+    enum tid_flags {
+        TID_READY   = 1 << 0,
+        TID_WAITING = 1 << 1
+    };
+
     template<typename T>
     struct tid_impl {
         tid_impl() = delete;
+        tid_impl(tid_impl const &) = delete;
+        tid_impl &operator=(tid_impl const &) = delete;
 
         template<typename F>
-        tid_impl(F &func): p_lock(), p_eptr(), p_cond(func()) {}
+        tid_impl(F &func): p_lock(func), p_eptr(), p_cond(func) {}
 
-        T get() {
-            std::unique_lock<std::mutex> l{p_lock};
-            while (!p_stor) {
-                p_cond.wait(l);
+        ~tid_impl() {
+            /* only non-empty when the result was never set */
+            tid_cont *c = p_conts.load(std::memory_order_relaxed);
+            if (c == conts_fired()) {
+                return;
+            }
+            while (c) {
+                delete std::exchange(c, c->p_next);
             }
+        }
+
+        bool ready() const noexcept {
+            return p_flags.load(std::memory_order_acquire) & TID_READY;
+        }
+
+        T get() {
+            wait();
             if (p_eptr) {
                 std::rethrow_exception(std::exchange(p_eptr, nullptr));
             }
-            auto ret = std::move(p_stor);
             if constexpr(!std::is_same_v<T, void>) {
                 if constexpr(std::is_lvalue_reference_v<T>) {
-                    return **ret;
+                    return **p_stor;
                 } else {
-                    return std::move(*ret);
+                    return std::move(*p_stor);
                 }
             }
         }
 
         void wait() {
-            std::unique_lock<std::mutex> l{p_lock};
-            while (!p_stor) {
+            /* fast path, no locking needed once the result is there */
+            if (ready()) {
+                return;
+            }
+            std::unique_lock<mutex> l{p_lock};
+            /* tell the setter that somebody needs to be woken up; this is
+             * done with the lock held so the notification cannot get lost
+             */
+            if (p_flags.fetch_or(
+                TID_WAITING, std::memory_order_acq_rel
+            ) & TID_READY) {
+                return;
+            }
+            while (!ready()) {
                 p_cond.wait(l);
             }
         }
 
         template<typename F>
         void set_value(F &func) {
-            {
-                std::lock_guard<std::mutex> l{p_lock};
-                try {
-                    if constexpr(std::is_same_v<T, void>) {
-                        func();
-                        p_stor = true;
+            try {
+                if constexpr(std::is_same_v<T, void>) {
+                    func();
+                } else {
+                    if constexpr(std::is_lvalue_reference_v<T>) {
+                        p_stor = &func();
                     } else {
-                        if constexpr(std::is_lvalue_reference_v<T>) {
-                            p_stor = &func();
-                        } else {
-                            p_stor = std::move(func());
-                        }
+                        p_stor.emplace(func());
                     }
-                } catch (...) {
-                    p_eptr = std::current_exception();
                 }
+            } catch (...) {
+                p_eptr = std::current_exception();
             }
-            p_cond.notify_one();
+            if (p_flags.fetch_or(
+                TID_READY, std::memory_order_acq_rel
+            ) & TID_WAITING) {
+                /* the waiter holds the lock until it's fully blocked */
+                { std::lock_guard<mutex> l{p_lock}; }
+                p_cond.notify_one();
+            }
+            run_continuations();
+        }
+
+        /* the function is called exactly once, after the result is set;
+         * if it already is, it's called immediately in the calling context
+         */
+        void add_continuation(std::function<void()> func) {
+            auto *nc = new tid_cont{std::move(func)};
+            tid_cont *head = p_conts.load(std::memory_order_acquire);
+            do {
+                if (head == conts_fired()) {
+                    std::unique_ptr<tid_cont>{nc}->p_func();
+                    return;
+                }
+                nc->p_next = head;
+            } while (!p_conts.compare_exchange_weak(
+                head, nc, std::memory_order_release, std::memory_order_acquire
+            ));
         }
 
     private:
+        static tid_cont *conts_fired() noexcept {
+            return reinterpret_cast<tid_cont *>(std::uintptr_t(1));
+        }
+
+        void run_continuations() noexcept {
+            tid_cont *c = p_conts.exchange(
+                conts_fired(), std::memory_order_acq_rel
+            );
+            /* the list is in reverse order of registration */
+            tid_cont *rc = nullptr;
+            while (c) {
+                rc = std::exchange(c, std::exchange(c->p_next, rc));
+            }
+            while (rc) {
+                std::unique_ptr<tid_cont> p{rc};
+                rc = rc->p_next;
+                p->p_func();
+            }
+        }
+
         using storage = std::conditional_t<
             std::is_same_v<T, void>,
             bool,
@@ -129,9 +218,11 @@ namespace detail {
             >>
         >;
 
-        mutable std::mutex p_lock;
+        std::atomic<int> p_flags{0};
+        std::atomic<tid_cont *> p_conts{nullptr};
+        mutable mutex p_lock;
         mutable std::exception_ptr p_eptr;
-        generic_condvar p_cond;
+        condition p_cond;
         storage p_stor = storage{};
     };
 }
@@ -150,6 +241,15 @@ namespace detail {
  * at least until the associated task finishes, but it can remain alive after
  * that to either get the return value or propagate an exception).
  *
+ * The readiness of the result is tracked with a single atomic word, so
+ * retrieving a result that is already there never locks anything. Only
+ * when the result is not ready yet is the waiting task actually parked
+ * using the scheduler's condition variable.
+ *
+ * Besides waiting, you can attach a continuation using then(), which gets
+ * spawned as a new task once the result is ready, and combine multiple tids
+ * using ostd::when_all() and ostd::when_any(). None of these block.
+ *
  * The `T` template parameter is the type of the result. It can be `void`,
  * in which case get() returns nothing, but can still propagate exceptions.
  */
@@ -181,7 +281,16 @@ struct tid {
 
     /** @brief Checks if this `tid` points to a valid shared state. */
     bool valid() const {
-        return p_state;
+        return bool(p_state);
+    }
+
+    /** @brief Checks if the result is available without waiting.
+     *
+     * If this returns `true`, get() will return or throw immediately.
+     * The behavior is undefined when valid() is not true.
+     */
+    bool ready() const noexcept {
+        return p_state->ready();
     }
 
     /** @brief Waits for the associated task to finish.
@@ -192,13 +301,47 @@ struct tid {
         p_state->wait();
     }
 
+    /** @brief Attaches a continuation to the task.
+     *
+     * Once the result of this task is ready, `func` is spawned as a new
+     * task on the current scheduler, receiving this `tid` as its only
+     * argument. That means calling get() on it inside of the continuation
+     * never blocks. No task is blocked waiting for the result meanwhile.
+     *
+     * If the result is already ready, the continuation is spawned right
+     * away. After this call is done, valid() will no longer be true.
+     *
+     * @returns A `tid` representing the continuation task.
+     *
+     * @see ostd::when_all(), ostd::when_any()
+     */
+    template<typename F>
+    tid<std::result_of_t<F(tid<T>)>> then(F func);
+
 private:
     template<typename F>
-    tid(F func): p_state(new detail::tid_impl<T>{func}) {}
+    tid(F func): p_state(std::make_shared<detail::tid_impl<T>>(func)) {}
+
+    tid(std::shared_ptr<detail::tid_impl<T>> st): p_state(std::move(st)) {}
 
     std::shared_ptr<detail::tid_impl<T>> p_state;
 };
 
+/** @brief The result of ostd::when_any().
+ *
+ * The `tids` member contains all the tids that were passed to when_any(),
+ * in their original order, while `index` is the index of the one which
+ * has become ready first. If when_any() was given no tids, the index
+ * is `std::size_t(-1)`.
+ *
+ * @tparam S Either an `std::vector` or an `std::tuple` of tids.
+ */
+template<typename S>
+struct when_any_result {
+    std::size_t index; ///< The index of the first finished tid.
+    S tids;            ///< All the tids.
+};
+
 /** @brief A base interface for any scheduler.
  *
  * All schedulers derive from this. Its core interface is defined using
@@ -263,6 +406,16 @@ public:
      */
     virtual void yield() noexcept = 0;
 
+    /** @brief Suspends the current task until the given time point.
+     *
+     * In ostd::thread_scheduler, this simply puts the OS thread to sleep.
+     * In coroutine based schedulers, the task is parked and the worker is
+     * free to run other tasks until the deadline is reached.
+     *
+     * @see ostd::sleep_until(), ostd::sleep_for()
+     */
+    virtual void sleep_until(std::chrono::steady_clock::time_point tp) = 0;
+
     /** @brief Creates a condition variable using ostd::generic_condvar.
      *
      * A scheduler might be using a custom condition variable type depending
@@ -274,6 +427,33 @@ public:
      */
     virtual generic_condvar make_condition() = 0;
 
+    /** @brief Creates a mutex suitable for the scheduler.
+     *
+     * The mutex is an ostd::mutex using a condition variable returned by
+     * make_condition(). In coroutine based schedulers this means that a
+     * contended lock parks the current task instead of blocking the whole
+     * worker thread. With ostd::thread_scheduler, it's simply a futex.
+     *
+     * @see make_condvar(), ostd::make_mutex()
+     */
+    mutex make_mutex() {
+        return mutex{[this]() {
+            return make_condition();
+        }};
+    }
+
+    /** @brief Creates an ostd::condition suitable for the scheduler.
+     *
+     * This is the counterpart of make_mutex() and works the same way.
+     *
+     * @see make_mutex(), ostd::make_condvar()
+     */
+    condition make_condvar() {
+        return condition{[this]() {
+            return make_condition();
+        }};
+    }
+
     /** @brief Allocates a stack suitable for a coroutine.
      *
      * If the scheduler uses coroutine based tasks, this allows us to
@@ -346,6 +526,199 @@ public:
         return t;
     }
 
+    /** @brief Attaches a continuation to a task.
+     *
+     * This is the implementation of tid::then(), which calls this on
+     * the current scheduler. Once `t` is ready, `func` is spawned as a new
+     * task using do_spawn(), with `t` passed to it.
+     *
+     * @see tid::then(), when_all(), when_any()
+     */
+    template<typename T, typename F>
+    tid<std::result_of_t<F(tid<T>)>> then(tid<T> t, F func) {
+        using R = std::result_of_t<F(tid<T>)>;
+        tid<R> ret{[this]() {
+            return make_condition();
+        }};
+        auto *st = t.p_state.get();
+        st->add_continuation([
+            this, lst = ret.p_state, lsrc = std::move(t.p_state),
+            lfunc = std::move(func)
+        ]() {
+            do_spawn([lst, lsrc, lfunc]() {
+                auto body = [&lsrc, &lfunc]() -> R {
+                    return lfunc(tid<T>{lsrc});
+                };
+                lst->set_value(body);
+            });
+        });
+        return ret;
+    }
+
+    /** @brief Waits for a number of tasks without blocking.
+     *
+     * Returns a `tid` that becomes ready once all of the given tids are
+     * ready. Its result is the input tids, whose results can then be
+     * retrieved without blocking. No task is spawned for the waiting.
+     *
+     * Typically you will want to use ostd::when_all().
+     *
+     * @see when_any(), ostd::when_all()
+     */
+    template<typename T>
+    tid<std::vector<tid<T>>> when_all(std::vector<tid<T>> tids) {
+        using R = std::vector<tid<T>>;
+        struct all_state {
+            std::atomic<std::size_t> left;
+            R tids;
+        };
+        tid<R> ret{[this]() {
+            return make_condition();
+        }};
+        /* the extra count makes sure we're not done while registering */
+        auto st = std::make_shared<all_state>();
+        st->left.store(tids.size() + 1, std::memory_order_relaxed);
+        st->tids = std::move(tids);
+        auto done = [st, lst = ret.p_state]() {
+            if (st->left.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                auto body = [&st]() -> R {
+                    return std::move(st->tids);
+                };
+                lst->set_value(body);
+            }
+        };
+        for (auto &t: st->tids) {
+            t.p_state->add_continuation(done);
+        }
+        done();
+        return ret;
+    }
+
+    /** @brief Like when_all(std::vector<tid<T>>), for differing types.
+     *
+     * The result is an `std::tuple` of the input tids.
+     */
+    template<typename ...T>
+    tid<std::tuple<tid<T>...>> when_all(tid<T> &&...tids) {
+        using R = std::tuple<tid<T>...>;
+        struct all_state {
+            all_state(R &&t): tids(std::move(t)) {}
+            std::atomic<std::size_t> left{sizeof...(T) + 1};
+            R tids;
+        };
+        tid<R> ret{[this]() {
+            return make_condition();
+        }};
+        auto st = std::make_shared<all_state>(R{std::move(tids)...});
+        auto done = [st, lst = ret.p_state]() {
+            if (st->left.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                auto body = [&st]() -> R {
+                    return std::move(st->tids);
+                };
+                lst->set_value(body);
+            }
+        };
+        std::apply([&done](auto &...ts) {
+            (ts.p_state->add_continuation(done), ...);
+        }, st->tids);
+        done();
+        return ret;
+    }
+
+    /** @brief Waits for the first of a number of tasks without blocking.
+     *
+     * Returns a `tid` that becomes ready as soon as any of the given tids
+     * is ready. Its result is an ostd::when_any_result containing all of
+     * the input tids as well as the index of the one that was first.
+     *
+     * Typically you will want to use ostd::when_any().
+     *
+     * @see when_all(), ostd::when_any()
+     */
+    template<typename T>
+    tid<when_any_result<std::vector<tid<T>>>> when_any(
+        std::vector<tid<T>> tids
+    ) {
+        using R = when_any_result<std::vector<tid<T>>>;
+        struct any_state {
+            std::atomic<bool> done{false};
+            R res;
+        };
+        tid<R> ret{[this]() {
+            return make_condition();
+        }};
+        auto st = std::make_shared<any_state>();
+        /* the tids may be gone as soon as the first one fires */
+        std::vector<std::shared_ptr<detail::tid_impl<T>>> sts;
+        sts.reserve(tids.size());
+        for (auto &t: tids) {
+            sts.push_back(t.p_state);
+        }
+        st->res.index = std::size_t(-1);
+        st->res.tids = std::move(tids);
+        auto fire = [&st, &ret](std::size_t idx) {
+            return [st, lst = ret.p_state, idx]() {
+                if (!st->done.exchange(true, std::memory_order_acq_rel)) {
+                    auto body = [&st, idx]() -> R {
+                        st->res.index = idx;
+                        return std::move(st->res);
+                    };
+                    lst->set_value(body);
+                }
+            };
+        };
+        if (sts.empty()) {
+            fire(std::size_t(-1))();
+        }
+        for (std::size_t i = 0; i < sts.size(); ++i) {
+            sts[i]->add_continuation(fire(i));
+        }
+        return ret;
+    }
+
+    /** @brief Like when_any(std::vector<tid<T>>), for differing types.
+     *
+     * The result is an ostd::when_any_result with an `std::tuple` of
+     * the input tids.
+     */
+    template<typename ...T>
+    tid<when_any_result<std::tuple<tid<T>...>>> when_any(tid<T> &&...tids) {
+        using R = when_any_result<std::tuple<tid<T>...>>;
+        struct any_state {
+            any_state(R &&r): res(std::move(r)) {}
+            std::atomic<bool> done{false};
+            R res;
+        };
+        tid<R> ret{[this]() {
+            return make_condition();
+        }};
+        /* the tids may be gone as soon as the first one fires */
+        auto sts = std::make_tuple(tids.p_state...);
+        auto st = std::make_shared<any_state>(R{
+            std::size_t(-1), std::tuple<tid<T>...>{std::move(tids)...}
+        });
+        auto fire = [&st, &ret](std::size_t idx) {
+            return [st, lst = ret.p_state, idx]() {
+                if (!st->done.exchange(true, std::memory_order_acq_rel)) {
+                    auto body = [&st, idx]() -> R {
+                        st->res.index = idx;
+                        return std::move(st->res);
+                    };
+                    lst->set_value(body);
+                }
+            };
+        };
+        if constexpr(sizeof...(T) == 0) {
+            fire(std::size_t(-1))();
+        } else {
+            std::apply([&fire](auto &...ps) {
+                std::size_t idx = 0;
+                (ps->add_continuation(fire(idx++)), ...);
+            }, sts);
+        }
+        return ret;
+    }
+
     /** @brief Creates a channel suitable for the scheduler.
      *
      * Returns a channel that uses a condition variable type returned by
@@ -418,6 +791,12 @@ namespace detail {
     };
 }
 
+template<typename T>
+template<typename F>
+inline tid<std::result_of_t<F(tid<T>)>> tid<T>::then(F func) {
+    return detail::current_scheduler->then(std::move(*this), std::move(func));
+}
+
 /** @brief A scheduler that uses an `std::thread` per each task.
  *
  * This one doesn't actually do any scheduling, it leaves it to the OS.
@@ -477,6 +856,10 @@ struct basic_thread_scheduler: scheduler {
         std::this_thread::yield();
     }
 
+    void sleep_until(std::chrono::steady_clock::time_point tp) {
+        std::this_thread::sleep_until(tp);
+    }
+
     generic_condvar make_condition() {
         return generic_condvar{};
     }
@@ -543,6 +926,16 @@ namespace detail {
     struct csched_task;
 
     OSTD_EXPORT extern thread_local csched_task *current_csched_task;
+    /* the numa node index of the current coroutine scheduler worker */
+    OSTD_EXPORT extern thread_local std::size_t current_csched_node;
+
+    template<typename SA, typename = void>
+    struct stack_has_node_alloc: std::false_type {};
+
+    template<typename SA>
+    struct stack_has_node_alloc<SA, std::void_t<decltype(
+        std::declval<SA &>().get_allocator(std::size_t(0))
+    )>>: std::true_type {};
 
     struct OSTD_EXPORT csched_task: coroutine_context {
         friend struct coroutine_context;
@@ -634,6 +1027,23 @@ private:
             l.lock();
         }
 
+        template<typename L>
+        std::cv_status wait_until(
+            L &l, std::chrono::steady_clock::time_point tp
+        ) noexcept {
+            l.unlock();
+            while (!p_notified) {
+                if (std::chrono::steady_clock::now() >= tp) {
+                    l.lock();
+                    return std::cv_status::timeout;
+                }
+                p_sched.yield();
+            }
+            p_notified = false;
+            l.lock();
+            return std::cv_status::no_timeout;
+        }
+
         void notify_one() noexcept {
             p_notified = true;
             p_sched.yield();
@@ -732,6 +1142,16 @@ public:
         detail::csched_task::current()->yield();
     }
 
+    void sleep_until(std::chrono::steady_clock::time_point tp) {
+        /* the dispatcher moves us out of the queue until the timer fires */
+        sleeper sl;
+        sl.pos = p_idx;
+        sl.timer.data = &sl;
+        p_timers.add(sl.timer, tp);
+        p_sleep = true;
+        yield();
+    }
+
     generic_condvar make_condition() {
         return generic_condvar{[this]() {
             return coro_cond{*this};
@@ -751,14 +1171,38 @@ public:
     }
 
 private:
+    using clist = std::list<detail::csched_task>;
+
+    struct sleeper {
+        timer_node timer;
+        typename clist::iterator pos;
+    };
+
     void dispatch() {
-        while (!p_coros.empty()) {
+        while (!p_coros.empty() || !p_sleeping.empty()) {
+            if (!p_timers.empty()) {
+                p_timers.expire(
+                    std::chrono::steady_clock::now(), [this](timer_node &nd) {
+                        auto *sl = static_cast<sleeper *>(nd.data);
+                        p_coros.splice(p_coros.end(), p_sleeping, sl->pos);
+                    }
+                );
+                if (p_coros.empty()) {
+                    /* everything is asleep, so block until the next timer */
+                    std::this_thread::sleep_until(p_timers.next_expiry());
+                    continue;
+                }
+            }
             if (p_idx == p_coros.end()) {
                 p_idx = p_coros.begin();
             }
             (*p_idx)();
             if (p_idx->dead()) {
                 p_idx = p_coros.erase(p_idx);
+            } else if (p_sleep) {
+                p_sleep = false;
+                auto it = p_idx++;
+                p_sleeping.splice(p_sleeping.end(), p_coros, it);
             } else {
                 ++p_idx;
             }
@@ -766,8 +1210,11 @@ private:
     }
 
     SA p_stacks;
-    std::list<detail::csched_task> p_coros;
-    typename std::list<detail::csched_task>::iterator p_idx = p_coros.end();
+    clist p_coros;
+    clist p_sleeping;
+    typename clist::iterator p_idx = p_coros.end();
+    timer_wheel p_timers;
+    bool p_sleep = false;
 };
 
 /** @brief An ostd::basic_simple_coroutine_scheduler using ostd::stack_pool. */
@@ -781,6 +1228,14 @@ using simple_coroutine_scheduler = basic_simple_coroutine_scheduler<stack_pool>;
  * so they're completely hidden from the outside code. This also has several
  * advantages for code using coroutines.
  *
+ * The placement of the worker threads can be configured using an
+ * ostd::worker_placement. With NUMA aware scheduling, every node gets
+ * its own run queue; a worker runs tasks from its own node first and
+ * only then takes work from other nodes, nearest first. New tasks are
+ * queued on the node of the worker that spawned them. If the stack
+ * allocator has a node aware `get_allocator(std::size_t)` (like
+ * ostd::basic_stack_pool), the task stacks are allocated on the node.
+ *
  * @tparam SA The stack allocator to use when requesting stacks. Used for
  *            the tasks as well as for the stack request methods.
  */
@@ -803,7 +1258,12 @@ private:
     public:
         task_cond *waiting_on = nullptr;
         task *next_waiting = nullptr;
+        task *prev_waiting = nullptr;
         titer pos;
+        std::size_t node = 0;
+        detail::sched_stamp stamp;
+        timer_node timer;
+        bool timed_out = false;
 
         template<typename F, typename TSA>
         task(F &&f, TSA &&sa):
@@ -853,6 +1313,28 @@ private:
             l.lock();
         }
 
+        template<typename L>
+        std::cv_status wait_until(
+            L &l, std::chrono::steady_clock::time_point tp
+        ) noexcept {
+            /* same as above, but also arm the timer while locked, if it
+             * fires first, the task is taken off the wait queue
+             */
+            p_sched.p_lock.lock();
+            l.unlock();
+            task *curr = task::current();
+            curr->waiting_on = this;
+            curr->timed_out = false;
+            curr->timer.data = curr;
+            p_sched.p_timers.add(curr->timer, tp);
+            curr->yield();
+            l.lock();
+            if (curr->timed_out) {
+                return std::cv_status::timeout;
+            }
+            return std::cv_status::no_timeout;
+        }
+
         void notify_one() noexcept {
             p_sched.notify_one(p_waiting);
         }
@@ -872,11 +1354,23 @@ public:
      *
      * @param[in] thrs The number of threads to use.
      * @param[in] sa The provided stack allocator.
+     * @param[in] pl The worker placement.
      */
     basic_coroutine_scheduler(
-        std::size_t thrs = std::thread::hardware_concurrency(), SA &&sa = SA{}
+        std::size_t thrs = std::thread::hardware_concurrency(), SA &&sa = SA{},
+        worker_placement pl = worker_placement{}
     ):
-        p_threads(thrs), p_stacks(std::move(sa))
+        p_threads(thrs), p_placement(pl), p_stacks(std::move(sa)),
+        p_available(pl.numa ? cpu_topology::system().nodes.size() : 1)
+    {}
+
+    /* @brief Creates the scheduler with the given worker placement.
+     *
+     * @param[in] thrs The number of threads to use.
+     * @param[in] pl The worker placement.
+     */
+    basic_coroutine_scheduler(std::size_t thrs, worker_placement pl):
+        basic_coroutine_scheduler(thrs, SA{}, pl)
     {}
 
     ~basic_coroutine_scheduler() {}
@@ -907,7 +1401,7 @@ public:
 
         if constexpr(std::is_same_v<R, void>) {
             spawn_add(
-                std::forward<TSA>(sa), std::move(func),
+                0, std::forward<TSA>(sa), std::move(func),
                 std::forward<A>(args)...
             );
             /* actually start the thread pool */
@@ -915,7 +1409,7 @@ public:
         } else {
             R ret;
             spawn_add(
-                std::forward<TSA>(sa),
+                0, std::forward<TSA>(sa),
                 [&ret, func = std::move(func)](auto &&...fargs) {
                     ret = func(std::forward<A>(fargs)...);
                 },
@@ -951,7 +1445,21 @@ public:
     void do_spawn(std::function<void()> func) {
         {
             std::lock_guard<std::mutex> l{p_lock};
-            spawn_add(p_stacks.get_allocator(), std::move(func));
+            std::size_t node = 0;
+            if (p_placement.numa) {
+                node = detail::current_csched_node;
+            }
+            if constexpr(detail::stack_has_node_alloc<SA>::value) {
+                if (p_placement.numa) {
+                    spawn_add(
+                        node, p_stacks.get_allocator(node), std::move(func)
+                    );
+                } else {
+                    spawn_add(node, p_stacks.get_allocator(), std::move(func));
+                }
+            } else {
+                spawn_add(node, p_stacks.get_allocator(), std::move(func));
+            }
         }
         p_cond.notify_one();
     }
@@ -960,6 +1468,16 @@ public:
         task::current()->yield();
     }
 
+    void sleep_until(std::chrono::steady_clock::time_point tp) {
+        /* wait on a condvar nobody else can notify */
+        struct {
+            void lock() noexcept {}
+            void unlock() noexcept {}
+        } nl;
+        task_cond c{*this};
+        c.wait_until(nl, tp);
+    }
+
     generic_condvar make_condition() {
         return generic_condvar{[this]() {
             return task_cond{*this};
@@ -993,17 +1511,28 @@ public:
         }
     }
 
+    /** @brief Gets a snapshot of the scheduler statistics.
+     *
+     * The snapshot is empty unless libostd was built with statistics
+     * enabled (see ostd::scheduler_stats_enabled). The queue depth is
+     * the number of tasks ready to run in all run queues combined.
+     */
+    scheduler_stats stats() const {
+        return p_stats.snapshot();
+    }
+
 private:
     template<typename TSA, typename F, typename ...A>
-    void spawn_add(TSA &&sa, F &&func, A &&...args) {
+    void spawn_add(std::size_t node, TSA &&sa, F &&func, A &&...args) {
+        tlist &avail = p_available[node];
         task *t = nullptr;
         if constexpr(sizeof...(A) == 0) {
-            t = &p_available.emplace_back(
+            t = &avail.emplace_back(
                 std::forward<F>(func),
                 std::forward<TSA>(sa)
             );
         } else {
-            t = &p_available.emplace_back(
+            t = &avail.emplace_back(
                 [lfunc = std::bind(
                     std::forward<F>(func), std::forward<A>(args)...
                 )]() mutable {
@@ -1012,15 +1541,20 @@ private:
                 std::forward<TSA>(sa)
             );
         }
-        t->pos = --p_available.end();
+        t->pos = --avail.end();
+        t->node = node;
+        ++p_navail;
+        p_stats.queued(t->stamp);
+        p_stats.depth(p_navail);
     }
 
     void init() {
         std::size_t size = p_threads;
         std::vector<std::thread> thrs;
         thrs.reserve(size);
+        p_stats.reset(size);
         for (std::size_t i = 0; i < size; ++i) {
-            thrs.emplace_back([this]() { thread_run(); });
+            thrs.emplace_back([this, i]() { thread_run(i); });
         }
         for (std::size_t i = 0; i < size; ++i) {
             if (thrs[i].joinable()) {
@@ -1034,9 +1568,7 @@ private:
         if (wl == nullptr) {
             return;
         }
-        wl->waiting_on = nullptr;
-        p_available.splice(p_available.cbegin(), p_waiting, wl->pos);
-        wl = std::exchange(wl->next_waiting, nullptr);
+        wake_waiting(wl);
         l.unlock();
         p_cond.notify_one();
         task::current()->yield();
@@ -1046,9 +1578,7 @@ private:
         {
             std::unique_lock<std::mutex> l{p_lock};
             while (wl != nullptr) {
-                wl->waiting_on = nullptr;
-                p_available.splice(p_available.cbegin(), p_waiting, wl->pos);
-                wl = std::exchange(wl->next_waiting, nullptr);
+                wake_waiting(wl);
                 l.unlock();
                 p_cond.notify_one();
                 l.lock();
@@ -1057,25 +1587,110 @@ private:
         task::current()->yield();
     }
 
-    void thread_run() {
+    /* takes the first task off a wait queue, with the lock held */
+    void wake_waiting(task *&wl) {
+        task *t = wl;
+        wl = std::exchange(t->next_waiting, nullptr);
+        if (wl) {
+            wl->prev_waiting = nullptr;
+        }
+        t->waiting_on = nullptr;
+        p_timers.remove(t->timer);
+        make_available(t, p_waiting, true);
+    }
+
+    /* a timed wait has expired, with the lock held */
+    void timer_fire(task *t) {
+        if (t->prev_waiting) {
+            t->prev_waiting->next_waiting = t->next_waiting;
+        } else {
+            t->waiting_on->p_waiting = t->next_waiting;
+        }
+        if (t->next_waiting) {
+            t->next_waiting->prev_waiting = t->prev_waiting;
+        }
+        t->next_waiting = t->prev_waiting = nullptr;
+        t->waiting_on = nullptr;
+        t->timed_out = true;
+        make_available(t, p_waiting, false);
+    }
+
+    /* fires the due timers, with the lock held */
+    void expire_timers() {
+        if (p_timers.empty()) {
+            return;
+        }
+        std::size_t nfired = 0;
+        p_timers.expire(
+            std::chrono::steady_clock::now(), [this, &nfired](timer_node &nd) {
+                timer_fire(static_cast<task *>(nd.data));
+                ++nfired;
+            }
+        );
+        /* the calling worker takes one, wake others for the rest */
+        for (std::size_t i = 1; i < nfired; ++i) {
+            p_cond.notify_one();
+        }
+    }
+
+    /* must be called with the lock held */
+    void make_available(task *t, tlist &from, bool front) {
+        tlist &avail = p_available[t->node];
+        avail.splice(front ? avail.cbegin() : avail.cend(), from, t->pos);
+        ++p_navail;
+        p_stats.depth(p_navail);
+    }
+
+    void thread_run(std::size_t worker) {
+        auto &topo = cpu_topology::system();
+        if (p_placement.pin) {
+            pin_current_thread(topo.worker_cpu(worker));
+        }
+        /* the order in which the run queues are checked */
+        std::vector<std::size_t> order{0};
+        if (p_placement.numa) {
+            detail::current_csched_node = topo.worker_node(worker);
+            order = topo.node_order(detail::current_csched_node);
+        }
         for (;;) {
             std::unique_lock<std::mutex> l{p_lock};
+            expire_timers();
             /* wait for an item to become available */
-            while (p_available.empty()) {
+            while (!p_navail) {
                 /* if all lists have become empty, we're done */
                 if (p_waiting.empty() && p_running.empty()) {
                     return;
                 }
-                p_cond.wait(l);
+                auto since = p_stats.now();
+                if (p_timers.empty()) {
+                    p_cond.wait(l);
+                } else {
+                    p_cond.wait_until(l, p_timers.next_expiry());
+                }
+                p_stats.idle(worker, since);
+                expire_timers();
+            }
+            for (auto n: order) {
+                if (!p_available[n].empty()) {
+                    if (n != order.front()) {
+                        p_stats.stole(worker);
+                    }
+                    task_run(l, p_available[n], worker);
+                    break;
+                }
             }
-            task_run(l);
         }
     }
 
-    void task_run(std::unique_lock<std::mutex> &l) {
-        auto it = p_available.begin();
-        p_running.splice(p_running.cend(), p_available, it);
+    void task_run(
+        std::unique_lock<std::mutex> &l, tlist &avail, std::size_t worker
+    ) {
+        auto it = avail.begin();
+        p_running.splice(p_running.cend(), avail, it);
+        --p_navail;
+        p_stats.depth(p_navail);
         task &c = *it;
+        p_stats.run(worker, c.stamp);
         l.unlock();
         c();
         if (c.dead()) {
@@ -1086,19 +1701,24 @@ private:
              * when a task or tasks are already running, and those that do
              * will do the final notify by themselves
              */
-            if (p_available.empty() && p_waiting.empty() && p_running.empty()) {
+            if (!p_navail && p_waiting.empty() && p_running.empty()) {
                 l.unlock();
                 p_cond.notify_all();
             }
         } else if (!c.waiting_on) {
             /* reschedule to the end of the queue */
             l.lock();
-            p_available.splice(p_available.cend(), p_running, it);
+            make_available(&c, p_running, false);
             l.unlock();
+            p_stats.yielded(worker);
             p_cond.notify_one();
         } else {
             p_waiting.splice(p_waiting.cbegin(), p_running, it);
+            c.prev_waiting = nullptr;
             c.next_waiting = c.waiting_on->p_waiting;
+            if (c.next_waiting) {
+                c.next_waiting->prev_waiting = &c;
+            }
             c.waiting_on->p_waiting = &c;
             /* wait locks the mutex, so manually unlock it here */
             p_lock.unlock();
@@ -1106,10 +1726,15 @@ private:
     }
 
     std::size_t p_threads;
+    worker_placement p_placement;
     std::condition_variable p_cond;
     std::mutex p_lock;
     SA p_stacks;
-    tlist p_available;
+    /* one run queue per numa node, or just one */
+    std::vector<tlist> p_available;
+    std::size_t p_navail = 0;
+    detail::sched_stats p_stats;
+    timer_wheel p_timers;
     tlist p_waiting;
     tlist p_running;
 };
@@ -1129,6 +1754,46 @@ inline tid<std::result_of_t<F(A...)>> spawn(F &&func, A &&...args) {
     );
 }
 
+/** @brief Waits for all of the given tasks without blocking.
+ *
+ * Effectively calls scheduler::when_all() on the current scheduler.
+ */
+template<typename T>
+inline tid<std::vector<tid<T>>> when_all(std::vector<tid<T>> tids) {
+    return detail::current_scheduler->when_all(std::move(tids));
+}
+
+/** @brief Waits for all of the given tasks without blocking.
+ *
+ * Effectively calls scheduler::when_all() on the current scheduler.
+ */
+template<typename ...T>
+inline tid<std::tuple<tid<T>...>> when_all(tid<T> &&...tids) {
+    return detail::current_scheduler->when_all(std::move(tids)...);
+}
+
+/** @brief Waits for the first of the given tasks without blocking.
+ *
+ * Effectively calls scheduler::when_any() on the current scheduler.
+ */
+template<typename T>
+inline tid<when_any_result<std::vector<tid<T>>>> when_any(
+    std::vector<tid<T>> tids
+) {
+    return detail::current_scheduler->when_any(std::move(tids));
+}
+
+/** @brief Waits for the first of the given tasks without blocking.
+ *
+ * Effectively calls scheduler::when_any() on the current scheduler.
+ */
+template<typename ...T>
+inline tid<when_any_result<std::tuple<tid<T>...>>> when_any(
+    tid<T> &&...tids
+) {
+    return detail::current_scheduler->when_any(std::move(tids)...);
+}
+
 /** @brief Tells the current scheduler to re-schedule the current task.
  *
  * Effectively calls scheduler::yield().
@@ -1137,6 +1802,79 @@ inline void yield() noexcept {
     detail::current_scheduler->yield();
 }
 
+/** @brief Suspends the current task until the given time point.
+ *
+ * Effectively calls scheduler::sleep_until(). Outside of a scheduler,
+ * the calling thread is put to sleep.
+ */
+inline void sleep_until(std::chrono::steady_clock::time_point tp) {
+    if (!detail::current_scheduler) {
+        std::this_thread::sleep_until(tp);
+        return;
+    }
+    detail::current_scheduler->sleep_until(tp);
+}
+
+/** @brief Suspends the current task for the given duration.
+ *
+ * Same as ostd::sleep_until() with the deadline being now plus `d`.
+ */
+template<typename Rep, typename Period>
+inline void sleep_for(std::chrono::duration<Rep, Period> const &d) {
+    using sd = std::chrono::steady_clock::duration;
+    sleep_until(std::chrono::steady_clock::now() + std::chrono::ceil<sd>(d));
+}
+
+/** @brief A timer that ticks at a fixed rate.
+ *
+ * Every call to wait() suspends the current task until the next tick,
+ * using ostd::sleep_until(), so it works with any scheduler. The ticks
+ * are based on the time the timer was created rather than on when wait()
+ * was called, so the period does not drift. If the caller falls behind,
+ * the missed ticks are skipped rather than fired in a burst.
+ */
+struct periodic_timer {
+    /** @brief Creates the timer, with the first tick one period from now. */
+    template<typename Rep, typename Period>
+    periodic_timer(std::chrono::duration<Rep, Period> const &period):
+        p_period(std::chrono::ceil<std::chrono::steady_clock::duration>(
+            period
+        )),
+        p_next(std::chrono::steady_clock::now() + p_period)
+    {
+        if (p_period <= std::chrono::steady_clock::duration::zero()) {
+            throw std::invalid_argument{"invalid periodic_timer period"};
+        }
+    }
+
+    /** @brief Waits until the next tick.
+     *
+     * @returns The number of ticks that have passed since the previous
+     *          call, i.e. 1 unless some ticks were missed.
+     */
+    std::size_t wait() {
+        ostd::sleep_until(p_next);
+        auto now = std::chrono::steady_clock::now();
+        auto n = std::size_t((now - p_next) / p_period) + 1;
+        p_next += n * p_period;
+        return n;
+    }
+
+    /** @brief Gets the time of the next tick. */
+    std::chrono::steady_clock::time_point next() const noexcept {
+        return p_next;
+    }
+
+    /** @brief Gets the period of the timer. */
+    std::chrono::steady_clock::duration period() const noexcept {
+        return p_period;
+    }
+
+private:
+    std::chrono::steady_clock::duration p_period;
+    std::chrono::steady_clock::time_point p_next;
+};
+
 /** @brief Creates a channel with the currently in use scheduler.
  *
  * Effectively calls scheduler::make_channel().
@@ -1149,6 +1887,22 @@ inline channel<T> make_channel() {
     return detail::current_scheduler->make_channel<T>();
 }
 
+/** @brief Creates a mutex with the currently in use scheduler.
+ *
+ * Effectively calls scheduler::make_mutex().
+ */
+inline mutex make_mutex() {
+    return detail::current_scheduler->make_mutex();
+}
+
+/** @brief Creates a condition with the currently in use scheduler.
+ *
+ * Effectively calls scheduler::make_condvar().
+ */
+inline condition make_condvar() {
+    return detail::current_scheduler->make_condvar();
+}
+
 /** @brief Creates a coroutine with the currently in use scheduler.
  *
  * Effectively calls scheduler::make_coroutine().
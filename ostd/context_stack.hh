@@ -21,8 +21,10 @@
 #include <cstddef>
 #include <new>
 #include <algorithm>
+#include <vector>
 
 #include <ostd/platform.hh>
+#include <ostd/topology.hh>
 
 #ifdef OSTD_USE_VALGRIND
 #  include <valgrind/valgrind.h>
@@ -269,6 +271,11 @@ using protected_fixedsize_stack = basic_fixedsize_stack<stack_traits, true>;
  * The allocated stacks are fixed size and allocated exactly the same as
  * ostd::basic_fixedsize_stack would.
  *
+ * Stacks can also be requested for a specific NUMA node (see
+ * get_allocator(std::size_t)). Every node has its own list of free stacks
+ * and its chunks have their memory bound to the node, so that tasks running
+ * on that node get local stack memory.
+ *
  * Keep in mind that stack pools are not thread safe, so external locking
  * has to be done (see is_thread_safe).
  *
@@ -280,10 +287,12 @@ struct basic_stack_pool {
 private:
     struct allocator {
         allocator() = delete;
-        allocator(basic_stack_pool &p) noexcept: p_pool(&p) {}
+        allocator(basic_stack_pool &p, std::size_t list = 0) noexcept:
+            p_pool(&p), p_list(list)
+        {}
 
         stack_context allocate() {
-            return p_pool->allocate();
+            return p_pool->allocate_from(p_list);
         }
 
         void deallocate(stack_context &st) noexcept {
@@ -292,6 +301,7 @@ private:
 
     private:
         basic_stack_pool *p_pool;
+        std::size_t p_list;
     };
 
 public:
@@ -350,12 +360,12 @@ public:
      */
     basic_stack_pool(basic_stack_pool &&p) noexcept {
         p_chunk = p.p_chunk;
-        p_unused = p.p_unused;
+        p_unused = std::move(p.p_unused);
         p_chunksize = p.p_chunksize;
         p_stacksize = p.p_stacksize;
         p_capacity = p.p_capacity;
         p.p_chunk = nullptr;
-        p.p_unused = nullptr;
+        p.p_unused.clear();
         p.p_capacity = 0;
     }
 
@@ -396,7 +406,7 @@ public:
             return;
         }
         std::size_t cnum = p_chunksize / p_stacksize;
-        p_unused = alloc_chunks(p_unused, (n - cap + cnum - 1) / cnum);
+        alloc_chunks(0, (n - cap + cnum - 1) / cnum);
     }
 
     /** @brief Requests a stack directly from the pool.
@@ -406,23 +416,23 @@ public:
      * and allocations from it will be done via get_allocator().
      */
     stack_context allocate() {
-        stack_node *nd = request();
-        std::size_t ss = p_stacksize - sizeof(stack_node);
-        [[maybe_unused]] auto *p = reinterpret_cast<unsigned char *>(nd) - ss;
-        if constexpr(Protected) {
-            detail::stack_protect(p, Traits::page_size());
-        }
-        stack_context ret{nd, ss};
-#ifdef OSTD_USE_VALGRIND
-        ret.valgrind_id = VALGRIND_STACK_REGISTER(ret.ptr, p);
-#endif
-        return ret;
+        return allocate_from(0);
+    }
+
+    /** @brief Requests a stack for a NUMA node directly from the pool.
+     *
+     * Like allocate(), but the stack comes from the node's own list. The
+     * node is an index into cpu_topology::nodes of the system topology.
+     */
+    stack_context allocate(std::size_t node) {
+        return allocate_from(node + 1);
     }
 
     /** @brief Returns a stack back to the pool.
      *
      * This returns the given stack back to the pool for reuse. Stack pool
-     * only frees all of its memory when it's destroyed.
+     * only frees all of its memory when it's destroyed. The stack is put
+     * back into the list it was taken from.
      */
     void deallocate(stack_context &st) noexcept {
         if (!st.ptr) {
@@ -432,9 +442,8 @@ public:
         VALGRIND_STACK_DEREGISTER(st.valgrind_id);
 #endif
         stack_node *nd = static_cast<stack_node *>(st.ptr);
-        stack_node *unused = p_unused;
-        nd->next = unused;
-        p_unused = nd;
+        nd->next = p_unused[nd->list];
+        p_unused[nd->list] = nd;
     }
 
     /** @brief Swaps two stack pools. */
@@ -457,28 +466,65 @@ public:
         return allocator{*this};
     }
 
+    /** @brief Gets a stack allocator for a NUMA node.
+     *
+     * Like get_allocator(), but the allocator uses allocate(std::size_t)
+     * with the given node.
+     */
+    allocator_type get_allocator(std::size_t node) noexcept {
+        return allocator{*this, node + 1};
+    }
+
 private:
     struct stack_node {
         void *next_chunk;
         stack_node *next;
+        std::size_t list;
     };
 
-    stack_node *alloc_chunks(stack_node *un, std::size_t n) {
+    /* list 0 is for regular stacks, others are for numa nodes */
+    stack_context allocate_from(std::size_t list) {
+        stack_node *nd = request(list);
+        std::size_t ss = p_stacksize - sizeof(stack_node);
+        [[maybe_unused]] auto *p = reinterpret_cast<unsigned char *>(nd) - ss;
+        if constexpr(Protected) {
+            detail::stack_protect(p, Traits::page_size());
+        }
+        stack_context ret{nd, ss};
+#ifdef OSTD_USE_VALGRIND
+        ret.valgrind_id = VALGRIND_STACK_REGISTER(ret.ptr, p);
+#endif
+        return ret;
+    }
+
+    void alloc_chunks(std::size_t list, std::size_t n) {
         std::size_t ss = p_stacksize;
         std::size_t cs = p_chunksize;
         std::size_t cnum = cs / ss;
 
+        if (p_unused.size() <= list) {
+            p_unused.resize(list + 1, nullptr);
+        }
+        stack_node *&un = p_unused[list];
+
         for (std::size_t ci = 0; ci < n; ++ci) {
             void *chunk = detail::stack_alloc(cs);
+            if (list) {
+                bind_memory_node(
+                    chunk, cs, cpu_topology::system().nodes[list - 1].id
+                );
+            }
             stack_node *prevn = un;
             for (std::size_t i = cnum; i >= 2; --i) {
                 auto nd = get_node(chunk, ss, i);
                 nd->next_chunk = nullptr;
                 nd->next = prevn;
+                nd->list = list;
                 prevn = nd;
             }
             auto *fnd = get_node(chunk, ss, 1);
             fnd->next_chunk = p_chunk;
+            fnd->list = list;
             /* write every time so that a potential failure results
              * in all previously allocated chunks being freed in dtor
              */
@@ -487,16 +533,14 @@ private:
             un = fnd;
         }
         p_capacity += (n * cnum);
-
-        return un;
     }
 
-    stack_node *request() {
-        stack_node *r = p_unused;
-        if (!r) {
-            r = alloc_chunks(nullptr, 1);
+    stack_node *request(std::size_t list) {
+        if ((p_unused.size() <= list) || !p_unused[list]) {
+            alloc_chunks(list, 1);
         }
-        p_unused = r->next;
+        stack_node *r = p_unused[list];
+        p_unused[list] = r->next;
         return r;
     }
 
@@ -507,7 +551,7 @@ private:
     }
 
     void *p_chunk = nullptr;
-    stack_node *p_unused = nullptr;
+    std::vector<stack_node *> p_unused = std::vector<stack_node *>(1);
 
     std::size_t p_chunksize;
     std::size_t p_stacksize;
@@ -27,6 +27,9 @@
 #include <climits>
 #include <utility>
 #include <stdexcept>
+#include <limits>
+#include <memory>
+#include <charconv>
 #include <locale>
 #include <ios>
 
@@ -142,7 +145,7 @@ namespace detail {
         1, 1, 1, 8, /* E F G H */
         8, 8, 8, 8, /* I J K L */
         8, 8, 8, 8, /* M N O P */
-        8, 8, 8, 8, /* Q R S T */
+        8, 1, 8, 8, /* Q R S T */
         8, 8, 8, 6, /* U V W X */
         8, 8,       /* Y Z */
 
@@ -154,7 +157,7 @@ namespace detail {
         1, 1, 1, 8, /* e f g h */
         8, 8, 8, 8, /* i j k l */
         8, 8, 4, 8, /* m n o p */
-        8, 8, 7, 8, /* q r s t */
+        8, 1, 7, 8, /* q r s t */
         8, 8, 8, 6, /* u v w x */
         8, 8,       /* y z */
 
@@ -166,6 +169,87 @@ namespace detail {
         0, 0, 0, 2, 8, 10, 16, 0
     };
 
+    /* two decimal digits at a time, indexed by twice the value */
+    static inline constexpr char const fmt_digit_pairs[] =
+        "0001020304050607080910111213141516171819"
+        "2021222324252627282930313233343536373839"
+        "4041424344454647484950515253545556575859"
+        "6061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+
+    static inline constexpr unsigned long long const fmt_pow10[] = {
+        1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+        10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+        100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+        100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+        100000000000000000ULL, 1000000000000000000ULL,
+        10000000000000000000ULL
+    };
+
+    /* the number of significant bits, at least 1 */
+    inline std::size_t fmt_bit_width(unsigned long long v) noexcept {
+        v |= 1;
+#if defined(__GNUC__) || defined(__clang__)
+        return std::size_t(
+            sizeof(unsigned long long) * CHAR_BIT - __builtin_clzll(v)
+        );
+#else
+        std::size_t ret = 0;
+        for (; v; v >>= 1) {
+            ++ret;
+        }
+        return ret;
+#endif
+    }
+
+    /* the number of decimal digits, at least 1; log10 is approximated
+     * from the bit width (1233 / 4096 being about log10(2)) and then
+     * corrected using a table of powers of 10, with no branches
+     */
+    inline std::size_t fmt_dec_digits(unsigned long long v) noexcept {
+        std::size_t t = (fmt_bit_width(v) * 1233) >> 12;
+        return t + (v >= fmt_pow10[t]) + !v;
+    }
+
+    /* writes the digits of v into buf, which must have exactly the room
+     * for them, as given by fmt_dec_digits; the digits are filled in from
+     * the end so that the buffer is in the final order once done
+     */
+    inline void fmt_write_dec(
+        char *buf, std::size_t ndig, unsigned long long v
+    ) noexcept {
+        char *p = buf + ndig;
+        while (v >= 100) {
+            auto i = std::size_t(v % 100) * 2;
+            v /= 100;
+            *--p = fmt_digit_pairs[i + 1];
+            *--p = fmt_digit_pairs[i];
+        }
+        if (v >= 10) {
+            auto i = std::size_t(v) * 2;
+            *--p = fmt_digit_pairs[i + 1];
+            *--p = fmt_digit_pairs[i];
+        } else {
+            *--p = char('0' + v);
+        }
+    }
+
+    /* same for power of two bases, taking the number of bits per digit
+     * and a mask of 32 for lowercase or 0 for uppercase digits
+     */
+    inline std::size_t fmt_write_pow2(
+        char *buf, unsigned long long v, unsigned int shift, char cmask
+    ) noexcept {
+        std::size_t ndig = (fmt_bit_width(v) + shift - 1) / shift;
+        unsigned long long mask = (1ULL << shift) - 1;
+        char *p = buf + ndig;
+        do {
+            *--p = char("0123456789ABCDEF"[v & mask] | cmask);
+            v >>= shift;
+        } while (v);
+        return ndig;
+    }
+
     /* non-printable escapes up to 0x20 (space) */
     static inline constexpr char const *fmt_escapes[] = {
         "\\0"  , "\\x01", "\\x02", "\\x03", "\\x04", "\\x05",
@@ -188,6 +272,84 @@ namespace detail {
         return nullptr;
     }
 
+    /* formats a float without the locale, returning the end pointer; the
+     * buffer must be large enough for the result, see write_float
+     */
+    template<typename T>
+    inline char *fmt_float_chars(
+        char *buf, char *end, T val, char spec, int prec, bool hprec,
+        bool hash
+    ) {
+        std::to_chars_result r;
+        switch (spec) {
+            case 'r':
+                r = std::to_chars(buf, end, val);
+                break;
+            case 'f':
+                r = std::to_chars(
+                    buf, end, val, std::chars_format::fixed, prec
+                );
+                break;
+            case 'e':
+                r = std::to_chars(
+                    buf, end, val, std::chars_format::scientific, prec
+                );
+                break;
+            case 'a':
+                if (hprec) {
+                    r = std::to_chars(
+                        buf, end, val, std::chars_format::hex, prec
+                    );
+                } else {
+                    r = std::to_chars(buf, end, val, std::chars_format::hex);
+                }
+                break;
+            default:
+                if (!hash || !std::isfinite(val)) {
+                    r = std::to_chars(
+                        buf, end, val, std::chars_format::general, prec
+                    );
+                    break;
+                }
+                /* the alternative form keeps trailing zeroes, which the
+                 * general format cannot do, so choose the style like C does
+                 */
+                if (!prec) {
+                    prec = 1;
+                }
+                r = std::to_chars(
+                    buf, end, val, std::chars_format::scientific, prec - 1
+                );
+                if (char *ep = std::find(buf, r.ptr, 'e'); ep != r.ptr) {
+                    int x = 0;
+                    std::from_chars(ep + 1 + (ep[1] == '+'), r.ptr, x);
+                    if ((prec > x) && (x >= -4)) {
+                        r = std::to_chars(
+                            buf, end, val, std::chars_format::fixed,
+                            prec - 1 - x
+                        );
+                    }
+                }
+                break;
+        }
+        if (r.ec != std::errc{}) {
+            throw format_error{"float formatting failed"};
+        }
+        /* the alternative form always has a decimal point */
+        if (
+            hash && std::isfinite(val) &&
+            (std::find(buf, r.ptr, '.') == r.ptr)
+        ) {
+            char *dp = std::find_if(buf, r.ptr, [](char c) {
+                return (c == 'e') || (c == 'p');
+            });
+            std::memmove(dp + 1, dp, std::size_t(r.ptr - dp));
+            *dp = '.';
+            ++r.ptr;
+        }
+        return r.ptr;
+    }
+
     /* retrieve width/precision */
     template<typename T, typename ...A>
     inline int get_arg_param(std::size_t idx, T const &val, A const &...args) {
@@ -401,6 +563,8 @@ namespace detail {
  * * `f`, `F` - decimal floating point (lowercase, uppercase).
  * * `g`, `G` - shortest representation (`e`/`E` or `f`/`F`).
  * * `o` - octal integers.
+ * * `r`, `R` - floats in the shortest form that reads back as the same
+ *   value (lowercase, uppercase); the precision is ignored.
  * * `s` - any value with its default format.
  * * `x`, `X` - hexadecimal integers (lowercase, uppercase).
  *
@@ -486,7 +650,7 @@ struct format_spec {
      * The locale used here is the C locale.
      */
     format_spec(string_range fmt):
-        p_fmt{fmt}, p_loc{std::locale::classic()}
+        p_fmt{fmt}, p_loc{std::locale::classic()}, p_classic{true}
     {}
 
     /** @brief Constructs with a format string and a locale.
@@ -494,7 +658,7 @@ struct format_spec {
      * Like format_spec(string_range), but with an explicit locale.
      */
     format_spec(string_range fmt, std::locale const &loc):
-        p_fmt(fmt), p_loc(loc)
+        p_fmt(fmt), p_loc(loc), p_classic(loc == std::locale::classic())
     {}
 
     /** @brief Constructs a specific format specifier.
@@ -507,7 +671,8 @@ struct format_spec {
      * for formatting values.
      */
     format_spec(char spec, int flags = 0):
-        p_flags(flags), p_spec(spec), p_loc()
+        p_flags(flags), p_spec(spec), p_loc(),
+        p_classic(p_loc == std::locale::classic())
     {}
 
     /** @brief Constructs a specific format specifier with a locale.
@@ -515,7 +680,8 @@ struct format_spec {
      * Like format_spec(char, int) but uses an explicit locale.
      */
     format_spec(char spec, std::locale const &loc, int flags = 0):
-        p_flags(flags), p_spec(spec), p_loc(loc)
+        p_flags(flags), p_spec(spec), p_loc(loc),
+        p_classic(loc == std::locale::classic())
     {}
 
     /** @brief Parses the format string if constructed with one.
@@ -565,6 +731,7 @@ struct format_spec {
     std::locale imbue(std::locale const &loc) {
         std::locale ret{p_loc};
         p_loc = loc;
+        p_classic = (loc == std::locale::classic());
         return ret;
     }
 
@@ -1105,27 +1272,33 @@ private:
         /* 32 for lowercase variants, 0 for uppercase */
         char cmask = char((isp >= 'a') << 5);
 
-        UT base = UT(detail::fmt_bases[specn]);
-        bool zeroval = !val;
-        if (zeroval) {
-            ndig = 1;
-            buf[0] = '0';
-        } else {
-            UT uval;
-            if (neg) {
-                if (base != 10) {
-                    uval = UT(val);
-                    neg = false;
-                } else {
-                    uval = UT(-val);
-                }
+        UT uval = UT(val);
+        if (neg) {
+            if (specn != 5) {
+                neg = false;
             } else {
-                uval = UT(val);
+                uval = UT(-val);
             }
-            for (; uval; uval /= base) {
+        }
+        bool zeroval = !uval;
+        if constexpr(sizeof(UT) <= sizeof(unsigned long long)) {
+            if (specn == 5) {
+                ndig = detail::fmt_dec_digits(uval);
+                detail::fmt_write_dec(buf, ndig, uval);
+            } else {
+                /* 1 bit for binary, 3 for octal and 4 for hexadecimal */
+                unsigned int shift = (specn == 3) ? 1 : ((specn == 4) ? 3 : 4);
+                ndig = detail::fmt_write_pow2(buf, uval, shift, cmask);
+            }
+        } else {
+            /* extended integer types, digits are written backwards */
+            UT base = UT(detail::fmt_bases[specn]);
+            do {
                 auto vb = char(uval % base);
                 buf[ndig++] = (vb + "70"[vb < 10]) | cmask;
-            }
+                uval /= base;
+            } while (uval);
+            std::reverse(buf, buf + ndig);
         }
 
         std::size_t tdig = ndig;
@@ -1138,35 +1311,43 @@ private:
             }
         }
 
-        /* here starts the bullshit */
-        auto const &fac = std::use_facet<std::numpunct<wchar_t>>(p_loc);
-
+        /* the classic locale has no grouping, so none of the locale
+         * lookups need to happen for it; the same goes for pointers
+         */
         char tseps[MB_LEN_MAX];
-        int ntsep = detail::wc_to_mb_loc(fac.thousands_sep(), tseps, p_loc);
-
-        auto const &grp = fac.grouping();
-        auto grpp = reinterpret_cast<unsigned char const *>(grp.data());
+        int ntsep = 0;
+        std::string grp;
+        auto grpp = reinterpret_cast<unsigned char const *>("");
 
         std::size_t nseps = 0, sreps = 0;
         std::size_t total = tdig;
-        if (!ptr && (ntsep >= 0)) {
-            int cndig = int(ndig);
-            while (*grpp) {
-                cndig -= *grpp;
-                if (cndig > 0) {
-                    ++nseps;
-                    if (!grpp[1]) {
-                        ++sreps;
-                        continue;
+        if (!ptr && !p_classic) {
+            /* here starts the bullshit */
+            auto const &fac = std::use_facet<std::numpunct<wchar_t>>(p_loc);
+            grp = fac.grouping();
+            if (!grp.empty()) {
+                grpp = reinterpret_cast<unsigned char const *>(grp.data());
+                ntsep = detail::wc_to_mb_loc(fac.thousands_sep(), tseps, p_loc);
+            }
+            if (ntsep > 0) {
+                int cndig = int(ndig);
+                while (*grpp) {
+                    cndig -= *grpp;
+                    if (cndig > 0) {
+                        ++nseps;
+                        if (!grpp[1]) {
+                            ++sreps;
+                            continue;
+                        }
+                    } else {
+                        break;
                     }
-                } else {
-                    break;
+                    ++grpp;
                 }
-                ++grpp;
+                total += nseps * std::size_t(ntsep);
             }
-            total += nseps * std::size_t(ntsep);
+            /* here ends the bullshit */
         }
-        /* here ends the bullshit */
 
         int fl = flags();
         bool lsgn = fl & FMT_FLAG_PLUS;
@@ -1202,11 +1383,14 @@ private:
             for (std::size_t i = 0; i < (tdig - ndig); ++i) {
                 writer.put('0');
             }
-            /* the rest of the number, with thousands grouping */
-            unsigned char grpn = *grpp;
-            for (std::size_t i = 0; i < ndig; ++i) {
-                if (nseps) {
-                    if (!grpn) {
+            if (!nseps) {
+                /* no grouping, the digits can be written at once */
+                range_put_all(writer, string_range{buf, buf + ndig});
+            } else {
+                /* the rest of the number, with thousands grouping */
+                unsigned char grpn = *grpp;
+                for (std::size_t i = 0; i < ndig; ++i) {
+                    if (nseps && !grpn) {
                         for (int j = 0; j < ntsep; ++j) {
                             writer.put(tseps[j]);
                         }
@@ -1221,8 +1405,8 @@ private:
                     if (grpn) {
                         --grpn;
                     }
+                    writer.put(buf[i]);
                 }
-                writer.put(buf[ndig - i - 1]);
             }
         }
         write_spaces(writer, total + sign + (!!pfx * 2), false);
@@ -1236,13 +1420,82 @@ private:
         if (specn != 1 && specn != 7) {
             throw format_error{"cannot format floats with the given spec"};
         }
+        /* only other locales need the stream machinery */
+        if (!p_classic) {
+            write_float_loc(writer, isp, val);
+            return;
+        }
+
+        char lsp = (isp == 's') ? 'g' : (isp | 32);
+        int prec = has_precision() ? precision() : 6;
+
+        /* fixed notation of huge values needs all the integer digits */
+        std::size_t need = std::size_t(prec) + 64;
+        if (lsp == 'f') {
+            need += std::size_t(std::numeric_limits<T>::max_exponent10);
+        }
+        char sbuf[512];
+        std::unique_ptr<char[]> hbuf;
+        char *buf = sbuf;
+        if (need > sizeof(sbuf)) {
+            hbuf = std::make_unique<char[]>(need);
+            buf = hbuf.get();
+        }
+        char *end = detail::fmt_float_chars(
+            buf, buf + need, val, lsp, prec, has_precision(),
+            p_flags & FMT_FLAG_HASH
+        );
+
+        char sign = '\0';
+        if (*buf == '-') {
+            sign = *buf++;
+        } else if (p_flags & FMT_FLAG_PLUS) {
+            sign = '+';
+        } else if (p_flags & FMT_FLAG_SPACE) {
+            sign = ' ';
+        }
+        if (!(isp & 32)) {
+            for (char *p = buf; p != end; ++p) {
+                if ((*p >= 'a') && (*p <= 'z')) {
+                    *p -= 32;
+                }
+            }
+        }
+        bool finite = std::isfinite(val);
+        bool pfx = (lsp == 'a') && finite;
+        bool zero = (p_flags & FMT_FLAG_ZERO) && finite;
+        std::size_t total = std::size_t(end - buf) + !!sign + pfx * 2;
+
+        if (!zero) {
+            write_spaces(writer, total, true, ' ');
+        }
+        if (sign) {
+            writer.put(sign);
+        }
+        if (pfx) {
+            writer.put('0');
+            writer.put(char('X' | (isp & 32)));
+        }
+        if (zero) {
+            write_spaces(writer, total, true, '0');
+        }
+        range_put_all(writer, string_range{buf, end});
+        write_spaces(writer, total, false);
+    }
 
+    template<typename R, typename T>
+    void write_float_loc(R &writer, char isp, T val) const {
         /* null streambuf because it's only used to read flags etc */
         std::ios st{nullptr};
         st.imbue(p_loc);
 
         st.width(width());
-        st.precision(has_precision() ? precision() : 6);
+        if ((isp | 32) == 'r') {
+            /* not the shortest, but enough digits to round trip */
+            st.precision(std::numeric_limits<T>::max_digits10);
+        } else {
+            st.precision(has_precision() ? precision() : 6);
+        }
 
         typename std::ios_base::fmtflags fl{};
         if (!(isp & 32)) {
@@ -1608,6 +1861,7 @@ private:
 
     string_range p_fmt;
     std::locale p_loc;
+    bool p_classic;
     char p_buf[32];
 };
 
@@ -1646,6 +1900,211 @@ inline R &&format(
     return format_spec{fmt, loc}.format(std::forward<R>(writer), args...);
 }
 
+/** @brief A character buffer to format into.
+ *
+ * This is an output range of `char` which keeps the first `N` characters
+ * inline and only allocates memory once it outgrows that. Clearing the
+ * buffer keeps the memory, so it can be reused for many format calls.
+ * Contiguous character ranges are put into it with a single copy, see
+ * put_n().
+ *
+ * The contents are not null terminated.
+ */
+template<std::size_t N = 256>
+struct format_buffer: output_range<format_buffer<N>> {
+    using value_type = char;
+    using size_type  = std::size_t;
+
+    /** @brief Creates an empty buffer. */
+    format_buffer() noexcept {}
+
+    format_buffer(format_buffer const &) = delete;
+    format_buffer &operator=(format_buffer const &) = delete;
+
+    /** @brief Puts a single character into the buffer. */
+    void put(char c) {
+        if (p_cur == p_end) {
+            grow(1);
+        }
+        *p_cur++ = c;
+    }
+
+    /** @brief Puts `n` characters starting at `p` into the buffer. */
+    void put_n(char const *p, std::size_t n) {
+        if (std::size_t(p_end - p_cur) < n) {
+            grow(n);
+        }
+        if (n) {
+            std::memcpy(p_cur, p, n);
+            p_cur += n;
+        }
+    }
+
+    /** @brief Makes room for at least `n` characters in total. */
+    void reserve(std::size_t n) {
+        if (n > capacity()) {
+            grow(n - size());
+        }
+    }
+
+    /** @brief Removes all contents, keeping the memory. */
+    void clear() noexcept {
+        p_cur = p_beg;
+    }
+
+    /** @brief Removes all contents and frees the memory, if allocated. */
+    void reset() noexcept {
+        p_heap.reset();
+        p_beg = p_cur = p_small;
+        p_end = p_small + N;
+    }
+
+    /** @brief Checks if the buffer is empty. */
+    bool empty() const noexcept {
+        return p_cur == p_beg;
+    }
+
+    /** @brief Gets the number of characters in the buffer. */
+    std::size_t size() const noexcept {
+        return std::size_t(p_cur - p_beg);
+    }
+
+    /** @brief Gets the number of characters the buffer can hold. */
+    std::size_t capacity() const noexcept {
+        return std::size_t(p_end - p_beg);
+    }
+
+    /** @brief Gets a pointer to the contents. */
+    char const *data() const noexcept {
+        return p_beg;
+    }
+
+    /** @brief Gets the contents as a string slice. */
+    string_range str() const noexcept {
+        return string_range{p_beg, p_cur};
+    }
+
+private:
+    void grow(std::size_t n) {
+        std::size_t len = size();
+        std::size_t cap = std::max(capacity() * 2, len + n);
+        auto nbuf = std::make_unique<char[]>(cap);
+        std::memcpy(nbuf.get(), p_beg, len);
+        p_heap = std::move(nbuf);
+        p_beg = p_heap.get();
+        p_cur = p_beg + len;
+        p_end = p_beg + cap;
+    }
+
+    char p_small[N];
+    std::unique_ptr<char[]> p_heap;
+    char *p_beg = p_small;
+    char *p_cur = p_small;
+    char *p_end = p_small + N;
+};
+
+/** @brief Puts a range into an ostd::format_buffer.
+ *
+ * Contiguous character ranges are copied at once.
+ */
+template<std::size_t N, typename R>
+inline void range_put_all(format_buffer<N> &buf, R range) {
+    if constexpr(
+        is_contiguous_range<R> &&
+        std::is_same_v<std::remove_const_t<range_value_t<R>>, char>
+    ) {
+        buf.put_n(range.data(), range.size());
+    } else {
+        range_traverse(range, [&buf](auto &&v) {
+            buf.put(v);
+            return true;
+        });
+    }
+}
+
+namespace detail {
+    /* per-thread buffer for format_to_string, kept around for reuse */
+    struct fmt_arena {
+        format_buffer<> buf;
+        bool used = false;
+    };
+
+    /* the arena memory is freed after formatting anything bigger, so that
+     * a single huge string does not stay allocated in every thread
+     */
+    static inline constexpr std::size_t const fmt_arena_max = 64 * 1024;
+
+    inline fmt_arena &get_fmt_arena() {
+        static thread_local fmt_arena ret;
+        return ret;
+    }
+
+    template<typename ...A>
+    inline std::string fmt_to_string(
+        std::locale const *loc, string_range fmt, A const &...args
+    ) {
+        auto do_format = [&](auto &buf) {
+            /* a guess that is enough for most simple formats */
+            buf.reserve(fmt.size() + sizeof...(A) * 16);
+            if (loc) {
+                format_spec{fmt, *loc}.format(buf, args...);
+            } else {
+                format_spec{fmt}.format(buf, args...);
+            }
+            return std::string{buf.data(), buf.size()};
+        };
+        auto &ar = get_fmt_arena();
+        if (ar.used) {
+            /* formatting recursively from some format_traits */
+            format_buffer<> buf;
+            return do_format(buf);
+        }
+        struct arena_guard {
+            fmt_arena &ar;
+            ~arena_guard() {
+                if (ar.buf.capacity() > fmt_arena_max) {
+                    ar.buf.reset();
+                }
+                ar.used = false;
+            }
+        } guard{ar};
+        ar.used = true;
+        ar.buf.clear();
+        return do_format(ar.buf);
+    }
+} /* namespace detail */
+
+/** @brief Formats into a new string.
+ *
+ * This is equivalent to
+ *
+ * ~~~{.cc}
+ *     ostd::format(ostd::appender<std::string>(), fmt, args...).get();
+ * ~~~
+ *
+ * but considerably cheaper. The formatting happens in a buffer that is
+ * reused by every call within the thread, so the only allocation is the
+ * resulting string, which is allocated exactly once with the right size.
+ *
+ * Like ostd::format(), the C locale is used.
+ */
+template<typename ...A>
+inline std::string format_to_string(string_range fmt, A const &...args) {
+    return detail::fmt_to_string(nullptr, fmt, args...);
+}
+
+/** @brief Formats into a new string using a locale.
+ *
+ * Like ostd::format_to_string(string_range, A const &...), but with
+ * an explicit locale.
+ */
+template<typename ...A>
+inline std::string format_to_string(
+    std::locale const &loc, string_range fmt, A const &...args
+) {
+    return detail::fmt_to_string(&loc, fmt, args...);
+}
+
 /** @} */
 
 } /* namespace ostd */
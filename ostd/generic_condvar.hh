@@ -14,6 +14,7 @@
 
 #include <type_traits>
 #include <algorithm>
+#include <chrono>
 #include <condition_variable>
 
 #include <ostd/platform.hh>
@@ -31,8 +32,23 @@ namespace detail {
         virtual void notify_one() = 0;
         virtual void notify_all() = 0;
         virtual void wait(std::unique_lock<std::mutex> &) = 0;
+        virtual std::cv_status wait_until(
+            std::unique_lock<std::mutex> &,
+            std::chrono::steady_clock::time_point
+        ) = 0;
     };
 
+    template<typename C, typename = void>
+    struct cond_has_wait_until: std::false_type {};
+
+    template<typename C>
+    struct cond_has_wait_until<C, std::void_t<decltype(
+        std::declval<C &>().wait_until(
+            std::declval<std::unique_lock<std::mutex> &>(),
+            std::declval<std::chrono::steady_clock::time_point>()
+        )
+    )>>: std::true_type {};
+
     template<typename C>
     struct cond_impl: cond_iface {
         cond_impl(): p_cond() {}
@@ -47,6 +63,18 @@ namespace detail {
         void wait(std::unique_lock<std::mutex> &l) {
             p_cond.wait(l);
         }
+        std::cv_status wait_until(
+            std::unique_lock<std::mutex> &l,
+            std::chrono::steady_clock::time_point tp
+        ) {
+            if constexpr(cond_has_wait_until<C>::value) {
+                return p_cond.wait_until(l, tp);
+            } else {
+                /* no timeouts, behave like a spurious wakeup */
+                p_cond.wait(l);
+                return std::cv_status::no_timeout;
+            }
+        }
     private:
         C p_cond;
     };
@@ -83,7 +111,11 @@ struct generic_condvar {
      * @param[in] func The function that is called to get the condvar.
      */
     template<typename F>
-    generic_condvar(F &&func) {
+    generic_condvar(F &&func):
+        p_native(std::is_same_v<
+            std::result_of_t<F()>, std::condition_variable
+        >)
+    {
         new (reinterpret_cast<void *>(&p_condbuf))
             detail::cond_impl<std::result_of_t<F()>>(func);
     }
@@ -139,6 +171,48 @@ struct generic_condvar {
         reinterpret_cast<detail::cond_iface *>(&p_condbuf)->wait(l);
     }
 
+    /** @brief Blocks the current thread until woken up or a deadline.
+     *
+     * Like wait(std::unique_lock<std::mutex> &), but also unblocks once
+     * the given time point is reached. This calls `.wait_until(l, tp)` on
+     * the stored condvar; if the stored type has no such method, this is
+     * the same as wait(std::unique_lock<std::mutex> &) and never times out.
+     *
+     * @returns `std::cv_status::timeout` if the deadline was reached.
+     */
+    std::cv_status wait_until(
+        std::unique_lock<std::mutex> &l,
+        std::chrono::steady_clock::time_point tp
+    ) {
+        return reinterpret_cast<detail::cond_iface *>(&p_condbuf)->wait_until(
+            l, tp
+        );
+    }
+
+    /** @brief Blocks the current thread until woken up or a timeout.
+     *
+     * Same as wait_until() with the deadline being now plus `d`.
+     */
+    template<typename Rep, typename Period>
+    std::cv_status wait_for(
+        std::unique_lock<std::mutex> &l,
+        std::chrono::duration<Rep, Period> const &d
+    ) {
+        using sd = std::chrono::steady_clock::duration;
+        return wait_until(
+            l, std::chrono::steady_clock::now() + std::chrono::ceil<sd>(d)
+        );
+    }
+
+    /** @brief Checks if the stored condvar is std::condition_variable.
+     *
+     * In that case, waiting always blocks the whole OS thread, so users
+     * such as ostd::mutex can use OS level primitives directly instead.
+     */
+    bool native() const noexcept {
+        return p_native;
+    }
+
 private:
     static constexpr auto cvars = sizeof(std::condition_variable);
     static constexpr auto icvars =
@@ -146,6 +220,7 @@ private:
     std::aligned_storage_t<std::max(
         6 * sizeof(void *) + (icvars - cvars), icvars
     )> p_condbuf;
+    bool p_native = true;
 };
 
 /** @} */
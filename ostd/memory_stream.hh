@@ -0,0 +1,468 @@
+/** @addtogroup Streams
+ * @{
+ */
+
+/** @file memory_stream.hh
+ *
+ * @brief Streams backed by memory.
+ *
+ * This file implements two streams that keep their data in memory. The
+ * ostd::memory_stream is a seekable stream over either a growable byte
+ * vector or a fixed user provided buffer. The ostd::ring_stream is a
+ * bounded lock-free queue of bytes for handing data from one producer
+ * thread to one consumer thread.
+ *
+ * ~~~{.cc}
+ * ostd::memory_stream ms;
+ * ms.writef("%d %d", 1, 2);
+ * ms.seek(0);
+ * ostd::string_range s = ms.str(); // "1 2"
+ * ~~~
+ *
+ * @copyright See COPYING.md in the project tree for further information.
+ */
+
+#ifndef OSTD_MEMORY_STREAM_HH
+#define OSTD_MEMORY_STREAM_HH
+
+#include <cstddef>
+#include <cstring>
+#include <cerrno>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <algorithm>
+
+#include <ostd/platform.hh>
+#include <ostd/string.hh>
+#include <ostd/stream.hh>
+
+namespace ostd {
+
+/** @addtogroup Streams
+ * @{
+ */
+
+/** @brief A seekable stream over memory.
+ *
+ * A memory stream either owns a `std::vector<unsigned char>`, which grows
+ * as needed when writing past its end, or works over a fixed buffer owned
+ * by the user, in which case no copies are made and writing past the end
+ * of the buffer fails. A fixed buffer can also be read-only.
+ *
+ * Like with files, it's possible to seek past the end of a growable stream;
+ * a write there fills the gap with zeroes.
+ */
+struct memory_stream: stream {
+    /** @brief Creates an empty growable memory stream. */
+    memory_stream() {}
+
+    /** @brief Creates a growable memory stream with the given contents.
+     *
+     * The position is at the beginning.
+     */
+    memory_stream(std::vector<unsigned char> v): p_vec(std::move(v)) {
+        p_data = p_vec.data();
+        p_size = p_vec.size();
+    }
+
+    /** @brief Creates a memory stream over a fixed writable buffer.
+     *
+     * The whole buffer counts as the stream contents, so this can be used
+     * to both read and overwrite the buffer in place. Use tell() to get the
+     * amount of data written from the beginning.
+     */
+    memory_stream(void *buf, std::size_t size):
+        p_data(static_cast<unsigned char *>(buf)), p_size(size),
+        p_fixed(true)
+    {}
+
+    /** @brief Creates a read-only memory stream over a fixed buffer. */
+    memory_stream(void const *buf, std::size_t size):
+        memory_stream(const_cast<void *>(buf), size)
+    {
+        p_rdonly = true;
+    }
+
+    /** @brief Creates a read-only memory stream over a string. */
+    memory_stream(string_range s):
+        memory_stream(static_cast<void const *>(s.data()), s.size())
+    {}
+
+    /** @brief Moves the state and contents of another memory stream.
+     *
+     * The other stream is left empty.
+     */
+    memory_stream(memory_stream &&s):
+        p_vec(std::move(s.p_vec)), p_data(std::exchange(s.p_data, nullptr)),
+        p_size(std::exchange(s.p_size, 0)), p_pos(std::exchange(s.p_pos, 0)),
+        p_fixed(std::exchange(s.p_fixed, false)),
+        p_rdonly(std::exchange(s.p_rdonly, false)),
+        p_eof(std::exchange(s.p_eof, false))
+    {
+        s.p_vec.clear();
+    }
+
+    /** @brief Move assigns the other stream, see the move constructor. */
+    memory_stream &operator=(memory_stream &&s) {
+        memory_stream tmp{std::move(s)};
+        swap(tmp);
+        return *this;
+    }
+
+    /** @brief Swaps two memory streams. */
+    void swap(memory_stream &s) {
+        using std::swap;
+        swap(p_vec, s.p_vec);
+        swap(p_data, s.p_data);
+        swap(p_size, s.p_size);
+        swap(p_pos, s.p_pos);
+        swap(p_fixed, s.p_fixed);
+        swap(p_rdonly, s.p_rdonly);
+        swap(p_eof, s.p_eof);
+    }
+
+    /** @brief Checks if the stream works over a fixed buffer. */
+    bool is_fixed() const noexcept {
+        return p_fixed;
+    }
+
+    /** @brief Releases the contents and makes the stream empty.
+     *
+     * After this, the stream is an empty growable stream.
+     */
+    void close() {
+        memory_stream tmp;
+        swap(tmp);
+    }
+
+    /** @brief Checks if a read has hit the end of the stream.
+     *
+     * Just like with files, this only becomes true after an attempt to
+     * read past the end. It's reset by seeking.
+     */
+    bool end() const {
+        return p_eof;
+    }
+
+    /** @brief Gets the size of the contents without seeking. */
+    offset_type size() {
+        return offset_type(p_size);
+    }
+
+    /** @brief Seeks within the stream.
+     *
+     * Seeking before the beginning or, for fixed streams, past the end
+     * of the buffer fails.
+     *
+     * @throws ostd::stream_error with EINVAL on failure.
+     */
+    void seek(offset_type pos, stream_seek whence = stream_seek::SET) {
+        offset_type base = 0;
+        switch (whence) {
+            case stream_seek::CUR:
+                base = offset_type(p_pos);
+                break;
+            case stream_seek::END:
+                base = offset_type(p_size);
+                break;
+            default:
+                break;
+        }
+        if (((pos < 0) && (-pos > base)) || (
+            p_fixed && (pos > 0) && (pos > offset_type(p_size) - base)
+        )) {
+            throw stream_error{EINVAL, std::generic_category()};
+        }
+        p_pos = std::size_t(base + pos);
+        p_eof = false;
+    }
+
+    /** @brief Tells the current position in the stream. */
+    offset_type tell() const {
+        return offset_type(p_pos);
+    }
+
+    /** @brief Reads at most `count` bytes.
+     *
+     * Fewer bytes are read only at the end of the stream.
+     */
+    std::size_t read_bytes(void *buf, std::size_t count) {
+        std::size_t avail = (p_pos < p_size) ? (p_size - p_pos) : 0;
+        if (count > avail) {
+            count = avail;
+            p_eof = true;
+        }
+        if (count) {
+            std::memcpy(buf, p_data + p_pos, count);
+            p_pos += count;
+        }
+        return count;
+    }
+
+    /** @brief Writes `count` bytes at the current position.
+     *
+     * A growable stream grows as needed.
+     *
+     * @throws ostd::stream_error with EINVAL for read-only streams and
+     *         ENOSPC when a fixed buffer is too small.
+     */
+    void write_bytes(void const *buf, std::size_t count) {
+        auto *p = reserve_write(count);
+        if (count) {
+            std::memcpy(p, buf, count);
+        }
+    }
+
+    /** @brief Reads a single byte.
+     *
+     * @throws ostd::stream_error with EIO at the end of the stream.
+     */
+    int get_char() {
+        if (p_pos >= p_size) {
+            p_eof = true;
+            throw stream_error{EIO, std::generic_category()};
+        }
+        return p_data[p_pos++];
+    }
+
+    /** @brief Writes a single byte, like write_bytes(). */
+    void put_char(int c) {
+        *reserve_write(1) = static_cast<unsigned char>(c);
+    }
+
+    /** @brief Gets a pointer to the contents.
+     *
+     * The pointer is invalidated by writes into growable streams.
+     */
+    unsigned char const *data() const noexcept {
+        return p_data;
+    }
+
+    /** @brief Gets the whole contents as a string slice.
+     *
+     * The slice is invalidated by writes into growable streams.
+     */
+    string_range str() const noexcept {
+        auto *p = reinterpret_cast<char const *>(p_data);
+        return string_range{p, p + p_size};
+    }
+
+    /** @brief Takes the contents of a growable stream.
+     *
+     * The stream is left empty. For fixed streams, this returns a copy.
+     */
+    std::vector<unsigned char> release() {
+        std::vector<unsigned char> ret;
+        if (p_fixed) {
+            ret.assign(p_data, p_data + p_size);
+        } else {
+            ret = std::move(p_vec);
+        }
+        close();
+        return ret;
+    }
+
+private:
+    unsigned char *reserve_write(std::size_t count) {
+        if (p_rdonly) {
+            throw stream_error{EINVAL, std::generic_category()};
+        }
+        std::size_t need = p_pos + count;
+        if (need > p_size) {
+            if (p_fixed || (need < p_pos)) {
+                throw stream_error{ENOSPC, std::generic_category()};
+            }
+            /* amortized growth, any gap is zero-filled */
+            p_vec.resize(need);
+            p_data = p_vec.data();
+            p_size = need;
+        }
+        auto *ret = p_data + p_pos;
+        p_pos = need;
+        return ret;
+    }
+
+    std::vector<unsigned char> p_vec;
+    unsigned char *p_data = nullptr;
+    std::size_t p_size = 0;
+    std::size_t p_pos = 0;
+    bool p_fixed = false;
+    bool p_rdonly = false;
+    bool p_eof = false;
+};
+
+/** @brief A bounded lock-free byte queue between two threads.
+ *
+ * A ring stream is written into by exactly one producer thread and read
+ * from by exactly one consumer thread. No locks are involved; a side that
+ * cannot make progress yields its thread until it can.
+ *
+ * The write_bytes() method blocks until all the data have been queued and
+ * the read_bytes() method blocks until the requested amount is available or
+ * the producer has called close(). Non-blocking variants are also provided.
+ * The stream is not seekable.
+ */
+struct ring_stream: stream {
+    /** @brief Creates a ring stream.
+     *
+     * The capacity is rounded up to a power of two.
+     */
+    ring_stream(std::size_t capacity = 64 * 1024) {
+        std::size_t cap = 1;
+        while (cap < capacity) {
+            cap <<= 1;
+        }
+        p_mask = cap - 1;
+        p_buf = std::make_unique<unsigned char[]>(cap);
+    }
+
+    ring_stream(ring_stream const &) = delete;
+    ring_stream &operator=(ring_stream const &) = delete;
+
+    /** @brief Gets the capacity in bytes. */
+    std::size_t capacity() const noexcept {
+        return p_mask + 1;
+    }
+
+    /** @brief Ends the stream, called by the producer.
+     *
+     * Data queued before closing can still be read. Writing afterwards
+     * fails with EPIPE.
+     */
+    void close() {
+        p_closed.store(true, std::memory_order_release);
+    }
+
+    /** @brief Checks if the stream is closed and all data have been read.
+     *
+     * Called by the consumer.
+     */
+    bool end() const {
+        /* check the flag first, so that no write can slip in between */
+        if (!p_closed.load(std::memory_order_acquire)) {
+            return false;
+        }
+        return p_head.load(std::memory_order_acquire) == p_rtail;
+    }
+
+    /** @brief Reads as much as is available, up to `count` bytes.
+     *
+     * Never blocks. Called by the consumer.
+     *
+     * @returns The number of bytes read.
+     */
+    std::size_t try_read_bytes(void *buf, std::size_t count) {
+        std::size_t tail = p_rtail;
+        std::size_t avail = p_rhead - tail;
+        if (avail < count) {
+            p_rhead = p_head.load(std::memory_order_acquire);
+            avail = p_rhead - tail;
+        }
+        count = std::min(count, avail);
+        copy_out(static_cast<unsigned char *>(buf), tail, count);
+        p_rtail = tail + count;
+        p_tail.store(p_rtail, std::memory_order_release);
+        return count;
+    }
+
+    /** @brief Queues as much as fits, up to `count` bytes.
+     *
+     * Never blocks. Called by the producer.
+     *
+     * @returns The number of bytes written.
+     *
+     * @throws ostd::stream_error with EPIPE after close().
+     */
+    std::size_t try_write_bytes(void const *buf, std::size_t count) {
+        if (p_closed.load(std::memory_order_relaxed)) {
+            throw stream_error{EPIPE, std::generic_category()};
+        }
+        std::size_t head = p_whead;
+        std::size_t space = capacity() - (head - p_wtail);
+        if (space < count) {
+            p_wtail = p_tail.load(std::memory_order_acquire);
+            space = capacity() - (head - p_wtail);
+        }
+        count = std::min(count, space);
+        copy_in(static_cast<unsigned char const *>(buf), head, count);
+        p_whead = head + count;
+        p_head.store(p_whead, std::memory_order_release);
+        return count;
+    }
+
+    /** @brief Reads `count` bytes, waiting for the producer as needed.
+     *
+     * Fewer bytes are read only when the stream has been closed.
+     * Called by the consumer.
+     */
+    std::size_t read_bytes(void *buf, std::size_t count) {
+        auto *p = static_cast<unsigned char *>(buf);
+        std::size_t nread = 0;
+        for (;;) {
+            nread += try_read_bytes(p + nread, count - nread);
+            if ((nread == count) || end()) {
+                return nread;
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    /** @brief Writes `count` bytes, waiting for the consumer as needed.
+     *
+     * Called by the producer.
+     *
+     * @throws ostd::stream_error with EPIPE after close().
+     */
+    void write_bytes(void const *buf, std::size_t count) {
+        auto *p = static_cast<unsigned char const *>(buf);
+        for (;;) {
+            std::size_t n = try_write_bytes(p, count);
+            p += n;
+            count -= n;
+            if (!count) {
+                return;
+            }
+            std::this_thread::yield();
+        }
+    }
+
+private:
+    /* the indexes only ever increase and are masked on access */
+    void copy_out(unsigned char *dst, std::size_t idx, std::size_t n) {
+        std::size_t off = idx & p_mask;
+        std::size_t n1 = std::min(n, capacity() - off);
+        std::memcpy(dst, &p_buf[off], n1);
+        std::memcpy(dst + n1, &p_buf[0], n - n1);
+    }
+
+    void copy_in(unsigned char const *src, std::size_t idx, std::size_t n) {
+        std::size_t off = idx & p_mask;
+        std::size_t n1 = std::min(n, capacity() - off);
+        std::memcpy(&p_buf[off], src, n1);
+        std::memcpy(&p_buf[0], src + n1, n - n1);
+    }
+
+    std::unique_ptr<unsigned char[]> p_buf;
+    std::size_t p_mask;
+    std::atomic<bool> p_closed{false};
+    /* the shared indexes, each on its own cache line */
+    alignas(64) std::atomic<std::size_t> p_head{0};
+    alignas(64) std::atomic<std::size_t> p_tail{0};
+    /* producer side: own head and the last seen tail */
+    alignas(64) std::size_t p_whead = 0;
+    std::size_t p_wtail = 0;
+    /* consumer side: own tail and the last seen head */
+    alignas(64) std::size_t p_rtail = 0;
+    std::size_t p_rhead = 0;
+};
+
+/** @} */
+
+} /* namespace ostd */
+
+#endif
+
+/** @} */
@@ -0,0 +1,302 @@
+/** @addtogroup Concurrency
+ * @{
+ */
+
+/** @file mutex.hh
+ *
+ * @brief Scheduler-aware mutexes and condition variables.
+ *
+ * This file implements a mutex and a condition variable that cooperate
+ * with libostd's schedulers. When used with plain OS threads, they're
+ * lightweight futex-style primitives with adaptive spinning. When created
+ * for a coroutine based scheduler, a contended lock parks the task instead
+ * of blocking the whole worker thread, and resumes it on unlock.
+ *
+ * @copyright See COPYING.md in the project tree for further information.
+ */
+
+#ifndef OSTD_MUTEX_HH
+#define OSTD_MUTEX_HH
+
+#include <climits>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+
+#include <ostd/platform.hh>
+#include <ostd/generic_condvar.hh>
+
+namespace ostd {
+
+/** @addtogroup Concurrency
+ * @{
+ */
+
+namespace detail {
+    /* block while *addr == val, may wake up spuriously */
+    OSTD_EXPORT void futex_wait(std::atomic<int> *addr, int val) noexcept;
+    /* like futex_wait, but gives up once the deadline is reached */
+    OSTD_EXPORT void futex_wait_until(
+        std::atomic<int> *addr, int val,
+        std::chrono::steady_clock::time_point tp
+    ) noexcept;
+    /* wake up at most n threads blocked on addr */
+    OSTD_EXPORT void futex_wake(std::atomic<int> *addr, int n) noexcept;
+
+    inline void cpu_relax() noexcept {
+#if defined(OSTD_TOOLCHAIN_GNU) && (defined(__i386__) || defined(__x86_64__))
+        __builtin_ia32_pause();
+#elif defined(OSTD_TOOLCHAIN_GNU) && defined(__aarch64__)
+        __asm__ __volatile__("yield");
+#endif
+    }
+
+    /* upper bound for the adaptive spin before going to sleep */
+    constexpr int MUTEX_MAX_SPIN = 100;
+}
+
+/** @brief A scheduler-aware mutex.
+ *
+ * The lock state is a single atomic word, so an uncontended lock and unlock
+ * is just one atomic operation each. On contention, the locking thread first
+ * spins for a while; the amount of spinning adapts to how long it previously
+ * took to get the lock. If that fails, it goes to sleep.
+ *
+ * How it sleeps depends on how the mutex was constructed. A default
+ * constructed mutex blocks the OS thread using a futex (or an emulation
+ * of it on systems that don't have one). A mutex constructed using a
+ * condition variable from a scheduler (see scheduler::make_mutex())
+ * parks the current task in that scheduler, leaving the OS thread free
+ * to run other tasks. If the scheduler's condvar is a plain
+ * std::condition_variable, the futex path is used anyway.
+ *
+ * Mutexes are neither copyable nor movable. It satisfies the standard
+ * Lockable requirements, so it can be used with std::lock_guard and
+ * std::unique_lock.
+ */
+struct mutex {
+    /** @brief Constructs a mutex for use with OS threads. */
+    mutex() {}
+
+    /** @brief Constructs a mutex using a custom condition variable.
+     *
+     * Just like with channels, the function is called to get the condvar,
+     * as it's not required to be copyable or movable. Typically this is
+     * used by scheduler::make_mutex() and you will not need to use it.
+     *
+     * @param[in] func A function that returns an ostd::generic_condvar.
+     */
+    template<typename F>
+    mutex(F func): p_cond(func()), p_native(p_cond.native()) {}
+
+    mutex(mutex const &) = delete;
+    mutex(mutex &&) = delete;
+    mutex &operator=(mutex const &) = delete;
+    mutex &operator=(mutex &&) = delete;
+
+    /** @brief Locks the mutex, waiting if necessary. */
+    void lock() {
+        if (try_lock()) {
+            return;
+        }
+        int maxs = std::min(
+            2 * p_spin.load(std::memory_order_relaxed) + 10,
+            detail::MUTEX_MAX_SPIN
+        );
+        for (int i = 0; i < maxs; ++i) {
+            detail::cpu_relax();
+            if (!p_state.load(std::memory_order_relaxed) && try_lock()) {
+                /* running average of the spins needed */
+                int sp = p_spin.load(std::memory_order_relaxed);
+                p_spin.store(sp + (i - sp) / 8, std::memory_order_relaxed);
+                return;
+            }
+        }
+        lock_slow();
+    }
+
+    /** @brief Attempts to lock the mutex without waiting.
+     *
+     * @returns `true` if the lock was acquired, `false` otherwise.
+     */
+    bool try_lock() noexcept {
+        int c = 0;
+        return p_state.compare_exchange_strong(
+            c, 1, std::memory_order_acquire, std::memory_order_relaxed
+        );
+    }
+
+    /** @brief Unlocks the mutex, waking up one waiter if any. */
+    void unlock() {
+        if (p_state.exchange(0, std::memory_order_release) != 2) {
+            return;
+        }
+        if (p_native) {
+            detail::futex_wake(&p_state, 1);
+        } else {
+            /* the waiter holds the guard until it's fully parked */
+            { std::lock_guard<std::mutex> l{p_guard}; }
+            p_cond.notify_one();
+        }
+    }
+
+private:
+    /* the state is 0 when unlocked, 1 when locked and 2 when locked
+     * with possible waiters, so we know when we need to wake someone
+     */
+    void lock_slow() {
+        if (p_native) {
+            while (p_state.exchange(2, std::memory_order_acquire)) {
+                detail::futex_wait(&p_state, 2);
+            }
+            return;
+        }
+        std::unique_lock<std::mutex> l{p_guard};
+        while (p_state.exchange(2, std::memory_order_acquire)) {
+            p_cond.wait(l);
+        }
+    }
+
+    std::atomic<int> p_state{0};
+    std::atomic<int> p_spin{0};
+    std::mutex p_guard;
+    generic_condvar p_cond;
+    bool p_native = true;
+};
+
+/** @brief A scheduler-aware condition variable for ostd::mutex.
+ *
+ * Like ostd::mutex, a default constructed condition blocks OS threads using
+ * a futex, while one constructed using a scheduler's condvar (see
+ * scheduler::make_condvar()) parks the current task in the scheduler.
+ *
+ * Waiting can wake up spuriously, so always wait in a loop.
+ */
+struct condition {
+    /** @brief Constructs a condition for use with OS threads. */
+    condition() {}
+
+    /** @brief Constructs a condition using a custom condition variable.
+     *
+     * @param[in] func A function that returns an ostd::generic_condvar.
+     */
+    template<typename F>
+    condition(F func): p_cond(func()), p_native(p_cond.native()) {}
+
+    condition(condition const &) = delete;
+    condition(condition &&) = delete;
+    condition &operator=(condition const &) = delete;
+    condition &operator=(condition &&) = delete;
+
+    /** @brief Blocks the current thread or task until notified.
+     *
+     * Atomically releases the lock and waits. The lock is re-acquired
+     * before returning.
+     */
+    void wait(std::unique_lock<mutex> &l) {
+        if (p_native) {
+            int seq = p_seq.load();
+            p_waiters.fetch_add(1);
+            l.unlock();
+            detail::futex_wait(&p_seq, seq);
+            p_waiters.fetch_sub(1, std::memory_order_relaxed);
+            l.lock();
+            return;
+        }
+        std::unique_lock<std::mutex> gl{p_guard};
+        l.unlock();
+        p_cond.wait(gl);
+        gl.unlock();
+        l.lock();
+    }
+
+    /** @brief Blocks the current thread or task until notified or a deadline.
+     *
+     * Like wait(), but also stops waiting once the time point is reached.
+     * With a scheduler's condvar, the task is parked in the scheduler until
+     * either happens, without blocking the worker thread.
+     *
+     * @returns `std::cv_status::timeout` if the deadline was reached.
+     */
+    std::cv_status wait_until(
+        std::unique_lock<mutex> &l, std::chrono::steady_clock::time_point tp
+    ) {
+        if (p_native) {
+            int seq = p_seq.load();
+            p_waiters.fetch_add(1);
+            l.unlock();
+            detail::futex_wait_until(&p_seq, seq, tp);
+            p_waiters.fetch_sub(1, std::memory_order_relaxed);
+            l.lock();
+            if (std::chrono::steady_clock::now() >= tp) {
+                return std::cv_status::timeout;
+            }
+            return std::cv_status::no_timeout;
+        }
+        std::unique_lock<std::mutex> gl{p_guard};
+        l.unlock();
+        auto ret = p_cond.wait_until(gl, tp);
+        gl.unlock();
+        l.lock();
+        return ret;
+    }
+
+    /** @brief Blocks the current thread or task until notified or a timeout.
+     *
+     * Same as wait_until() with the deadline being now plus `d`.
+     */
+    template<typename Rep, typename Period>
+    std::cv_status wait_for(
+        std::unique_lock<mutex> &l, std::chrono::duration<Rep, Period> const &d
+    ) {
+        using sd = std::chrono::steady_clock::duration;
+        return wait_until(
+            l, std::chrono::steady_clock::now() + std::chrono::ceil<sd>(d)
+        );
+    }
+
+    /** @brief Wakes up at most one waiter. */
+    void notify_one() {
+        if (p_native) {
+            /* skip the syscall when nobody is waiting */
+            p_seq.fetch_add(1);
+            if (p_waiters.load()) {
+                detail::futex_wake(&p_seq, 1);
+            }
+            return;
+        }
+        { std::lock_guard<std::mutex> l{p_guard}; }
+        p_cond.notify_one();
+    }
+
+    /** @brief Wakes up all waiters. */
+    void notify_all() {
+        if (p_native) {
+            /* skip the syscall when nobody is waiting */
+            p_seq.fetch_add(1);
+            if (p_waiters.load()) {
+                detail::futex_wake(&p_seq, INT_MAX);
+            }
+            return;
+        }
+        { std::lock_guard<std::mutex> l{p_guard}; }
+        p_cond.notify_all();
+    }
+
+private:
+    std::atomic<int> p_seq{0};
+    std::atomic<int> p_waiters{0};
+    std::mutex p_guard;
+    generic_condvar p_cond;
+    bool p_native = true;
+};
+
+/** @} */
+
+} /* namespace ostd */
+
+#endif
+
+/** @} */
@@ -0,0 +1,195 @@
+/** @addtogroup Strings
+ * @{
+ */
+
+/** @file parse.hh
+ *
+ * @brief APIs for parsing numbers out of strings and streams.
+ *
+ * This is the counterpart of the formatting system for numbers. It reads
+ * integers and floating point values directly out of string slices, with
+ * no allocation and no null terminator needed. Failures are reported using
+ * the result value rather than exceptions, so it's suitable for ingesting
+ * large amounts of textual numeric data.
+ *
+ * ~~~{.cc}
+ * ostd::string_range s = "42 3.5";
+ * auto i = ostd::parse<int>(s);     // i.value == 42, s == " 3.5"
+ * s = s.trim();
+ * auto d = ostd::parse<double>(s);  // d.value == 3.5, s is empty
+ * ~~~
+ *
+ * @copyright See COPYING.md in the project tree for further information.
+ */
+
+#ifndef OSTD_PARSE_HH
+#define OSTD_PARSE_HH
+
+#include <cstddef>
+#include <charconv>
+#include <system_error>
+#include <type_traits>
+
+#include <ostd/string.hh>
+#include <ostd/stream.hh>
+
+namespace ostd {
+
+/** @addtogroup Strings
+ * @{
+ */
+
+/** @brief The result of ostd::parse().
+ *
+ * The error is `std::errc{}` on success, `std::errc::invalid_argument`
+ * when there is no number to parse and `std::errc::result_out_of_range`
+ * when the number does not fit into the type. The value is only set on
+ * success; otherwise it's value-initialized.
+ */
+template<typename T>
+struct parse_result {
+    /** @brief The parsed value. */
+    T value{};
+    /** @brief The error, if any. */
+    std::errc error{};
+
+    /** @brief Checks if parsing succeeded. */
+    explicit operator bool() const noexcept {
+        return error == std::errc{};
+    }
+};
+
+namespace detail {
+    template<typename T, typename A>
+    inline parse_result<T> parse_num(string_range &input, A arg) noexcept {
+        parse_result<T> ret;
+        char const *beg = input.data();
+        char const *end = beg + input.size();
+        /* unlike std::from_chars, allow an explicit plus sign */
+        char const *nbeg = beg;
+        if (((end - beg) > 1) && (*beg == '+') && (beg[1] != '-')) {
+            ++nbeg;
+        }
+        auto r = std::from_chars(nbeg, end, ret.value, arg);
+        ret.error = r.ec;
+        if (r.ec == std::errc::invalid_argument) {
+            return ret;
+        }
+        input = string_range{r.ptr, end};
+        return ret;
+    }
+
+    inline bool parse_is_space(char c) noexcept {
+        return (c == ' ') || ((c >= '\t') && (c <= '\r'));
+    }
+
+    /* all characters that can possibly make up a number */
+    inline bool parse_is_num(char c) noexcept {
+        char lc = char(c | 32);
+        return ((c >= '0') && (c <= '9')) || ((lc >= 'a') && (lc <= 'z'))
+            || (c == '+') || (c == '-') || (c == '.');
+    }
+} /* namespace detail */
+
+/** @brief Parses an integer out of a string slice in the given base.
+ *
+ * Leading whitespace is not skipped. An optional sign is accepted, though
+ * a minus sign only for signed types. No base prefixes are accepted. The
+ * number is consumed from `input` unless there is no number at all, in
+ * which case `input` is left untouched.
+ *
+ * @see parse_result
+ */
+template<typename T>
+inline parse_result<T> parse(string_range &input, int base) noexcept {
+    static_assert(
+        std::is_integral_v<T> && !std::is_same_v<T, bool>,
+        "parsing with a base requires an integer type"
+    );
+    return detail::parse_num<T>(input, base);
+}
+
+/** @brief Parses a floating point value out of a string slice.
+ *
+ * The rules are those of `std::from_chars` with the given format, which
+ * means that infinities and NaNs are accepted, but hexadecimal values
+ * with a `0x` prefix are not. Otherwise it's like parse(string_range &, int).
+ *
+ * @see parse_result
+ */
+template<typename T>
+inline parse_result<T> parse(
+    string_range &input, std::chars_format fmt
+) noexcept {
+    static_assert(
+        std::is_floating_point_v<T>,
+        "parsing with a format requires a floating point type"
+    );
+    return detail::parse_num<T>(input, fmt);
+}
+
+/** @brief Parses a number out of a string slice.
+ *
+ * Integers are parsed in base 10 and floating point values in the general
+ * format, see parse(string_range &, int) and
+ * parse(string_range &, std::chars_format).
+ */
+template<typename T>
+inline parse_result<T> parse(string_range &input) noexcept {
+    if constexpr(std::is_floating_point_v<T>) {
+        return parse<T>(input, std::chars_format::general);
+    } else {
+        return parse<T>(input, 10);
+    }
+}
+
+/** @brief Parses a whitespace separated number out of a stream.
+ *
+ * The leading whitespace is skipped, then all characters that can make
+ * up a number are read and parsed with the other arguments passed as for
+ * the string slice version. The characters are consumed even if they do
+ * not form a number; in that case, or when the number is followed by any
+ * other characters, the error is `std::errc::invalid_argument`. Numbers
+ * longer than 128 characters result in `std::errc::result_out_of_range`.
+ *
+ * The character following the number stays cached in the range.
+ *
+ * @throws ostd::stream_error when reading from the stream fails.
+ */
+template<typename T, typename ...A>
+inline parse_result<T> parse(stream_range<char> &input, A const &...args) {
+    char buf[128];
+    std::size_t n = 0;
+    bool toolong = false;
+    while (!input.empty() && detail::parse_is_space(input.front())) {
+        input.pop_front();
+    }
+    while (!input.empty() && detail::parse_is_num(input.front())) {
+        if (n < sizeof(buf)) {
+            buf[n++] = input.front();
+        } else {
+            toolong = true;
+        }
+        input.pop_front();
+    }
+    parse_result<T> ret;
+    if (toolong) {
+        ret.error = std::errc::result_out_of_range;
+        return ret;
+    }
+    string_range s{buf, buf + n};
+    ret = parse<T>(s, args...);
+    if (ret && !s.empty()) {
+        ret = parse_result<T>{};
+        ret.error = std::errc::invalid_argument;
+    }
+    return ret;
+}
+
+/** @} */
+
+} /* namespace ostd */
+
+#endif
+
+/** @} */
@@ -785,6 +785,86 @@ inline range_size_t<IR> range_pop_back_n(IR &range, range_size_t<IR> n) {
     }
 }
 
+namespace detail {
+    /* a callable only used for detecting the traverse member */
+    struct range_traverse_probe {
+        template<typename T>
+        bool operator()(T &&) const { return true; }
+    };
+
+    template<typename R>
+    inline auto test_range_traverse(int) -> std::is_same<decltype(
+        std::declval<R const &>().traverse(
+            std::declval<range_traverse_probe &>()
+        )
+    ), bool>;
+
+    template<typename>
+    inline std::false_type test_range_traverse(...);
+
+    template<typename R>
+    static inline constexpr bool const range_has_traverse =
+        decltype(test_range_traverse<R>(0))::value;
+
+    /* the element by element fallback, usable from traverse members */
+    template<typename IR, typename F>
+    inline bool range_traverse_loop(IR range, F &func) {
+        for (; !range.empty(); range.pop_front()) {
+            if (!func(range.front())) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+/** @brief Calls `func` on each element of `range` until it returns false.
+ *
+ * This is the internal iteration protocol used by the algorithms which
+ * consume a whole range, such as ostd::for_each(), ostd::foldl() or
+ * ostd::copy(). The `func` is called like `func(range.front())` for each
+ * element, in order, and is expected to return `true` to continue or
+ * `false` to stop. The `range` itself is not modified.
+ *
+ * Calling `empty()`, `front()` and `pop_front()` for every element is
+ * expensive with long chains of wrapper ranges, as every wrapper needs
+ * to forward these to the range it wraps. Therefore, a range type can
+ * provide a member function to iterate itself with a callback:
+ *
+ * ~~~{.cc}
+ * template<typename F>
+ * bool traverse(F &func) const;
+ * ~~~
+ *
+ * It returns `false` if `func` stopped the iteration and `true` otherwise.
+ * When present, it is used. Wrapper ranges implement it by traversing the
+ * wrapped range with their own callback, so the whole chain turns into
+ * a single loop over the innermost range. When not present, contiguous
+ * ranges are iterated as a block of memory and other ranges use the
+ * `empty()`, `front()` and `pop_front()` loop.
+ *
+ * @returns `false` if `func` stopped the iteration, `true` otherwise.
+ */
+template<typename IR, typename F>
+inline bool range_traverse(IR const &range, F &&func) {
+    if constexpr(detail::range_has_traverse<IR>) {
+        return range.traverse(func);
+    } else if constexpr(is_contiguous_range<IR>) {
+        if (range.empty()) {
+            return true;
+        }
+        auto *p = &range.front();
+        for (auto *e = p + range.size(); p != e; ++p) {
+            if (!func(*p)) {
+                return false;
+            }
+        }
+        return true;
+    } else {
+        return detail::range_traverse_loop(range, func);
+    }
+}
+
 /** @brief A base type for all input-type ranges to derive from.
  *
  * Every input range type derives from this, see [Ranges](@ref ranges).
@@ -1038,15 +1118,17 @@ struct output_range {
 /** @brief Puts all of `range`'s elements into `orange`.
  *
  * The default implementation is equivalent to iterating `range` and then
- * calling `orange.put(range.front())` on each, but it can be overloaded
+ * calling `orange.put(range.front())` on each (using ostd::range_traverse()
+ * to do the iteration), but it can be overloaded
  * with more efficient implementations per type. Usages of this in generic
  * algortihms follow ADL, so the right function will always be resolved.
  */
 template<typename OR, typename IR>
 inline void range_put_all(OR &orange, IR range) {
-    for (; !range.empty(); range.pop_front()) {
-        orange.put(range.front());
-    }
+    range_traverse(range, [&orange](auto &&v) {
+        orange.put(std::forward<decltype(v)>(v));
+        return true;
+    });
 }
 
 namespace detail {
@@ -1536,6 +1618,30 @@ namespace detail {
         }
 
         reference front() const { return p_range.front(); }
+
+        template<typename F>
+        bool traverse(F &func) const {
+            if constexpr(is_finite_random_access_range<T>) {
+                size_type n = p_range.size();
+                if (p_remaining < n) {
+                    n = size_type(p_remaining);
+                }
+                return range_traverse(p_range.slice(0, n), func);
+            } else {
+                std::size_t n = p_remaining;
+                bool stopped = false;
+                if (n) {
+                    range_traverse(p_range, [&func, &n, &stopped](auto &&v) {
+                        if (!func(std::forward<decltype(v)>(v))) {
+                            stopped = true;
+                            return false;
+                        }
+                        return --n != 0;
+                    });
+                }
+                return !stopped;
+            }
+        }
     };
 
     template<typename T>
@@ -1567,27 +1673,39 @@ namespace detail {
         reference front() const { return p_range.take(p_chunksize); }
     };
 
+    /* the first non-empty range at or after cur, N if there is none */
+    template<std::size_t I, std::size_t N, typename T>
+    inline std::size_t join_range_next(T const &tup, std::size_t cur) {
+        if constexpr(I != N) {
+            if ((I >= cur) && !std::get<I>(tup).empty()) {
+                return I;
+            }
+            return join_range_next<I + 1, N>(tup, cur);
+        }
+        return N;
+    }
+
     template<std::size_t I, std::size_t N, typename T>
-    inline void join_range_pop(T &tup) {
+    inline void join_range_pop(T &tup, std::size_t cur) {
         if constexpr(I != N) {
-            if (!std::get<I>(tup).empty()) {
+            if (I == cur) {
                 std::get<I>(tup).pop_front();
                 return;
             }
-            join_range_pop<I + 1, N>(tup);
+            join_range_pop<I + 1, N>(tup, cur);
         }
     }
 
-    template<std::size_t I, std::size_t N, typename T>
-    inline auto join_range_front(T &tup) {
+    template<typename R, std::size_t I, std::size_t N, typename T>
+    inline R join_range_front(T const &tup, std::size_t cur) {
         if constexpr(I != N) {
-            if (!std::get<I>(tup).empty()) {
-                return std::get<I>(tup).front();
+            if (I == cur) {
+                return R(std::get<I>(tup).front());
             }
-            return join_range_front<I + 1, N>(tup);
+            return join_range_front<R, I + 1, N>(tup, cur);
         }
         /* fallback, will probably throw */
-        return std::get<0>(tup).front();
+        return R(std::get<0>(tup).front());
     }
 
     template<typename ...R>
@@ -1601,24 +1719,43 @@ namespace detail {
 
     private:
         std::tuple<R...> p_ranges;
+        /* the range the front is in, so that we don't look at the others */
+        std::size_t p_cur;
 
     public:
         join_range() = delete;
 
-        join_range(R const &...ranges): p_ranges(ranges...) {}
+        join_range(R const &...ranges):
+            p_ranges(ranges...),
+            p_cur(join_range_next<0, sizeof...(R)>(p_ranges, 0))
+        {}
 
         bool empty() const {
-            return std::apply([](auto const &...args) {
-                return (... && args.empty());
-            }, p_ranges);
+            return p_cur == sizeof...(R);
         }
 
         void pop_front() {
-            join_range_pop<0, sizeof...(R)>(p_ranges);
+            join_range_pop<0, sizeof...(R)>(p_ranges, p_cur);
+            p_cur = join_range_next<0, sizeof...(R)>(p_ranges, p_cur);
         }
 
         reference front() const {
-            return join_range_front<0, sizeof...(R)>(p_ranges);
+            return join_range_front<reference, 0, sizeof...(R)>(
+                p_ranges, p_cur
+            );
+        }
+
+        template<typename F>
+        bool traverse(F &func) const {
+            /* the ranges before the current one are all empty */
+            auto conv = [&func](auto &&v) {
+                return func(
+                    static_cast<reference>(std::forward<decltype(v)>(v))
+                );
+            };
+            return std::apply([&conv](auto const &...args) {
+                return (... && range_traverse(args, conv));
+            }, p_ranges);
         }
     };
 
@@ -1669,6 +1806,24 @@ namespace detail {
                 return reference{args.front()...};
             }, p_ranges);
         }
+
+        template<typename F>
+        bool traverse(F &func) const {
+            if constexpr((... && is_finite_random_access_range<R>)) {
+                /* index all the ranges at once, which avoids the pops */
+                return std::apply([&func](auto const &...args) {
+                    size_type n = std::min({size_type(args.size())...});
+                    for (size_type i = 0; i < n; ++i) {
+                        if (!func(reference{args[i]...})) {
+                            return false;
+                        }
+                    }
+                    return true;
+                }, p_ranges);
+            } else {
+                return range_traverse_loop(*this, func);
+            }
+        }
     };
 
     template<typename T>
@@ -1716,6 +1871,41 @@ namespace detail {
     private:
         T p_data;
     };
+
+    template<typename T, typename P>
+    inline auto appender_insert_test(int) -> typename std::is_same<decltype(
+        std::declval<T &>().insert(
+            std::declval<T &>().end(), std::declval<P>(), std::declval<P>()
+        )
+    ), typename T::iterator>::type;
+
+    template<typename, typename>
+    inline std::false_type appender_insert_test(...);
+
+    template<typename T, typename IR, bool = is_contiguous_range<IR>>
+    static inline constexpr bool const appender_can_insert = false;
+
+    template<typename T, typename IR>
+    static inline constexpr bool const appender_can_insert<T, IR, true> =
+        std::is_same_v<
+            std::remove_const_t<range_value_t<IR>>, typename T::value_type
+        > && decltype(appender_insert_test<
+            T, decltype(std::declval<IR &>().data())
+        >(0))::value;
+
+    /* containers with a range insert take contiguous ranges all at once */
+    template<typename T, typename IR>
+    inline void range_put_all(appender_range<T> &orange, IR range) {
+        if constexpr(appender_can_insert<T, IR>) {
+            auto &c = orange.get();
+            c.insert(c.end(), range.data(), range.data() + range.size());
+        } else {
+            range_traverse(range, [&orange](auto &&v) {
+                orange.put(std::forward<decltype(v)>(v));
+                return true;
+            });
+        }
+    }
 } /* namespace detail */
 
 /** @brief Creates am appender output range for a container.
@@ -2043,6 +2233,33 @@ namespace detail {
     };
 }
 
+namespace detail {
+    template<typename C, typename R>
+    inline auto test_push_back(int) -> decltype(
+        std::declval<C &>().push_back(std::declval<range_reference_t<R>>()),
+        std::true_type{}
+    );
+
+    template<typename, typename>
+    inline std::false_type test_push_back(...);
+
+    template<typename C, typename R>
+    static inline constexpr bool const can_push_back =
+        decltype(test_push_back<C, R>(0))::value;
+
+    template<typename C>
+    inline auto test_reserve(int) -> decltype(
+        std::declval<C &>().reserve(std::size_t(0)), std::true_type{}
+    );
+
+    template<typename>
+    inline std::false_type test_reserve(...);
+
+    template<typename C>
+    static inline constexpr bool const can_reserve =
+        decltype(test_reserve<C>(0))::value;
+}
+
 /** @brief Creates a `Container` from `range`.
  *
  * Standard sequence containers usually support construction from an
@@ -2051,12 +2268,41 @@ namespace detail {
  * and `iter_end()` methods.
  *
  * The remaining arguments are passed after the two iterators.
+ *
+ * Contiguous ranges are passed as a pair of pointers instead. Ranges that
+ * implement traversal (see ostd::range_traverse()) are traversed and each
+ * element is `push_back`ed into the container when that is possible and
+ * there are no extra arguments, reserving the space first for finite
+ * random access ranges.
  */
 template<typename Container, typename InputRange, typename ...Args>
 inline Container from_range(InputRange range, Args &&...args) {
-    return Container(
-        range.iter_begin(), range.iter_end(), std::forward<Args>(args)...
-    );
+    if constexpr(is_contiguous_range<InputRange>) {
+        auto *p = range.empty() ? nullptr : &range.front();
+        return Container(
+            p, p + range.size(), std::forward<Args>(args)...
+        );
+    } else if constexpr(
+        !sizeof...(Args) && detail::range_has_traverse<InputRange> &&
+        detail::can_push_back<Container, InputRange>
+    ) {
+        Container ret;
+        if constexpr(
+            is_finite_random_access_range<InputRange> &&
+            detail::can_reserve<Container>
+        ) {
+            ret.reserve(range.size());
+        }
+        range_traverse(range, [&ret](auto &&v) {
+            ret.push_back(std::forward<decltype(v)>(v));
+            return true;
+        });
+        return ret;
+    } else {
+        return Container(
+            range.iter_begin(), range.iter_end(), std::forward<Args>(args)...
+        );
+    }
 }
 
 /** @} */
@@ -0,0 +1,338 @@
+/** @addtogroup Concurrency
+ * @{
+ */
+
+/** @file scheduler_stats.hh
+ *
+ * @brief Statistics for schedulers and thread pools.
+ *
+ * This file provides the counters that ostd::basic_coroutine_scheduler and
+ * ostd::thread_pool keep about their workers, as well as the snapshot types
+ * used to read them. Every worker has its own set of counters, which only
+ * it writes into, so collecting them is cheap.
+ *
+ * Collection is only enabled when libostd is built with the `scheduler-stats`
+ * option, which defines `OSTD_SCHEDULER_STATS`. Otherwise all collection
+ * compiles to nothing and the snapshots are always empty.
+ *
+ * @copyright See COPYING.md in the project tree for further information.
+ */
+
+#ifndef OSTD_SCHEDULER_STATS_HH
+#define OSTD_SCHEDULER_STATS_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include <ostd/platform.hh>
+#include <ostd/format.hh>
+
+namespace ostd {
+
+/** @addtogroup Concurrency
+ * @{
+ */
+
+/** @brief Whether scheduler statistics are collected. */
+#ifdef OSTD_SCHEDULER_STATS
+constexpr bool scheduler_stats_enabled = true;
+#else
+constexpr bool scheduler_stats_enabled = false;
+#endif
+
+/** @brief A histogram of latencies.
+ *
+ * The buckets are powers of two in nanoseconds; bucket `i` counts the
+ * latencies in the range `[2^(i-1), 2^i)`, with bucket 0 counting zero
+ * latencies and the last bucket counting everything that is bigger.
+ */
+struct latency_histogram {
+    /** @brief The number of buckets. */
+    static constexpr std::size_t size = 40;
+
+    /** @brief The counts in each bucket. */
+    std::array<std::uint64_t, size> buckets{};
+
+    /** @brief Gets the bucket index for a latency in nanoseconds. */
+    static std::size_t bucket_for(std::uint64_t ns) noexcept {
+        std::size_t ret = 0;
+        while (ns && (ret < (size - 1))) {
+            ns >>= 1;
+            ++ret;
+        }
+        return ret;
+    }
+
+    /** @brief Gets the total number of samples. */
+    std::uint64_t count() const noexcept {
+        std::uint64_t ret = 0;
+        for (auto n: buckets) {
+            ret += n;
+        }
+        return ret;
+    }
+
+    /** @brief Gets an upper bound for the given percentile in nanoseconds.
+     *
+     * The result is the upper bound of the bucket the percentile falls
+     * into. If there are no samples, the result is zero.
+     *
+     * @param[in] pct The percentile, between 0 and 100.
+     */
+    std::uint64_t percentile(double pct) const noexcept {
+        std::uint64_t total = count();
+        if (!total) {
+            return 0;
+        }
+        auto want = static_cast<std::uint64_t>(total * (pct / 100.0));
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < size; ++i) {
+            seen += buckets[i];
+            if (seen > want || (seen == total)) {
+                return std::uint64_t(1) << i;
+            }
+        }
+        return std::uint64_t(1) << (size - 1);
+    }
+
+    /** @brief Adds the samples of another histogram to this one. */
+    latency_histogram &operator+=(latency_histogram const &o) noexcept {
+        for (std::size_t i = 0; i < size; ++i) {
+            buckets[i] += o.buckets[i];
+        }
+        return *this;
+    }
+};
+
+/** @brief The statistics of a single worker thread. */
+struct worker_stats {
+    /** @brief The number of times a task was run or resumed. */
+    std::uint64_t tasks_run = 0;
+    /** @brief The number of times a task yielded back to the worker. */
+    std::uint64_t yields = 0;
+    /** @brief The number of tasks taken from another NUMA node's queue. */
+    std::uint64_t steals = 0;
+    /** @brief The time spent waiting for work, in nanoseconds. */
+    std::uint64_t idle_ns = 0;
+    /** @brief The time from queueing a task to its first run. */
+    latency_histogram queue_latency{};
+
+    /** @brief Adds the counters of another worker to this one. */
+    worker_stats &operator+=(worker_stats const &o) noexcept {
+        tasks_run += o.tasks_run;
+        yields += o.yields;
+        steals += o.steals;
+        idle_ns += o.idle_ns;
+        queue_latency += o.queue_latency;
+        return *this;
+    }
+};
+
+/** @brief A snapshot of scheduler or thread pool statistics.
+ *
+ * Retrieved using the `stats()` method of a scheduler or a thread pool.
+ * The counters are reset every time the workers are started.
+ */
+struct scheduler_stats {
+    /** @brief The statistics of each worker. */
+    std::vector<worker_stats> workers{};
+    /** @brief The run queue depth at the time of the snapshot. */
+    std::size_t queue_depth = 0;
+    /** @brief The biggest run queue depth seen. */
+    std::size_t max_queue_depth = 0;
+
+    /** @brief Gets the sum of all worker statistics. */
+    worker_stats total() const noexcept {
+        worker_stats ret;
+        for (auto &w: workers) {
+            ret += w;
+        }
+        return ret;
+    }
+};
+
+namespace detail {
+    inline std::uint64_t sched_now() noexcept {
+        return std::uint64_t(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()
+            ).count()
+        );
+    }
+
+    /* a timestamp of when a task was queued, empty without stats */
+    struct sched_stamp {
+#ifdef OSTD_SCHEDULER_STATS
+        std::uint64_t p_time = 0;
+#endif
+    };
+
+#ifdef OSTD_SCHEDULER_STATS
+    /* written only by the owning worker, so no read-modify-write needed */
+    struct alignas(64) worker_counters {
+        std::atomic<std::uint64_t> tasks_run{0};
+        std::atomic<std::uint64_t> yields{0};
+        std::atomic<std::uint64_t> steals{0};
+        std::atomic<std::uint64_t> idle_ns{0};
+        std::array<std::atomic<std::uint64_t>, latency_histogram::size> lat{};
+
+        static void bump(
+            std::atomic<std::uint64_t> &c, std::uint64_t n = 1
+        ) noexcept {
+            c.store(
+                c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed
+            );
+        }
+    };
+#endif
+
+    struct sched_stats {
+#ifdef OSTD_SCHEDULER_STATS
+        void reset(std::size_t nworkers) {
+            p_workers = std::make_unique<worker_counters[]>(nworkers);
+            p_nworkers.store(nworkers, std::memory_order_release);
+            p_depth.store(0, std::memory_order_relaxed);
+            p_max_depth.store(0, std::memory_order_relaxed);
+        }
+
+        static std::uint64_t now() noexcept {
+            return sched_now();
+        }
+
+        void queued(sched_stamp &st) noexcept {
+            st.p_time = now();
+        }
+
+        /* the depth is only updated with the queue lock held */
+        void depth(std::size_t n) noexcept {
+            p_depth.store(n, std::memory_order_relaxed);
+            if (n > p_max_depth.load(std::memory_order_relaxed)) {
+                p_max_depth.store(n, std::memory_order_relaxed);
+            }
+        }
+
+        void run(std::size_t w, sched_stamp &st) noexcept {
+            auto &c = p_workers[w];
+            worker_counters::bump(c.tasks_run);
+            if (st.p_time) {
+                std::uint64_t t = now();
+                std::uint64_t lat = (t > st.p_time) ? (t - st.p_time) : 0;
+                worker_counters::bump(
+                    c.lat[latency_histogram::bucket_for(lat)]
+                );
+                st.p_time = 0;
+            }
+        }
+
+        void yielded(std::size_t w) noexcept {
+            worker_counters::bump(p_workers[w].yields);
+        }
+
+        void stole(std::size_t w) noexcept {
+            worker_counters::bump(p_workers[w].steals);
+        }
+
+        void idle(std::size_t w, std::uint64_t since) noexcept {
+            worker_counters::bump(p_workers[w].idle_ns, now() - since);
+        }
+
+        scheduler_stats snapshot() const {
+            scheduler_stats ret;
+            std::size_t n = p_nworkers.load(std::memory_order_acquire);
+            ret.workers.resize(n);
+            for (std::size_t i = 0; i < n; ++i) {
+                auto &c = p_workers[i];
+                auto &w = ret.workers[i];
+                w.tasks_run = c.tasks_run.load(std::memory_order_relaxed);
+                w.yields = c.yields.load(std::memory_order_relaxed);
+                w.steals = c.steals.load(std::memory_order_relaxed);
+                w.idle_ns = c.idle_ns.load(std::memory_order_relaxed);
+                for (std::size_t j = 0; j < latency_histogram::size; ++j) {
+                    w.queue_latency.buckets[j] = c.lat[j].load(
+                        std::memory_order_relaxed
+                    );
+                }
+            }
+            ret.queue_depth = p_depth.load(std::memory_order_relaxed);
+            ret.max_queue_depth = p_max_depth.load(std::memory_order_relaxed);
+            return ret;
+        }
+
+    private:
+        std::unique_ptr<worker_counters[]> p_workers;
+        std::atomic<std::size_t> p_nworkers{0};
+        std::atomic<std::size_t> p_depth{0};
+        std::atomic<std::size_t> p_max_depth{0};
+#else
+        void reset(std::size_t) noexcept {}
+        static std::uint64_t now() noexcept { return 0; }
+        void queued(sched_stamp &) noexcept {}
+        void depth(std::size_t) noexcept {}
+        void run(std::size_t, sched_stamp &) noexcept {}
+        void yielded(std::size_t) noexcept {}
+        void stole(std::size_t) noexcept {}
+        void idle(std::size_t, std::uint64_t) noexcept {}
+
+        scheduler_stats snapshot() const {
+            return scheduler_stats{};
+        }
+#endif
+    };
+} /* namespace detail */
+
+/** @brief ostd::format_traits specialization for worker statistics.
+ *
+ * Formats the counters on a single line. The idle time is printed in
+ * microseconds and the latencies are the median and the 99th percentile.
+ */
+template<>
+struct format_traits<worker_stats> {
+    /** @brief Formats the statistics. */
+    template<typename R>
+    static void to_format(
+        worker_stats const &v, R &writer, format_spec const &
+    ) {
+        format(
+            writer, "run: %d, yields: %d, steals: %d, idle: %d us, "
+            "latency p50: <%d ns, p99: <%d ns",
+            v.tasks_run, v.yields, v.steals, v.idle_ns / 1000,
+            v.queue_latency.percentile(50), v.queue_latency.percentile(99)
+        );
+    }
+};
+
+/** @brief ostd::format_traits specialization for scheduler statistics.
+ *
+ * Formats the queue depths followed by one line per worker, as formatted
+ * by ostd::format_traits<worker_stats>, and one line with the totals.
+ */
+template<>
+struct format_traits<scheduler_stats> {
+    /** @brief Formats the statistics. */
+    template<typename R>
+    static void to_format(
+        scheduler_stats const &v, R &writer, format_spec const &
+    ) {
+        format(
+            writer, "queue depth: %d (max %d)\n",
+            v.queue_depth, v.max_queue_depth
+        );
+        for (std::size_t i = 0; i < v.workers.size(); ++i) {
+            format(writer, "worker %d: %s\n", i, v.workers[i]);
+        }
+        format(writer, "total: %s", v.total());
+    }
+};
+
+/** @} */
+
+} /* namespace ostd */
+
+#endif
+
+/** @} */
@@ -0,0 +1,712 @@
+/** @addtogroup Streams
+ * @{
+ */
+
+/** @file serialize.hh
+ *
+ * @brief Binary serialization on top of streams.
+ *
+ * This file implements a simple binary encoding for values written into
+ * and read from any ostd::stream. Arithmetic values are written with a
+ * fixed width in a selectable byte order, strings and containers are
+ * prefixed with their length encoded as a LEB128 varint, tuple-like
+ * values are written member by member and custom types can provide
+ * their own encoding by specializing ostd::serialize_traits.
+ *
+ * ~~~{.cc}
+ * ostd::binary_writer w{stream};
+ * w.put(42, 3.5, std::string{"hello"}, std::vector<int>{1, 2, 3});
+ * w.flush();
+ * ...
+ * ostd::binary_reader r{stream};
+ * int i; double d; std::string s; std::vector<int> v;
+ * r.get(i, d, s, v);
+ * ~~~
+ *
+ * Both the reader and the writer are buffered, so small values do not
+ * result in a stream call each. Contiguous containers of arithmetic
+ * values in the native byte order are transferred with a single call
+ * to ostd::stream::write_bytes() or ostd::stream::read_bytes().
+ *
+ * @copyright See COPYING.md in the project tree for further information.
+ */
+
+#ifndef OSTD_SERIALIZE_HH
+#define OSTD_SERIALIZE_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <limits>
+#include <utility>
+#include <tuple>
+#include <iterator>
+#include <algorithm>
+#include <type_traits>
+
+#include <ostd/platform.hh>
+#include <ostd/string.hh>
+#include <ostd/stream.hh>
+
+namespace ostd {
+
+/** @addtogroup Streams
+ * @{
+ */
+
+/** @brief The byte order to serialize arithmetic values in. */
+enum class byte_order {
+    LITTLE, ///< Least significant byte first.
+    BIG,    ///< Most significant byte first.
+    /** @brief The byte order of the system. */
+    NATIVE = (OSTD_BYTE_ORDER == OSTD_ENDIAN_LIL) ? LITTLE : BIG
+};
+
+struct binary_writer;
+struct binary_reader;
+
+/** @brief Specialize this to serialize custom objects.
+ *
+ * By default it's empty. To provide an encoding for your own type, you
+ * specialize it like this:
+ *
+ * ~~~{.cc}
+ * template<>
+ * struct serialize_traits<foo> {
+ *     static void serialize(ostd::binary_writer &w, foo const &v) {
+ *         w.put(v.a, v.b);
+ *     }
+ *     static void deserialize(ostd::binary_reader &r, foo &v) {
+ *         r.get(v.a, v.b);
+ *     }
+ * };
+ * ~~~
+ *
+ * Types with a specialization always use it, even if they'd otherwise
+ * be handled by the builtin rules. It's possible to only provide one of
+ * the functions if only one direction is needed.
+ */
+template<typename T>
+struct serialize_traits {};
+
+namespace detail {
+    template<typename T>
+    inline auto ser_writable_test(int) -> typename std::is_void<decltype(
+        serialize_traits<T>::serialize(
+            std::declval<binary_writer &>(), std::declval<T const &>()
+        )
+    )>::type;
+
+    template<typename>
+    inline std::false_type ser_writable_test(...);
+
+    template<typename T>
+    static inline constexpr bool ser_has_writer =
+        decltype(ser_writable_test<T>(0))::value;
+
+    template<typename T>
+    inline auto ser_readable_test(int) -> typename std::is_void<decltype(
+        serialize_traits<T>::deserialize(
+            std::declval<binary_reader &>(), std::declval<T &>()
+        )
+    )>::type;
+
+    template<typename>
+    inline std::false_type ser_readable_test(...);
+
+    template<typename T>
+    static inline constexpr bool ser_has_reader =
+        decltype(ser_readable_test<T>(0))::value;
+
+    /* anything with a size and iterators */
+    template<typename T>
+    inline auto ser_container_test(int) -> decltype(
+        std::declval<T const &>().size(),
+        std::begin(std::declval<T const &>()),
+        std::end(std::declval<T const &>()),
+        std::true_type{}
+    );
+
+    template<typename>
+    inline std::false_type ser_container_test(...);
+
+    template<typename T>
+    static inline constexpr bool ser_is_container =
+        decltype(ser_container_test<T>(0))::value;
+
+    /* containers with their elements in a single array */
+    template<typename T>
+    inline auto ser_contiguous_test(int) -> typename std::is_same<
+        std::remove_const_t<std::remove_pointer_t<
+            decltype(std::declval<T &>().data())
+        >>, typename T::value_type
+    >::type;
+
+    template<typename>
+    inline std::false_type ser_contiguous_test(...);
+
+    template<typename T>
+    static inline constexpr bool ser_is_contiguous =
+        decltype(ser_contiguous_test<T>(0))::value;
+
+    template<typename T>
+    inline auto ser_resize_test(int) -> decltype(
+        std::declval<T &>().resize(std::size_t(0)), std::true_type{}
+    );
+
+    template<typename>
+    inline std::false_type ser_resize_test(...);
+
+    template<typename T>
+    static inline constexpr bool ser_can_resize =
+        decltype(ser_resize_test<T>(0))::value;
+
+    template<typename T>
+    inline auto ser_push_back_test(int) -> decltype(
+        std::declval<T &>().push_back(
+            std::declval<typename T::value_type>()
+        ), std::true_type{}
+    );
+
+    template<typename>
+    inline std::false_type ser_push_back_test(...);
+
+    template<typename T>
+    static inline constexpr bool ser_can_push_back =
+        decltype(ser_push_back_test<T>(0))::value;
+
+    template<typename T>
+    inline auto ser_map_test(int) -> decltype(
+        std::declval<typename T::key_type>(),
+        std::declval<typename T::mapped_type>(),
+        std::true_type{}
+    );
+
+    template<typename>
+    inline std::false_type ser_map_test(...);
+
+    template<typename T>
+    static inline constexpr bool ser_is_map =
+        decltype(ser_map_test<T>(0))::value;
+
+    template<typename T>
+    inline auto ser_set_test(int) -> decltype(
+        std::declval<typename T::key_type>(), std::true_type{}
+    );
+
+    template<typename>
+    inline std::false_type ser_set_test(...);
+
+    template<typename T>
+    static inline constexpr bool ser_is_set =
+        decltype(ser_set_test<T>(0))::value && !ser_is_map<T>;
+
+    template<typename T>
+    inline auto ser_tuple_test(int) ->
+        typename std::is_integral<decltype(std::tuple_size<T>::value)>::type;
+
+    template<typename>
+    inline std::false_type ser_tuple_test(...);
+
+    template<typename T>
+    static inline constexpr bool ser_is_tuple =
+        decltype(ser_tuple_test<T>(0))::value;
+
+    /* values that can be copied into the stream as they are, as long
+     * as the byte order matches for arithmetic ones
+     */
+    template<typename T>
+    static inline constexpr bool ser_is_raw =
+        !std::is_same_v<T, bool> && !ser_has_writer<T> &&
+        !ser_has_reader<T> && !ser_is_container<T> && !ser_is_tuple<T> &&
+        (std::is_arithmetic_v<T> || (
+            std::is_trivially_copyable_v<T> && !std::is_enum_v<T>
+        ));
+
+    template<typename T>
+    inline T ser_swap(T v) {
+        if constexpr(std::is_arithmetic_v<T> && (sizeof(T) > 1)) {
+            if constexpr(
+                (sizeof(T) == 2) || (sizeof(T) == 4) || (sizeof(T) == 8)
+            ) {
+                return endian_swap<T>{}(v);
+            } else {
+                /* e.g. long double, no portable layout to swap */
+                throw stream_error{EINVAL, std::generic_category()};
+            }
+        } else {
+            return v;
+        }
+    }
+} /* namespace detail */
+
+/** @brief A buffered binary encoder writing into a stream.
+ *
+ * The writer keeps an internal buffer which is written into the stream
+ * when it's full, on flush() and on destruction. Use flush() to get write
+ * errors reported; errors during destruction are ignored.
+ *
+ * The encoding of values passed to put() is as follows:
+ *
+ * * Types with an ostd::serialize_traits specialization use that.
+ * * `bool` is a single byte, 0 or 1.
+ * * Enumerations use their underlying type.
+ * * Arithmetic types are written with their size in the writer's byte
+ *   order.
+ * * Strings (anything convertible to ostd::string_range) and containers
+ *   (anything with `size()`, `begin()` and `end()`) are written as their
+ *   length as a varint followed by the elements. Maps are written as pairs.
+ * * Tuple-like types (tuples, pairs, arrays) that are not containers are
+ *   written member by member.
+ * * Other trivially copyable types are written as their raw memory.
+ *
+ * Varints are unsigned LEB128, with zigzag encoding for signed values.
+ */
+struct binary_writer {
+    /** @brief Creates a writer for a stream in the given byte order.
+     *
+     * The stream must stay alive for as long as the writer does.
+     */
+    binary_writer(stream &s, byte_order order = byte_order::LITTLE):
+        p_stream(&s), p_order(order)
+    {}
+
+    binary_writer(binary_writer const &) = delete;
+    binary_writer &operator=(binary_writer const &) = delete;
+
+    /** @brief Writes the remaining buffered data, ignoring errors. */
+    ~binary_writer() {
+        try {
+            flush_buf();
+        } catch (...) {}
+    }
+
+    /** @brief Gets the stream the writer writes into. */
+    stream &get_stream() const noexcept {
+        return *p_stream;
+    }
+
+    /** @brief Gets the byte order of the writer. */
+    byte_order order() const noexcept {
+        return p_order;
+    }
+
+    /** @brief Writes the buffered data and flushes the stream.
+     *
+     * @throws ostd::stream_error on write failure.
+     */
+    void flush() {
+        flush_buf();
+        p_stream->flush();
+    }
+
+    /** @brief Writes raw bytes.
+     *
+     * Small writes are buffered; writes bigger than the buffer go directly
+     * into the stream as a single call.
+     *
+     * @throws ostd::stream_error on write failure.
+     */
+    void write_bytes(void const *buf, std::size_t n) {
+        /* empty containers may give us a null pointer */
+        if (!n) {
+            return;
+        }
+        if (n > (sizeof(p_buf) - p_len)) {
+            flush_buf();
+            if (n >= sizeof(p_buf)) {
+                p_stream->write_bytes(buf, n);
+                return;
+            }
+        }
+        std::memcpy(p_buf + p_len, buf, n);
+        p_len += n;
+    }
+
+    /** @brief Writes an integer as a LEB128 varint.
+     *
+     * Signed integers are zigzag encoded first, so that small negative
+     * values are also short.
+     *
+     * @throws ostd::stream_error on write failure.
+     */
+    template<typename T>
+    void put_varint(T v) {
+        static_assert(std::is_integral_v<T>, "varints must be integers");
+        using U = std::make_unsigned_t<T>;
+        U u;
+        if constexpr(std::is_signed_v<T>) {
+            u = U(U(v) << 1) ^ U(v >> (sizeof(T) * CHAR_BIT - 1));
+        } else {
+            u = v;
+        }
+        if ((sizeof(p_buf) - p_len) < (sizeof(T) * 2)) {
+            flush_buf();
+        }
+        while (u >= 0x80) {
+            p_buf[p_len++] = static_cast<unsigned char>(u | 0x80);
+            u >>= 7;
+        }
+        p_buf[p_len++] = static_cast<unsigned char>(u);
+    }
+
+    /** @brief Writes all given values.
+     *
+     * See ostd::binary_writer for the encoding.
+     *
+     * @throws ostd::stream_error on write failure.
+     */
+    template<typename ...A>
+    void put(A const &...args) {
+        (put_one(args), ...);
+    }
+
+    /** @brief Writes `count` values from `v` without a length prefix.
+     *
+     * Arithmetic values in the native byte order and other raw values are
+     * written using a single write_bytes() call.
+     *
+     * @throws ostd::stream_error on write failure.
+     */
+    template<typename T>
+    void put_n(T const *v, std::size_t count) {
+        if constexpr(detail::ser_is_raw<T>) {
+            if (
+                !std::is_arithmetic_v<T> || (sizeof(T) == 1) ||
+                (p_order == byte_order::NATIVE)
+            ) {
+                write_bytes(v, count * sizeof(T));
+                return;
+            }
+        }
+        for (std::size_t i = 0; i < count; ++i) {
+            put_one(v[i]);
+        }
+    }
+
+private:
+    void flush_buf() {
+        if (p_len) {
+            std::size_t len = p_len;
+            p_len = 0;
+            p_stream->write_bytes(p_buf, len);
+        }
+    }
+
+    template<typename T>
+    void put_arith(T v) {
+        if (p_order != byte_order::NATIVE) {
+            v = detail::ser_swap(v);
+        }
+        write_bytes(&v, sizeof(T));
+    }
+
+    template<typename T>
+    void put_one(T const &v) {
+        if constexpr(detail::ser_has_writer<T>) {
+            serialize_traits<T>::serialize(*this, v);
+        } else if constexpr(std::is_same_v<T, bool>) {
+            put_arith(static_cast<unsigned char>(v));
+        } else if constexpr(std::is_enum_v<T>) {
+            put_arith(static_cast<std::underlying_type_t<T>>(v));
+        } else if constexpr(std::is_arithmetic_v<T>) {
+            put_arith(v);
+        } else if constexpr(std::is_constructible_v<string_range, T const &>) {
+            string_range s{v};
+            put_varint(s.size());
+            write_bytes(s.data(), s.size());
+        } else if constexpr(detail::ser_is_container<T>) {
+            put_varint(std::size_t(v.size()));
+            if constexpr(detail::ser_is_contiguous<T>) {
+                put_n(v.data(), v.size());
+            } else {
+                for (auto const &it: v) {
+                    put_one(it);
+                }
+            }
+        } else if constexpr(detail::ser_is_tuple<T>) {
+            std::apply([this](auto const &...args) {
+                put(args...);
+            }, v);
+        } else {
+            static_assert(
+                std::is_trivially_copyable_v<T>,
+                "the value cannot be serialized"
+            );
+            write_bytes(&v, sizeof(T));
+        }
+    }
+
+    stream *p_stream;
+    byte_order p_order;
+    std::size_t p_len = 0;
+    unsigned char p_buf[4096];
+};
+
+/** @brief A buffered binary decoder reading from a stream.
+ *
+ * This decodes what ostd::binary_writer encodes, using the same rules
+ * when given the same types. Besides that, containers are read using
+ * `resize()` when they support it, `push_back()` otherwise and using
+ * `insert()` or `emplace()` when they're sets or maps. Fixed size
+ * containers such as `std::array` must have a matching size.
+ *
+ * The reader reads ahead into an internal buffer, so the stream's position
+ * is generally past the last value read.
+ *
+ * All reading functions throw ostd::stream_error on read failure, with
+ * `EIO` when the end of the stream is reached before a whole value was
+ * read and `EILSEQ` when the data are malformed.
+ */
+struct binary_reader {
+    /** @brief Creates a reader for a stream in the given byte order.
+     *
+     * The stream must stay alive for as long as the reader does.
+     */
+    binary_reader(stream &s, byte_order order = byte_order::LITTLE):
+        p_stream(&s), p_order(order)
+    {}
+
+    binary_reader(binary_reader const &) = delete;
+    binary_reader &operator=(binary_reader const &) = delete;
+
+    /** @brief Gets the stream the reader reads from. */
+    stream &get_stream() const noexcept {
+        return *p_stream;
+    }
+
+    /** @brief Gets the byte order of the reader. */
+    byte_order order() const noexcept {
+        return p_order;
+    }
+
+    /** @brief Checks if there is nothing more to read. */
+    bool end() {
+        if (p_pos == p_len) {
+            fill();
+        }
+        return p_pos == p_len;
+    }
+
+    /** @brief Reads exactly `n` raw bytes.
+     *
+     * Reads bigger than the buffer go directly into `buf`.
+     *
+     * @throws ostd::stream_error on failure or end-of-stream.
+     */
+    void read_bytes(void *buf, std::size_t n) {
+        if (!n) {
+            return;
+        }
+        auto *p = static_cast<unsigned char *>(buf);
+        std::size_t avail = std::min(n, p_len - p_pos);
+        std::memcpy(p, p_buf + p_pos, avail);
+        p_pos += avail;
+        p += avail;
+        n -= avail;
+        if (!n) {
+            return;
+        }
+        if (n >= sizeof(p_buf)) {
+            while (n) {
+                std::size_t rd = p_stream->read_bytes(p, n);
+                if (!rd) {
+                    throw stream_error{EIO, std::generic_category()};
+                }
+                p += rd;
+                n -= rd;
+            }
+            return;
+        }
+        while (n) {
+            if (!fill()) {
+                throw stream_error{EIO, std::generic_category()};
+            }
+            avail = std::min(n, p_len);
+            std::memcpy(p, p_buf, avail);
+            p_pos = avail;
+            p += avail;
+            n -= avail;
+        }
+    }
+
+    /** @brief Reads a LEB128 varint.
+     *
+     * Signed types are zigzag decoded. If the value does not fit into
+     * the type, the data are considered malformed.
+     */
+    template<typename T>
+    T get_varint() {
+        static_assert(std::is_integral_v<T>, "varints must be integers");
+        using U = std::make_unsigned_t<T>;
+        std::uint64_t u = 0;
+        for (unsigned int shift = 0;; shift += 7) {
+            if ((p_pos == p_len) && !fill()) {
+                throw stream_error{EIO, std::generic_category()};
+            }
+            unsigned char c = p_buf[p_pos++];
+            /* the tenth byte may only hold the last bit of 64 */
+            if ((shift == 63) && (c > 1)) {
+                throw stream_error{EILSEQ, std::generic_category()};
+            }
+            u |= std::uint64_t(c & 0x7F) << shift;
+            if (!(c & 0x80)) {
+                break;
+            }
+        }
+        if (u > std::numeric_limits<U>::max()) {
+            throw stream_error{EILSEQ, std::generic_category()};
+        }
+        if constexpr(std::is_signed_v<T>) {
+            U uv = U(u);
+            return T(uv >> 1) ^ -T(uv & 1);
+        } else {
+            return T(u);
+        }
+    }
+
+    /** @brief Reads into all given values.
+     *
+     * See ostd::binary_writer for the encoding.
+     */
+    template<typename ...A>
+    void get(A &...args) {
+        (get_one(args), ...);
+    }
+
+    /** @brief Reads a single value and returns it.
+     *
+     * The type must be default constructible.
+     */
+    template<typename T>
+    T get() {
+        T ret{};
+        get_one(ret);
+        return ret;
+    }
+
+    /** @brief Reads `count` values into `v` with no length prefix.
+     *
+     * The counterpart of ostd::binary_writer::put_n().
+     */
+    template<typename T>
+    void get_n(T *v, std::size_t count) {
+        if constexpr(detail::ser_is_raw<T>) {
+            if (
+                !std::is_arithmetic_v<T> || (sizeof(T) == 1) ||
+                (p_order == byte_order::NATIVE)
+            ) {
+                read_bytes(v, count * sizeof(T));
+                return;
+            }
+        }
+        for (std::size_t i = 0; i < count; ++i) {
+            get_one(v[i]);
+        }
+    }
+
+private:
+    bool fill() {
+        p_pos = 0;
+        p_len = p_stream->read_bytes(p_buf, sizeof(p_buf));
+        return p_len != 0;
+    }
+
+    template<typename T>
+    T get_arith() {
+        T v;
+        read_bytes(&v, sizeof(T));
+        if (p_order != byte_order::NATIVE) {
+            v = detail::ser_swap(v);
+        }
+        return v;
+    }
+
+    template<typename T>
+    void get_container(T &v) {
+        using VT = typename T::value_type;
+        auto n = get_varint<std::size_t>();
+        if constexpr(detail::ser_is_map<T>) {
+            v.clear();
+            for (; n; --n) {
+                typename T::key_type k{};
+                typename T::mapped_type m{};
+                get(k, m);
+                v.emplace(std::move(k), std::move(m));
+            }
+        } else if constexpr(detail::ser_is_set<T>) {
+            v.clear();
+            for (; n; --n) {
+                v.insert(get<typename T::key_type>());
+            }
+        } else if constexpr(
+            detail::ser_can_resize<T> && detail::ser_is_contiguous<T>
+        ) {
+            /* grow in steps, so that a malformed length
+             * cannot make us allocate everything at once
+             */
+            constexpr std::size_t step = 65536 / sizeof(VT) + 1;
+            v.resize(0);
+            for (std::size_t i = 0; i < n;) {
+                std::size_t c = std::min(n - i, step);
+                v.resize(i + c);
+                get_n(v.data() + i, c);
+                i += c;
+            }
+        } else if constexpr(detail::ser_can_push_back<T>) {
+            v.clear();
+            for (; n; --n) {
+                v.push_back(get<VT>());
+            }
+        } else {
+            /* fixed size containers */
+            if (n != std::size_t(v.size())) {
+                throw stream_error{EILSEQ, std::generic_category()};
+            }
+            for (auto &it: v) {
+                get_one(it);
+            }
+        }
+    }
+
+    template<typename T>
+    void get_one(T &v) {
+        if constexpr(detail::ser_has_reader<T>) {
+            serialize_traits<T>::deserialize(*this, v);
+        } else if constexpr(std::is_same_v<T, bool>) {
+            v = (get_arith<unsigned char>() != 0);
+        } else if constexpr(std::is_enum_v<T>) {
+            v = static_cast<T>(get_arith<std::underlying_type_t<T>>());
+        } else if constexpr(std::is_arithmetic_v<T>) {
+            v = get_arith<T>();
+        } else if constexpr(detail::ser_is_container<T>) {
+            get_container(v);
+        } else if constexpr(detail::ser_is_tuple<T>) {
+            std::apply([this](auto &...args) {
+                get(args...);
+            }, v);
+        } else {
+            static_assert(
+                std::is_trivially_copyable_v<T>,
+                "the value cannot be deserialized"
+            );
+            read_bytes(&v, sizeof(T));
+        }
+    }
+
+    stream *p_stream;
+    byte_order p_order;
+    std::size_t p_pos = 0;
+    std::size_t p_len = 0;
+    unsigned char p_buf[4096];
+};
+
+/** @} */
+
+} /* namespace ostd */
+
+#endif
+
+/** @} */
@@ -79,6 +79,26 @@ namespace detail {
     OSTD_EXPORT std::size_t tstrlen(char16_t const *p) noexcept;
     OSTD_EXPORT std::size_t tstrlen(char32_t const *p) noexcept;
     OSTD_EXPORT std::size_t tstrlen(wchar_t const *p) noexcept;
+
+    template<typename>
+    struct split_range;
+}
+
+struct byte_set;
+
+namespace detail {
+    OSTD_EXPORT char const *str_find(
+        char const *h, std::size_t hn, char const *n, std::size_t nn
+    ) noexcept;
+    OSTD_EXPORT char const *str_rfind(
+        char const *h, std::size_t hn, char const *n, std::size_t nn
+    ) noexcept;
+    OSTD_EXPORT char const *str_find_first_of(
+        char const *h, std::size_t hn, byte_set const &set
+    ) noexcept;
+    OSTD_EXPORT std::size_t str_count(
+        char const *h, std::size_t hn, char c
+    ) noexcept;
 }
 
 /** @addtogroup Strings
@@ -363,6 +383,79 @@ public:
      */
     inline int case_compare(basic_char_range<value_type const> s) const noexcept;
 
+    /** @brief Finds the first occurence of a sub-slice.
+     *
+     * The result is the slice from the beginning of the occurence until
+     * the end, or an empty slice at the end when there is none, just like
+     * with ostd::find(). An empty `s` is found at the beginning.
+     *
+     * For byte slices this uses SIMD kernels (AVX2 if the library is built
+     * with it enabled, SSE2 otherwise, with a scalar fallback) to find the
+     * candidate positions by their first and last units, and switches to
+     * the Two-Way algorithm if the candidates keep failing, so the search
+     * is linear in the worst case.
+     *
+     * @see rfind(), find_first_of()
+     */
+    inline basic_char_range find(
+        basic_char_range<value_type const> s
+    ) const noexcept;
+
+    /** @brief Finds the last occurence of a sub-slice.
+     *
+     * The result is the slice from the beginning of the last occurence
+     * until the end, or an empty slice at the end when there is none.
+     * An empty `s` is found at the end. This scans backwards, so unlike
+     * find(), the worst case is proportional to the product of the sizes.
+     *
+     * @see find()
+     */
+    inline basic_char_range rfind(
+        basic_char_range<value_type const> s
+    ) const noexcept;
+
+    /** @brief Finds the first unit that is a member of `set`.
+     *
+     * The result is the slice from the unit until the end, or an empty
+     * slice at the end when there is none. Only valid for byte slices.
+     *
+     * @see ostd::byte_set
+     */
+    inline basic_char_range find_first_of(byte_set const &set) const noexcept;
+
+    /** @brief Counts the occurences of a unit in the slice. */
+    inline size_type count(std::remove_cv_t<value_type> c) const noexcept;
+
+    /** @brief Removes the ASCII whitespace on both ends of the slice.
+     *
+     * The whitespace characters are space, `\t`, `\n`, `\v`, `\f`
+     * and `\r`. The result is a sub-slice of this slice.
+     */
+    inline basic_char_range trim() const noexcept;
+
+    /** @brief Gets a lazy range of the parts of the slice split by `delim`.
+     *
+     * The result is an ostd::forward_range_tag range of sub-slices of this
+     * slice. Each part is found with find() when popping the previous one,
+     * so splitting only does the work needed to get to the parts that are
+     * actually used.
+     *
+     * Consecutive delimiters result in empty parts, as do delimiters at
+     * the ends of the slice, so there is always one more part than there
+     * are delimiters. An empty slice is therefore a single empty part. An
+     * empty `delim` does not split anything.
+     *
+     * ~~~{.cc}
+     * // prints "a", "", "b"
+     * for (auto part: ostd::string_range{"a,,b"}.split(",")) {
+     *     ostd::writeln(part);
+     * }
+     * ~~~
+     */
+    inline detail::split_range<T> split(
+        basic_char_range<value_type const> delim
+    ) const noexcept;
+
     /** @brief Iterate over the Unicode units of the given type.
      *
      * Like utf::iter_u().
@@ -591,6 +684,123 @@ inline bool starts_with(wstring_range a, wstring_range b) noexcept {
     return a.slice(0, b.size()) == b;
 }
 
+/** @brief A set of bytes.
+ *
+ * Used with basic_char_range::find_first_of(). Besides a plain bitmap of
+ * the members, it precomputes the lookup tables used by the SIMD kernels,
+ * so it's best created once and then reused for many searches.
+ */
+struct byte_set {
+    /** @brief Constructs an empty set. */
+    byte_set() noexcept {}
+
+    /** @brief Constructs a set containing the bytes of `chars`. */
+    byte_set(string_range chars) noexcept {
+        for (char c: chars) {
+            add(c);
+        }
+    }
+
+    /** @brief Adds a byte to the set. */
+    void add(char c) noexcept {
+        auto v = static_cast<unsigned char>(c);
+        if (contains(c)) {
+            return;
+        }
+        p_bits[v / 64] |= std::uint64_t(1) << (v % 64);
+        /* indexed by the low nibble, one bit for each high nibble */
+        if (v < 128) {
+            p_lo[v & 0xF] |= static_cast<unsigned char>(1 << (v >> 4));
+        } else {
+            p_hi[v & 0xF] |= static_cast<unsigned char>(1 << ((v >> 4) - 8));
+        }
+        if (p_nchars < sizeof(p_chars)) {
+            p_chars[p_nchars] = c;
+        }
+        ++p_nchars;
+    }
+
+    /** @brief Checks if a byte is in the set. */
+    bool contains(char c) const noexcept {
+        auto v = static_cast<unsigned char>(c);
+        return p_bits[v / 64] & (std::uint64_t(1) << (v % 64));
+    }
+
+    /** @brief Gets the number of bytes in the set. */
+    std::size_t size() const noexcept {
+        return p_nchars;
+    }
+
+    /** @brief Checks if the set is empty. */
+    bool empty() const noexcept {
+        return !p_nchars;
+    }
+
+private:
+    friend char const *detail::str_find_first_of(
+        char const *, std::size_t, byte_set const &
+    ) noexcept;
+
+    std::uint64_t p_bits[4] = {};
+    unsigned char p_lo[16] = {};
+    unsigned char p_hi[16] = {};
+    /* the members as a list, when there are few of them */
+    char p_chars[16] = {};
+    std::size_t p_nchars = 0;
+};
+
+namespace detail {
+    template<typename T>
+    struct split_range: input_range<split_range<T>> {
+        using range_category = forward_range_tag;
+        using value_type     = basic_char_range<T>;
+        using reference      = basic_char_range<T>;
+        using size_type      = std::size_t;
+
+        split_range() = delete;
+
+        split_range(
+            basic_char_range<T> s, basic_char_range<T const> delim
+        ) noexcept:
+            p_rest(s), p_delim(delim), p_done(false)
+        {
+            next();
+        }
+
+        bool empty() const noexcept { return p_done; }
+
+        void pop_front() noexcept {
+            if (p_rest.size() == p_part.size()) {
+                /* there was no delimiter after the last part */
+                p_done = true;
+                return;
+            }
+            p_rest = p_rest.slice(p_part.size() + p_delim.size());
+            next();
+        }
+
+        reference front() const noexcept { return p_part; }
+
+    private:
+        void next() noexcept {
+            if (p_delim.empty()) {
+                p_part = p_rest;
+                return;
+            }
+            auto r = p_rest.find(p_delim);
+            if (r.empty()) {
+                p_part = p_rest;
+            } else {
+                p_part = p_rest.slice(0, p_rest.size() - r.size());
+            }
+        }
+
+        basic_char_range<T> p_rest, p_part;
+        basic_char_range<T const> p_delim;
+        bool p_done;
+    };
+}
+
 /** @brief Mutable range integration for std::basic_string.
  *
  * The range type used for mutable string references
@@ -1411,6 +1621,97 @@ inline int basic_char_range<T>::case_compare(
     return utf::case_compare(*this, s);
 }
 
+template<typename T>
+inline basic_char_range<T> basic_char_range<T>::find(
+    basic_char_range<T const> s
+) const noexcept {
+    if constexpr(sizeof(T) == 1) {
+        auto *p = detail::str_find(
+            reinterpret_cast<char const *>(p_beg), size(),
+            reinterpret_cast<char const *>(s.data()), s.size()
+        );
+        if (!p) {
+            return slice(size());
+        }
+        return slice(size_type(p - reinterpret_cast<char const *>(p_beg)));
+    } else {
+        auto pos = std::basic_string_view<std::remove_cv_t<T>>(*this).find(
+            std::basic_string_view<std::remove_cv_t<T>>(s)
+        );
+        return slice((pos == std::string_view::npos) ? size() : pos);
+    }
+}
+
+template<typename T>
+inline basic_char_range<T> basic_char_range<T>::rfind(
+    basic_char_range<T const> s
+) const noexcept {
+    if constexpr(sizeof(T) == 1) {
+        auto *p = detail::str_rfind(
+            reinterpret_cast<char const *>(p_beg), size(),
+            reinterpret_cast<char const *>(s.data()), s.size()
+        );
+        if (!p) {
+            return slice(size());
+        }
+        return slice(size_type(p - reinterpret_cast<char const *>(p_beg)));
+    } else {
+        auto pos = std::basic_string_view<std::remove_cv_t<T>>(*this).rfind(
+            std::basic_string_view<std::remove_cv_t<T>>(s)
+        );
+        return slice((pos == std::string_view::npos) ? size() : pos);
+    }
+}
+
+template<typename T>
+inline basic_char_range<T> basic_char_range<T>::find_first_of(
+    byte_set const &set
+) const noexcept {
+    static_assert(sizeof(T) == 1, "byte sets can only be used with bytes");
+    auto *p = detail::str_find_first_of(
+        reinterpret_cast<char const *>(p_beg), size(), set
+    );
+    if (!p) {
+        return slice(size());
+    }
+    return slice(size_type(p - reinterpret_cast<char const *>(p_beg)));
+}
+
+template<typename T>
+inline std::size_t basic_char_range<T>::count(
+    std::remove_cv_t<T> c
+) const noexcept {
+    if constexpr(sizeof(T) == 1) {
+        return detail::str_count(
+            reinterpret_cast<char const *>(p_beg), size(), char(c)
+        );
+    } else {
+        return ostd::count(*this, c);
+    }
+}
+
+template<typename T>
+inline basic_char_range<T> basic_char_range<T>::trim() const noexcept {
+    auto is_space = [](std::remove_cv_t<T> c) {
+        return (c == ' ') || ((c >= '\t') && (c <= '\r'));
+    };
+    T *beg = p_beg, *end = p_end;
+    while ((beg != end) && is_space(*beg)) {
+        ++beg;
+    }
+    while ((end != beg) && is_space(*(end - 1))) {
+        --end;
+    }
+    return basic_char_range(beg, end);
+}
+
+template<typename T>
+inline detail::split_range<T> basic_char_range<T>::split(
+    basic_char_range<T const> delim
+) const noexcept {
+    return detail::split_range<T>{*this, delim};
+}
+
 /* string literals */
 
 inline namespace literals {
@@ -27,6 +27,9 @@
 #include <mutex>
 #include <condition_variable>
 
+#include <ostd/topology.hh>
+#include <ostd/scheduler_stats.hh>
+
 namespace ostd {
 
 /** @addtogroup Concurrency
@@ -62,7 +65,7 @@ namespace detail {
         tpool_func(tpool_func const &) = delete;
         tpool_func &operator=(tpool_func const &) = delete;
 
-        tpool_func(tpool_func &&func) {
+        tpool_func(tpool_func &&func): stamp(func.stamp) {
             if (static_cast<void *>(func.p_func) == &func.p_buf) {
                 p_func = reinterpret_cast<tpool_func_base *>(&p_buf);
                 func.p_func->clone(p_func);
@@ -93,6 +96,8 @@ namespace detail {
         void operator()() {
             p_func->call();
         }
+
+        sched_stamp stamp;
     private:
         std::aligned_storage_t<
             sizeof(tpool_func_impl<std::packaged_task<void()>>),
@@ -115,15 +120,31 @@ struct thread_pool {
      * Creates the threads and marks the pool as running. The number of
      * threads defaults to the number of hardware threads in your system.
      *
+     * When `pl.pin` is set, every worker is pinned to a CPU, with the
+     * workers spread across the NUMA nodes (see ostd::cpu_topology).
+     * The pool has a single queue, so `pl.numa` has no effect here.
+     *
      * @param[in] size The number of threads to use.
+     * @param[in] pl The worker placement.
      */
-    void start(std::size_t size = std::thread::hardware_concurrency()) {
+    void start(
+        std::size_t size = std::thread::hardware_concurrency(),
+        worker_placement pl = worker_placement{}
+    ) {
         p_running = true;
-        auto tf = [this]() {
-            thread_run();
-        };
+        p_stats.reset(size);
         for (std::size_t i = 0; i < size; ++i) {
-            p_thrs.push_back(std::thread{tf});
+            if (pl.pin) {
+                unsigned int cpu = cpu_topology::system().worker_cpu(i);
+                p_thrs.push_back(std::thread{[this, i, cpu]() {
+                    pin_current_thread(cpu);
+                    thread_run(i);
+                }});
+            } else {
+                p_thrs.push_back(std::thread{[this, i]() {
+                    thread_run(i);
+                }});
+            }
         }
     }
 
@@ -191,6 +212,8 @@ struct thread_pool {
                 throw std::runtime_error{"push on stopped thread_pool"};
             }
             p_tasks.emplace(std::move(t));
+            p_stats.queued(p_tasks.back().stamp);
+            p_stats.depth(p_tasks.size());
         }
         p_cond.notify_one();
         return ret;
@@ -201,18 +224,32 @@ struct thread_pool {
         return p_thrs.size();
     }
 
+    /** @brief Gets a snapshot of the pool statistics.
+     *
+     * The snapshot is empty unless libostd was built with statistics
+     * enabled (see ostd::scheduler_stats_enabled). There is only one
+     * queue, so there are never any steals.
+     */
+    scheduler_stats stats() const {
+        return p_stats.snapshot();
+    }
+
 private:
-    void thread_run() {
+    void thread_run(std::size_t worker) {
         for (;;) {
             std::unique_lock<std::mutex> l{p_lock};
             while (p_running && p_tasks.empty()) {
+                auto since = p_stats.now();
                 p_cond.wait(l);
+                p_stats.idle(worker, since);
             }
             if (!p_running && p_tasks.empty()) {
                 return;
             }
             auto t{std::move(p_tasks.front())};
             p_tasks.pop();
+            p_stats.depth(p_tasks.size());
+            p_stats.run(worker, t.stamp);
             l.unlock();
             t();
         }
@@ -222,6 +259,7 @@ private:
     std::mutex p_lock;
     std::vector<std::thread> p_thrs;
     std::queue<detail::tpool_func> p_tasks;
+    detail::sched_stats p_stats;
     bool p_running = false;
 };
 
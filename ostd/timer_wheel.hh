@@ -0,0 +1,414 @@
+/** @addtogroup Concurrency
+ * @{
+ */
+
+/** @file timer_wheel.hh
+ *
+ * @brief A hierarchical timing wheel.
+ *
+ * This file implements the timer structure used by the coroutine schedulers
+ * to implement sleeping and timed waits. It can hold a very large amount of
+ * timers at once, with constant time insertion and removal.
+ *
+ * @copyright See COPYING.md in the project tree for further information.
+ */
+
+#ifndef OSTD_TIMER_WHEEL_HH
+#define OSTD_TIMER_WHEEL_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <chrono>
+
+#include <ostd/platform.hh>
+#include <ostd/unit_test.hh>
+
+namespace ostd {
+
+/** @addtogroup Concurrency
+ * @{
+ */
+
+/** @brief A timer in an ostd::timer_wheel.
+ *
+ * Timer nodes are intrusive, i.e. the wheel does not allocate any memory
+ * and instead links the nodes provided by the user. A node must stay alive
+ * for as long as it's in a wheel. A node can only be in one wheel at once.
+ */
+struct timer_node {
+    /** @brief Arbitrary user data, typically the owner of the node. */
+    void *data = nullptr;
+
+    /** @brief Checks if the node is currently in a wheel. */
+    bool armed() const noexcept {
+        return p_next != nullptr;
+    }
+
+private:
+    friend struct timer_wheel;
+
+    timer_node *p_prev = nullptr;
+    timer_node *p_next = nullptr;
+    std::uint64_t p_expires = 0;
+    std::size_t p_slot = 0;
+};
+
+/** @brief A hierarchical timing wheel.
+ *
+ * The wheel counts time in ticks of one millisecond since its creation.
+ * It consists of several levels of 64 slots each; the first level holds
+ * the timers due in the next 64 ticks, one slot per tick, the second level
+ * holds the timers due in the next 4096 ticks, 64 ticks per slot, and so
+ * on. As the time advances, the slots of the upper levels are cascaded
+ * into the lower levels. Timers further in the future than the wheel can
+ * hold (about 4.6 hours) are put into the last slot and re-inserted once
+ * they're cascaded.
+ *
+ * Adding and removing a timer takes constant time. Expiring timers takes
+ * time proportional to the number of expired timers, and occupancy bitmaps
+ * make it possible to skip over empty periods of time without visiting
+ * every tick.
+ *
+ * Timers never fire early, but may fire up to a tick late.
+ *
+ * The wheel is not thread safe, so external locking is needed.
+ */
+struct timer_wheel {
+    /** @brief The clock used for deadlines. */
+    using clock = std::chrono::steady_clock;
+
+    /** @brief The time point type used for deadlines. */
+    using time_point = clock::time_point;
+
+    /** @brief Creates an empty wheel with the current time as the origin. */
+    timer_wheel(): p_epoch(clock::now()) {
+        for (auto &s: p_slots) {
+            s.p_prev = s.p_next = &s;
+        }
+    }
+
+    timer_wheel(timer_wheel const &) = delete;
+    timer_wheel(timer_wheel &&) = delete;
+    timer_wheel &operator=(timer_wheel const &) = delete;
+    timer_wheel &operator=(timer_wheel &&) = delete;
+
+    /** @brief Checks if there are no timers in the wheel. */
+    bool empty() const noexcept {
+        return !p_count;
+    }
+
+    /** @brief Gets the number of timers in the wheel. */
+    std::size_t size() const noexcept {
+        return p_count;
+    }
+
+    /** @brief Adds a timer to the wheel.
+     *
+     * If the node is already in the wheel, it's re-armed with the new
+     * deadline. If the deadline has already passed, the timer will be
+     * fired on the next call to expire().
+     */
+    void add(timer_node &nd, time_point deadline) noexcept {
+        if (nd.armed()) {
+            unlink(nd);
+        } else {
+            ++p_count;
+        }
+        nd.p_expires = tick_ceil(deadline);
+        insert(nd);
+    }
+
+    /** @brief Removes a timer from the wheel.
+     *
+     * If the node is not in the wheel, this does nothing.
+     */
+    void remove(timer_node &nd) noexcept {
+        if (!nd.armed()) {
+            return;
+        }
+        unlink(nd);
+        --p_count;
+    }
+
+    /** @brief Fires all timers due at the given time.
+     *
+     * Every expired timer is removed from the wheel and then passed to
+     * `fire`. The function is free to add or remove timers, including
+     * the one it's called with.
+     *
+     * @param[in] now The current time.
+     * @param[in] fire A function taking `timer_node &`.
+     */
+    template<typename F>
+    void expire(time_point now, F &&fire) {
+        std::uint64_t to = tick_floor(now);
+        while (p_count && (p_now <= to)) {
+            if (!(p_now & SLOT_MASK)) {
+                cascade();
+            }
+            timer_node &head = p_slots[p_now & SLOT_MASK];
+            while (head.p_next != &head) {
+                timer_node &nd = *head.p_next;
+                unlink(nd);
+                --p_count;
+                fire(nd);
+            }
+            ++p_now;
+            if (!p_count) {
+                break;
+            }
+            p_now = std::max(p_now, std::min(next_tick(), to + 1));
+        }
+        if (p_now <= to) {
+            p_now = to + 1;
+        }
+    }
+
+    /** @brief Gets the time when expire() needs to be called next.
+     *
+     * This is never later than the earliest deadline in the wheel, but
+     * may be earlier when the wheel needs to cascade its upper levels.
+     * When the wheel is empty, the result is `time_point::max()`.
+     */
+    time_point next_expiry() const noexcept {
+        if (!p_count) {
+            return time_point::max();
+        }
+        return p_epoch + std::chrono::milliseconds(next_tick());
+    }
+
+private:
+    static constexpr std::size_t SLOT_BITS = 6;
+    static constexpr std::size_t SLOTS = std::size_t(1) << SLOT_BITS;
+    static constexpr std::uint64_t SLOT_MASK = SLOTS - 1;
+    static constexpr std::size_t LEVELS = 4;
+    static constexpr std::uint64_t HORIZON =
+        std::uint64_t(1) << (SLOT_BITS * LEVELS);
+
+    std::uint64_t tick_floor(time_point tp) const noexcept {
+        if (tp <= p_epoch) {
+            return 0;
+        }
+        return std::uint64_t(std::chrono::duration_cast<
+            std::chrono::milliseconds
+        >(tp - p_epoch).count());
+    }
+
+    std::uint64_t tick_ceil(time_point tp) const noexcept {
+        if (tp <= p_epoch) {
+            return 0;
+        }
+        if (tp == time_point::max()) {
+            return ~std::uint64_t(0);
+        }
+        auto ns = std::uint64_t(std::chrono::duration_cast<
+            std::chrono::nanoseconds
+        >(tp - p_epoch).count());
+        return (ns + 999999) / 1000000;
+    }
+
+    void insert(timer_node &nd) noexcept {
+        std::uint64_t exp = std::max(nd.p_expires, p_now);
+        std::uint64_t delta = exp - p_now;
+        std::size_t lev = 0;
+        if (delta >= HORIZON) {
+            lev = LEVELS - 1;
+            exp = p_now + HORIZON - 1;
+        } else {
+            while (delta >= (std::uint64_t(1) << (SLOT_BITS * (lev + 1)))) {
+                ++lev;
+            }
+        }
+        std::size_t slot = (exp >> (SLOT_BITS * lev)) & SLOT_MASK;
+        timer_node &head = p_slots[lev * SLOTS + slot];
+        nd.p_slot = lev * SLOTS + slot;
+        nd.p_prev = head.p_prev;
+        nd.p_next = &head;
+        head.p_prev->p_next = &nd;
+        head.p_prev = &nd;
+        p_bits[lev] |= std::uint64_t(1) << slot;
+    }
+
+    void unlink(timer_node &nd) noexcept {
+        nd.p_prev->p_next = nd.p_next;
+        nd.p_next->p_prev = nd.p_prev;
+        timer_node &head = p_slots[nd.p_slot];
+        if (head.p_next == &head) {
+            p_bits[nd.p_slot / SLOTS] &= ~(std::uint64_t(1) << (
+                nd.p_slot % SLOTS
+            ));
+        }
+        nd.p_prev = nd.p_next = nullptr;
+    }
+
+    /* called when the current tick is a multiple of the slot count;
+     * moves the timers from the current upper level slots downwards,
+     * starting from the top so that they cannot land in a slot that
+     * has already been cascaded
+     */
+    void cascade() noexcept {
+        std::size_t top = 1;
+        while ((top < (LEVELS - 1)) && !(
+            (p_now >> (SLOT_BITS * top)) & SLOT_MASK
+        )) {
+            ++top;
+        }
+        for (std::size_t lev = top; lev >= 1; --lev) {
+            std::size_t slot = (p_now >> (SLOT_BITS * lev)) & SLOT_MASK;
+            timer_node &head = p_slots[lev * SLOTS + slot];
+            while (head.p_next != &head) {
+                timer_node &nd = *head.p_next;
+                unlink(nd);
+                insert(nd);
+            }
+        }
+    }
+
+    /* the distance from idx to the first set bit at or after it,
+     * wrapping around; the bits must not be all zero
+     */
+    static std::size_t first_from(
+        std::uint64_t bits, std::size_t idx
+    ) noexcept {
+        /* rotate so that the bit for idx becomes bit 0 */
+        if (idx) {
+            bits = (bits >> idx) | (bits << (SLOTS - idx));
+        }
+        std::size_t ret = 0;
+        while (!(bits & 1)) {
+            bits >>= 1;
+            ++ret;
+        }
+        return ret;
+    }
+
+    /* the earliest tick that has something to do */
+    std::uint64_t next_tick() const noexcept {
+        std::uint64_t ret = ~std::uint64_t(0);
+        if (p_bits[0]) {
+            ret = p_now + first_from(p_bits[0], p_now & SLOT_MASK);
+        }
+        for (std::size_t lev = 1; lev < LEVELS; ++lev) {
+            if (!p_bits[lev]) {
+                continue;
+            }
+            /* the current slot was cascaded when its period began, so
+             * anything in it is a whole round ahead and comes after the
+             * other slots; start looking from the next one
+             */
+            std::size_t shift = SLOT_BITS * lev;
+            std::uint64_t next = (p_now >> shift) + 1;
+            std::uint64_t t = (next + first_from(
+                p_bits[lev], next & SLOT_MASK
+            )) << shift;
+            ret = std::min(ret, t);
+        }
+        return ret;
+    }
+
+    time_point p_epoch;
+    std::uint64_t p_now = 0;
+    std::size_t p_count = 0;
+    std::uint64_t p_bits[LEVELS] = {};
+    timer_node p_slots[LEVELS * SLOTS];
+};
+
+#ifdef OSTD_BUILD_TESTS
+#define OSTD_TEST_MODULE libostd_timer_wheel
+
+namespace detail {
+    /* runs the wheel the way the schedulers do, waking up at every
+     * next_expiry() until it's empty, and checks that every timer
+     * fires on its tick or the one after it
+     */
+    inline void timer_wheel_check(
+        timer_wheel &w, timer_wheel::time_point ep,
+        std::uint64_t start, std::uint64_t const *ticks, std::size_t n
+    ) {
+        using ostd::test::fail_if;
+        using ms = std::chrono::milliseconds;
+        timer_node nds[16];
+        std::uint64_t fired[16] = {};
+        fail_if(n > 16);
+        w.expire(ep + ms(start - 1), [](timer_node &) {});
+        for (std::size_t i = 0; i < n; ++i) {
+            nds[i].data = &fired[i];
+            w.add(nds[i], ep + ms(ticks[i]));
+        }
+        /* cascades need a bounded number of wakeups per timer */
+        for (std::size_t iter = 0; !w.empty(); ++iter) {
+            fail_if(iter > 1000);
+            auto next = w.next_expiry();
+            auto now = std::chrono::duration_cast<ms>(next - ep).count();
+            /* the first timer is never later than the wakeup */
+            for (std::size_t i = 0; i < n; ++i) {
+                fail_if(nds[i].armed() && (ticks[i] < std::uint64_t(now)));
+            }
+            w.expire(next, [now](timer_node &nd) {
+                *static_cast<std::uint64_t *>(nd.data) = std::uint64_t(now);
+            });
+        }
+        for (std::size_t i = 0; i < n; ++i) {
+            fail_if(fired[i] < ticks[i]);
+            fail_if(fired[i] > (ticks[i] + 1));
+        }
+    }
+
+    /* the time the wheel counts from; a timer that's already due is
+     * always on tick zero
+     */
+    inline timer_wheel::time_point timer_wheel_epoch(timer_wheel &w) {
+        timer_node nd;
+        w.add(nd, timer_wheel::time_point::min());
+        auto ret = w.next_expiry();
+        w.remove(nd);
+        return ret;
+    }
+}
+
+OSTD_UNIT_TEST {
+    /* a timer in the current slot of an upper level must not hide the
+     * timers in its other slots
+     */
+    timer_wheel w;
+    auto ep = detail::timer_wheel_epoch(w);
+    std::uint64_t ticks[] = {130 + 4095, 130 + 500};
+    detail::timer_wheel_check(w, ep, 130, ticks, 2);
+}
+
+OSTD_UNIT_TEST {
+    /* timers on every level at once, added in the middle of a round */
+    timer_wheel w;
+    auto ep = detail::timer_wheel_epoch(w);
+    std::uint64_t ticks[] = {
+        1000 + 5, 1000 + 63, 1000 + 64, 1000 + 700, 1000 + 4095,
+        1000 + 4096, 1000 + 70000, 1000 + 262143, 1000 + 262144,
+        1000 + 4286332, 1000 + 16777215
+    };
+    detail::timer_wheel_check(w, ep, 1000, ticks, 11);
+}
+
+OSTD_UNIT_TEST {
+    /* timers beyond the horizon are parked in the last level, which
+     * must not delay the other timers there
+     */
+    timer_wheel w;
+    auto ep = detail::timer_wheel_epoch(w);
+    std::uint64_t ticks[] = {
+        777 + 36000000, 777 + 4286332, 777 + 300000, 777 + 16777216,
+        777 + 100000000, 777 + 9
+    };
+    detail::timer_wheel_check(w, ep, 777, ticks, 6);
+}
+
+#undef OSTD_TEST_MODULE
+#endif
+
+/** @} */
+
+} /* namespace ostd */
+
+#endif
+
+/** @} */
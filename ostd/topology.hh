@@ -0,0 +1,142 @@
+/** @addtogroup Concurrency
+ * @{
+ */
+
+/** @file topology.hh
+ *
+ * @brief CPU and NUMA topology discovery and worker thread placement.
+ *
+ * This file provides a way to find out how the CPUs of the system are laid
+ * out into NUMA nodes, as well as to pin threads to CPUs and bind memory to
+ * nodes. Thread pools and schedulers use this to place their workers.
+ *
+ * Discovery is currently only implemented on Linux, using sysfs. Elsewhere,
+ * the system is always treated as a single node containing all the CPUs,
+ * and pinning and memory binding do nothing.
+ *
+ * @copyright See COPYING.md in the project tree for further information.
+ */
+
+#ifndef OSTD_TOPOLOGY_HH
+#define OSTD_TOPOLOGY_HH
+
+#include <cstddef>
+#include <vector>
+
+#include <ostd/platform.hh>
+
+namespace ostd {
+
+/** @addtogroup Concurrency
+ * @{
+ */
+
+/** @brief A single NUMA node. */
+struct cpu_node {
+    /** @brief The node number as seen by the OS. */
+    std::size_t id = 0;
+
+    /** @brief The CPUs belonging to the node, usable by this process. */
+    std::vector<unsigned int> cpus{};
+
+    /** @brief Distances to other nodes.
+     *
+     * Indexed the same way as cpu_topology::nodes. The distance to the
+     * node itself is typically 10, further nodes have bigger values.
+     */
+    std::vector<unsigned int> distances{};
+};
+
+/** @brief The layout of CPUs in the system.
+ *
+ * Only nodes that contain CPUs this process is allowed to run on are
+ * included, so there is always at least one node with at least one CPU.
+ */
+struct OSTD_EXPORT cpu_topology {
+    /** @brief The NUMA nodes. */
+    std::vector<cpu_node> nodes{};
+
+    /** @brief Gets the topology of the current system.
+     *
+     * The topology is discovered on the first call and cached afterwards.
+     */
+    static cpu_topology const &system();
+
+    /** @brief Gets the total number of CPUs in all nodes. */
+    std::size_t cpu_count() const noexcept {
+        std::size_t ret = 0;
+        for (auto &nd: nodes) {
+            ret += nd.cpus.size();
+        }
+        return ret;
+    }
+
+    /** @brief Gets the node index a worker should run on.
+     *
+     * Workers are spread across the nodes in a round-robin manner, so
+     * that all nodes are used even when there are fewer workers than CPUs.
+     */
+    std::size_t worker_node(std::size_t worker) const noexcept {
+        return worker % nodes.size();
+    }
+
+    /** @brief Gets the CPU a worker should be pinned to.
+     *
+     * The CPU belongs to the node returned by worker_node().
+     */
+    unsigned int worker_cpu(std::size_t worker) const noexcept {
+        auto &nd = nodes[worker_node(worker)];
+        return nd.cpus[(worker / nodes.size()) % nd.cpus.size()];
+    }
+
+    /** @brief Gets node indexes ordered by distance from the given node.
+     *
+     * The first index is always the node itself. This is the order in
+     * which schedulers look for work when their own node has none.
+     */
+    std::vector<std::size_t> node_order(std::size_t node) const;
+};
+
+/** @brief Describes how pools and schedulers place their worker threads.
+ *
+ * By default, nothing special is done and the OS is free to move the
+ * threads around. This is the cheapest option on single socket systems.
+ */
+struct worker_placement {
+    /** @brief Whether to pin each worker thread to a single CPU. */
+    bool pin = false;
+
+    /** @brief Whether to use NUMA aware scheduling.
+     *
+     * When enabled, coroutine schedulers keep a separate run queue and
+     * a separate stack pool for every node. A worker prefers tasks from
+     * its own node and takes work from other nodes nearest first. The
+     * stack memory is bound to the node as well.
+     */
+    bool numa = false;
+};
+
+/** @brief Pins the calling thread to the given CPU.
+ *
+ * @returns `true` on success, `false` if not supported or failed.
+ */
+OSTD_EXPORT bool pin_current_thread(unsigned int cpu) noexcept;
+
+/** @brief Binds a page-aligned memory range to a NUMA node.
+ *
+ * The pages are preferably allocated on the node once touched. The node
+ * is the OS node number (cpu_node::id).
+ *
+ * @returns `true` on success, `false` if not supported or failed.
+ */
+OSTD_EXPORT bool bind_memory_node(
+    void *p, std::size_t size, std::size_t node
+) noexcept;
+
+/** @} */
+
+} /* namespace ostd */
+
+#endif
+
+/** @} */
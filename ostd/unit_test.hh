@@ -58,7 +58,7 @@ namespace detail {
     struct test_error {};
 }
 
-#define OSTD_TEST_FUNC_CONCAT(p, m, l) p##_##m##_##line
+#define OSTD_TEST_FUNC_CONCAT(p, m, l) p##_##m##_##l
 #define OSTD_TEST_FUNC_NAME(p, m, l) OSTD_TEST_FUNC_CONCAT(p, m, l)
 
 /** @brief Defines a unit test.
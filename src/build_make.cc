@@ -3,7 +3,11 @@
  * This file is part of libostd. See COPYING.md for futher information.
  */
 
+#include <cstring>
+#include <algorithm>
+
 #include "ostd/build/make.hh"
+#include "ostd/build/make_watcher.hh"
 
 namespace ostd {
 namespace build {
@@ -14,27 +18,25 @@ OSTD_EXPORT make_task::~make_task() {}
 static bool check_exec(
     string_range tname, std::vector<string_range> const &deps
 ) {
-    if (!fs::exists(tname)) {
-        return true;
-    }
-    for (auto &dep: deps) {
-        if (!fs::exists(dep)) {
-            return true;
-        }
-    }
-    auto get_ts = [](string_range fname) {
-        path p{fname};
-        if (!fs::is_regular_file(p)) {
+    /* a single stat per file tells both existence and time */
+    auto get_ts = [](string_range fname, bool &exists) {
+        auto st = fs::status(path{fname});
+        exists = fs::exists(st.mode());
+        if (!fs::is_regular_file(st.mode())) {
             return fs::file_time_t{};
         }
-        return fs::last_write_time(p);
+        return st.last_write_time();
     };
-    auto tts = get_ts(tname);
+    bool exists;
+    auto tts = get_ts(tname, exists);
     if (tts == fs::file_time_t{}) {
         return true;
     }
     for (auto &dep: deps) {
-        auto sts = get_ts(dep);
+        auto sts = get_ts(dep, exists);
+        if (!exists) {
+            return true;
+        }
         if ((sts != fs::file_time_t{}) && (tts < sts)) {
             return true;
         }
@@ -86,17 +88,15 @@ static string_range match_pattern(
 
 OSTD_EXPORT std::pair<
     std::size_t, std::size_t
-> make_pattern::match(string_range target) {
+> make_pattern::match(string_range target, string_range &sub) const {
     using PT = std::pair<std::size_t, std::size_t>;
 
-    string_range sub = match_pattern(target, p_target);
-    p_subs.clear();
+    sub = match_pattern(target, p_target);
 
     std::size_t subl = sub.size();
     if (subl == 0) {
         return PT{0, 0};
     }
-    p_subs.push_back(sub);
 
     std::size_t tarl = target.size();
     if (subl == tarl) {
@@ -105,58 +105,215 @@ OSTD_EXPORT std::pair<
     return PT{target.data() + tarl - sub.data() - subl, subl};
 }
 
-OSTD_EXPORT std::string make_pattern::replace(string_range dep) const {
-    if (p_subs.empty()) {
-        return std::string{dep};
+OSTD_EXPORT std::pair<
+    std::size_t, std::size_t
+> make_pattern::match(string_range target) {
+    string_range sub;
+    auto ret = match(target, sub);
+    p_subs.clear();
+    if (!sub.empty()) {
+        p_subs.push_back(sub);
+    }
+    return ret;
+}
+
+OSTD_EXPORT string_range make_pattern::replace(
+    string_range dep, string_range sub, std::string &buf
+) const {
+    if (sub.empty()) {
+        return dep;
     }
     auto lp = ostd::find(dep, '%');
     if (lp.empty()) {
-        return std::string{dep};
+        return dep;
     }
-    auto ret = std::string{dep.slice(0, &lp[0] - &dep[0])};
-    ret.append(p_subs[0]);
+    buf.assign(dep.data(), std::size_t(&lp[0] - &dep[0]));
+    buf.append(sub);
     lp.pop_front();
-    ret.append(lp);
-    return ret;
+    buf.append(lp);
+    return buf;
 }
 
-void make::exec_rlist(string_range tname, std::vector<rule_inst> const &rlist) {
-    std::vector<string_range> rdeps;
-    if ((rlist.size() > 1) || !rlist[0].deps.empty()) {
-        wait_for([&rlist, &rdeps, &tname, this]() {
-            for (auto &sr: rlist) {
-                for (auto &tgt: sr.deps) {
-                    rdeps.push_back(tgt);
-                    exec_rule(tgt, tname);
+OSTD_EXPORT std::string make_pattern::replace(string_range dep) const {
+    std::string buf;
+    string_range sub = p_subs.empty() ? string_range{} : p_subs[0];
+    auto ret = replace(dep, sub, buf);
+    if (ret.data() != buf.data()) {
+        return std::string{ret};
+    }
+    return buf;
+}
+
+namespace detail {
+    OSTD_EXPORT void make_rule_index::add(
+        string_range pattern, std::size_t idx
+    ) {
+        auto rep = ostd::find(pattern, '%');
+        if (rep.empty()) {
+            auto it = p_exact.find(pattern);
+            if (it == p_exact.end()) {
+                /* the keys are views, so keep the names at stable places */
+                p_names.emplace_back(pattern);
+                it = p_exact.emplace(
+                    string_range{p_names.back()}, std::vector<std::size_t>{}
+                ).first;
+            }
+            it->second.push_back(idx);
+            return;
+        }
+        auto pfx = pattern.slice(0, &rep[0] - &pattern[0]);
+        /* like in matching, only the first % is special */
+        rep.pop_front();
+        std::size_t sn = trie_insert(p_suffixes, rep, true);
+        if (p_suffixes[sn].items.empty()) {
+            p_suffixes[sn].items.push_back(p_prefixes.size());
+            p_prefixes.emplace_back(1);
+        }
+        auto &pt = p_prefixes[p_suffixes[sn].items[0]];
+        std::size_t pn = trie_insert(pt, pfx, false);
+        pt[pn].items.push_back(idx);
+    }
+
+    OSTD_EXPORT void make_rule_index::find(
+        string_range target, std::vector<std::size_t> &out
+    ) const {
+        out.clear();
+        if (auto it = p_exact.find(target); it != p_exact.end()) {
+            out.insert(out.end(), it->second.begin(), it->second.end());
+        }
+        std::size_t ts = target.size();
+        /* every suffix node on the way holds patterns ending with the
+         * same suffix as the target, then the same goes for prefixes
+         */
+        std::size_t sn = 0;
+        for (std::size_t si = 0;;) {
+            if (!p_suffixes[sn].items.empty()) {
+                auto &pt = p_prefixes[p_suffixes[sn].items[0]];
+                std::size_t pn = 0;
+                for (std::size_t pi = 0;;) {
+                    auto &its = pt[pn].items;
+                    out.insert(out.end(), its.begin(), its.end());
+                    if (pi == ts) {
+                        break;
+                    }
+                    if (!(pn = trie_next(pt, pn, target[pi++]))) {
+                        break;
+                    }
                 }
             }
-        });
+            if (si == ts) {
+                break;
+            }
+            if (!(sn = trie_next(p_suffixes, sn, target[ts - ++si]))) {
+                break;
+            }
+        }
+        std::sort(out.begin(), out.end());
     }
-    make_rule *rl = nullptr;
-    for (auto &sr: rlist) {
-        if (sr.rule->has_body()) {
-            rl = sr.rule;
-            break;
+
+    std::size_t make_rule_index::trie_insert(
+        trie &t, string_range key, bool rev
+    ) {
+        std::size_t n = 0;
+        for (std::size_t i = 0; i < key.size(); ++i) {
+            char c = rev ? key[key.size() - i - 1] : key[i];
+            std::size_t nn = trie_next(t, n, c);
+            if (!nn) {
+                nn = t.size();
+                t.emplace_back();
+                t[n].next.emplace_back(c, nn);
+            }
+            n = nn;
         }
+        return n;
     }
-    if (rl && (rl->action() || check_exec(tname, rdeps))) {
-        std::unique_ptr<make_task> t{
-            p_factory(tname, std::move(rdeps), *rl)
-        };
-        p_current = t.get();
-        t->resume();
-        if (!t->done()) {
-            p_waiting.top()->push(std::move(t));
+
+    /* the root is never a child, so zero means there is no such child */
+    std::size_t make_rule_index::trie_next(
+        trie const &t, std::size_t n, char c
+    ) {
+        for (auto &p: t[n].next) {
+            if (p.first == c) {
+                return p.second;
+            }
+        }
+        return 0;
+    }
+} /* namespace detail */
+
+make::rule_list &make::rule_cache::get(string_range name, bool *claimed) {
+    auto &sh = p_shards[std::hash<string_range>{}(name) % nshards];
+    std::lock_guard<std::mutex> l{sh.mtx};
+    auto it = sh.lists.find(name);
+    if (it == sh.lists.end()) {
+        if (sh.left < name.size()) {
+            /* the rest of the block is lost, which is not much */
+            std::size_t bsize = std::max(name.size(), std::size_t(64 * 1024));
+            sh.blocks.push_back(std::make_unique<char[]>(bsize));
+            sh.cur = sh.blocks.back().get();
+            sh.left = bsize;
+        }
+        string_range iname{sh.cur, sh.cur + name.size()};
+        if (!name.empty()) {
+            std::memcpy(sh.cur, name.data(), name.size());
+        }
+        sh.cur += name.size();
+        sh.left -= name.size();
+        it = sh.lists.try_emplace(iname).first;
+        it->second.name = iname;
+    }
+    if (claimed) {
+        *claimed = !it->second.queued;
+        if (*claimed) {
+            it->second.queued = true;
+            p_taken.store(true, std::memory_order_relaxed);
         }
     }
+    return it->second;
 }
 
-void make::exec_rule(string_range target, string_range from) {
-    std::vector<rule_inst> &rlist = p_cache[target];
-    find_rules(target, rlist);
+OSTD_EXPORT void make::rule_cache::invalidate() {
+    if (!p_taken.load(std::memory_order_relaxed)) {
+        return;
+    }
+    for (auto &sh: p_shards) {
+        std::lock_guard<std::mutex> l{sh.mtx};
+        for (auto &p: sh.lists) {
+            p.second = rule_list{p.first};
+        }
+    }
+    p_taken.store(false, std::memory_order_relaxed);
+}
+
+std::size_t make::plan(rule_list &rl, string_range from) {
+    string_range target = rl.name;
+    if (auto it = p_nodemap.find(target); it != p_nodemap.end()) {
+        if (p_nodes[it->second].visiting) {
+            throw make_error{"dependency cycle at '%s'", target};
+        }
+        return it->second;
+    }
+    std::size_t idx = p_nodes.size();
+    p_nodes.emplace_back();
+    p_nodes[idx].name = target;
+    p_nodemap.emplace(target, idx);
+    if (!rl.resolved) {
+        /* left over by a resolve() that was interrupted */
+        resolve_buf buf;
+        rl.queued = true;
+        find_rules(rl, buf);
+    }
+    if (rl.error) {
+        auto err = rl.error;
+        /* try again next time */
+        rl = rule_list{target};
+        std::rethrow_exception(err);
+    }
+    std::vector<rule_inst> &rlist = rl.rules;
     if (rlist.empty()) {
         if (fs::exists(target)) {
-            return;
+            p_order.push_back(idx);
+            return idx;
         }
         if (from.empty()) {
             throw make_error{"no rule to exec target '%s'", target};
@@ -166,27 +323,528 @@ void make::exec_rule(string_range target, string_range from) {
             };
         }
     }
-    exec_rlist(target, rlist);
+    /* the node vector may move while recursing, so always index it */
+    p_nodes[idx].rlist = &rlist;
+    p_nodes[idx].visiting = true;
+    for (auto &sr: rlist) {
+        for (auto *dep: sr.deps) {
+            std::size_t didx = plan(*dep, target);
+            p_nodes[didx].dependents.push_back(idx);
+        }
+    }
+    p_nodes[idx].visiting = false;
+    p_order.push_back(idx);
+    return idx;
+}
+
+void make::prioritize(std::vector<bool> const *affected) {
+    /* the targets that were not built before get the average time */
+    double known = 0.0;
+    std::size_t nknown = 0;
+    for (std::size_t idx = 0; idx < p_nodes.size(); ++idx) {
+        auto &nd = p_nodes[idx];
+        if (!nd.rlist || !p_db || (affected && !(*affected)[idx])) {
+            continue;
+        }
+        auto t = p_db->time(nd.name).count();
+        if (t > 0) {
+            nd.cost = double(t);
+            known += nd.cost;
+            ++nknown;
+        }
+    }
+    double unknown = nknown ? (known / double(nknown)) : 1.0;
+    double crit = 0.0;
+    /* dependents always come after their dependencies in the order */
+    for (auto it = p_order.rbegin(); it != p_order.rend(); ++it) {
+        if (affected && !(*affected)[*it]) {
+            continue;
+        }
+        auto &nd = p_nodes[*it];
+        if (nd.rlist && (nd.cost == 0.0)) {
+            nd.cost = unknown;
+        }
+        double next = 0.0;
+        for (auto didx: nd.dependents) {
+            next = std::max(next, p_nodes[didx].prio);
+        }
+        nd.prio = nd.cost + next;
+        crit = std::max(crit, nd.prio);
+    }
+    if (nknown) {
+        p_stats.critical_path = std::chrono::nanoseconds{
+            std::int64_t(crit)
+        };
+    }
+}
+
+make_rule *make::body_rule(graph_node const &nd) {
+    for (auto &sr: *nd.rlist) {
+        if (sr.rule->has_body()) {
+            return sr.rule;
+        }
+    }
+    return nullptr;
+}
+
+bool make::start_node(std::size_t idx, running_task &rt) {
+    auto &nd = p_nodes[idx];
+    if (!nd.rlist) {
+        return false;
+    }
+    auto *rl = body_rule(nd);
+    if (!rl) {
+        return false;
+    }
+    std::vector<string_range> rdeps;
+    for (auto &sr: *nd.rlist) {
+        for (auto *dep: sr.deps) {
+            rdeps.push_back(dep->name);
+        }
+    }
+    rt.depfile = rl->depfile(nd.name);
+    bool run = rl->action();
+    if (!run) {
+        /* include what the previous build found out about the target */
+        std::vector<std::string> buf;
+        std::vector<string_range> chk;
+        auto *found = found_deps(nd.name, rt.depfile, buf);
+        if (found) {
+            chk.reserve(rdeps.size() + found->size());
+            chk = rdeps;
+            for (auto &d: *found) {
+                chk.emplace_back(d);
+            }
+        }
+        auto &cdeps = found ? chk : rdeps;
+        if (p_db) {
+            run = db_check(nd.name, cdeps, *rl, rt.pend);
+            rt.rec = true;
+        } else {
+            run = check_exec(nd.name, cdeps);
+        }
+    }
+    if (!run) {
+        return false;
+    }
+    rt.node = idx;
+    if (rt.rec && !rt.depfile.empty()) {
+        rt.deps = rdeps;
+    }
+    rt.start = std::chrono::steady_clock::now();
+    rt.stamp = std::chrono::system_clock::now();
+    if (rt.rec && p_acache && cache_restore(rt, rdeps)) {
+        if (p_trace) {
+            p_trace->complete(
+                "cache", nd.name, nd.ready, rt.start,
+                std::chrono::steady_clock::now()
+            );
+        }
+        return false;
+    }
+    if (p_trace) {
+        auto it = std::find(p_lanes.begin(), p_lanes.end(), false);
+        rt.lane = std::size_t(it - p_lanes.begin());
+        if (it == p_lanes.end()) {
+            p_lanes.push_back(true);
+        } else {
+            *it = true;
+        }
+    }
+    rt.task.reset(p_factory(nd.name, std::move(rdeps), *rl));
+    ++p_stats.executed;
+    return true;
 }
 
-void make::find_rules(string_range target, std::vector<rule_inst> &rlist) {
-    if (!rlist.empty()) {
+bool make::resume_task(running_task &rt) {
+    using clock = std::chrono::steady_clock;
+    auto start = clock::now();
+    p_current = rt.task.get();
+    p_current_name = p_nodes[rt.node].name;
+    try {
+        rt.task->resume();
+    } catch (...) {
+        p_busy += (clock::now() - start).count();
+        throw;
+    }
+    p_busy += (clock::now() - start).count();
+    return rt.task->done();
+}
+
+void make::task_done(running_task &rt) {
+    auto now = std::chrono::steady_clock::now();
+    auto &nd = p_nodes[rt.node];
+    if (p_trace) {
+        p_trace->complete(
+            rt.lane, "target", nd.name, nd.ready, rt.start, now
+        );
+        p_lanes[rt.lane] = false;
+    }
+    if (!p_db) {
         return;
     }
-    rule_inst *frule = nullptr;
+    auto name = nd.name;
+    p_db->record_time(name, now - rt.start);
+    /* no depfile means nothing was discovered */
+    std::vector<std::string> found;
+    if (!rt.depfile.empty()) {
+        read_depfile(rt.depfile, found);
+    }
+    if (rt.key && p_acache->store(rt.key, *p_db, name, found)) {
+        ++p_stats.cache_stored;
+    }
+    record_done(rt, rt.depfile.empty() ? nullptr : &found);
+}
+
+void make::record_done(running_task &rt, std::vector<std::string> *found) {
+    auto name = p_nodes[rt.node].name;
+    if (found) {
+        if (rt.rec) {
+            /* the next check will include these */
+            for (auto &d: *found) {
+                rt.deps.emplace_back(d);
+            }
+            rt.pend.entry.inputs = p_db->files_hash(rt.deps);
+            /* one changed while the task was running, so what it was
+             * built from is not known and it has to be run again
+             */
+            for (auto &d: *found) {
+                auto st = fs::status(path{d});
+                if (
+                    fs::is_regular_file(st.mode()) &&
+                    !(st.last_write_time() < rt.stamp)
+                ) {
+                    rt.pend.entry.inputs = 0;
+                    break;
+                }
+            }
+        }
+        p_db->record_deps(name, std::move(*found));
+    }
+    if (rt.rec) {
+        rt.pend.entry.output = p_db->file_hash(name);
+        p_db->record(name, rt.pend.entry);
+    }
+}
+
+bool make::cache_restore(
+    running_task &rt, std::vector<string_range> const &rdeps
+) {
+    auto name = p_nodes[rt.node].name;
+    /* the discovered dependencies are checked by the cache itself */
+    make_hasher kh;
+    kh.update(name);
+    kh.update(&rt.pend.entry.command, sizeof(rt.pend.entry.command));
+    auto ih = p_db->files_hash(rdeps);
+    kh.update(&ih, sizeof(ih));
+    std::uint64_t key = kh.digest();
+    std::vector<std::string> found;
+    if (p_acache->restore(key, *p_db, name, found)) {
+        ++p_stats.cache_hits;
+        record_done(rt, rt.depfile.empty() ? nullptr : &found);
+        return true;
+    }
+    ++p_stats.cache_misses;
+    rt.key = key;
+    /* the body must not write into a file shared with the cache */
+    make_cache::detach(name);
+    return false;
+}
+
+void make::queue_nodes(std::vector<bool> const *affected) {
+    auto queued = [affected](std::size_t idx) {
+        return !affected || (*affected)[idx];
+    };
+    for (auto idx: p_order) {
+        if (queued(idx)) {
+            p_nodes[idx].npending = 0;
+        }
+    }
+    /* the dependents of a queued node are always queued too */
+    for (auto idx: p_order) {
+        if (!queued(idx)) {
+            continue;
+        }
+        ++p_stats.targets;
+        for (auto didx: p_nodes[idx].dependents) {
+            ++p_nodes[didx].npending;
+        }
+    }
+    for (auto idx: p_order) {
+        if (queued(idx) && !p_nodes[idx].npending) {
+            node_ready(idx);
+        }
+    }
+}
+
+void make::node_ready(std::size_t idx) {
+    auto &nd = p_nodes[idx];
+    if (p_trace) {
+        nd.ready = std::chrono::steady_clock::now();
+    }
+    p_ready.emplace(nd.prio, -std::ptrdiff_t(idx));
+}
+
+void make::node_done(std::size_t idx) {
+    for (auto didx: p_nodes[idx].dependents) {
+        auto &dn = p_nodes[didx];
+        if (!--dn.npending) {
+            node_ready(didx);
+        }
+    }
+}
+
+void make::wait_woken(std::vector<make_task *> &woken) {
+    woken.clear();
+    std::unique_lock<std::mutex> lk{p_mtx};
+    while (p_woken.empty()) {
+        p_cond.wait(lk);
+    }
+    woken.swap(p_woken);
+}
+
+void make::run_graph() {
+    std::unordered_map<make_task *, running_task> running;
+    std::vector<make_task *> woken;
+    /* keep only so many tasks in flight, so that the ones with the higher
+     * priority do not end up queued behind everything that is ready
+     */
+    std::size_t limit = std::max(threads(), 1u);
+    try {
+        for (;;) {
+            while (!p_ready.empty() && (running.size() < limit)) {
+                auto idx = std::size_t(-p_ready.top().second);
+                p_ready.pop();
+                running_task rt;
+                if (!start_node(idx, rt)) {
+                    node_done(idx);
+                    continue;
+                }
+                if (resume_task(rt)) {
+                    task_done(rt);
+                    node_done(idx);
+                } else {
+                    auto *t = rt.task.get();
+                    running.emplace(t, std::move(rt));
+                }
+            }
+            if (running.empty()) {
+                if (p_ready.empty()) {
+                    break;
+                }
+                continue;
+            }
+            /* only resume the tasks that have something to do */
+            wait_woken(woken);
+            for (auto *t: woken) {
+                auto it = running.find(t);
+                if (it == running.end()) {
+                    /* woken more than once or already failed */
+                    continue;
+                }
+                bool done;
+                try {
+                    done = resume_task(it->second);
+                } catch (...) {
+                    running.erase(it);
+                    throw;
+                }
+                if (!done) {
+                    continue;
+                }
+                auto rt = std::move(it->second);
+                running.erase(it);
+                task_done(rt);
+                node_done(rt.node);
+            }
+        }
+    } catch (make_error const &) {
+        writeln("waiting for the remaining tasks to finish...");
+        /* wakeups may have been lost with the failure, so go over all */
+        woken.clear();
+        for (auto &p: running) {
+            woken.push_back(p.first);
+        }
+        for (;;) {
+            for (auto *t: woken) {
+                auto it = running.find(t);
+                if (it == running.end()) {
+                    continue;
+                }
+                try {
+                    p_current = t;
+                    p_current_name = p_nodes[it->second.node].name;
+                    t->resume();
+                    if (!t->done()) {
+                        continue;
+                    }
+                } catch (make_error const &) {
+                    /* no rethrow */
+                }
+                running.erase(it);
+            }
+            if (running.empty()) {
+                break;
+            }
+            wait_woken(woken);
+        }
+        throw;
+    }
+}
+
+std::vector<std::string> const *make::found_deps(
+    string_range tname, string_range depfile, std::vector<std::string> &buf
+) {
+    if (depfile.empty()) {
+        return nullptr;
+    }
+    if (p_db) {
+        if (auto *dd = p_db->deps(tname); dd) {
+            return dd;
+        }
+    }
+    /* built before without a database, or the database is new */
+    if (!read_depfile(depfile, buf)) {
+        return nullptr;
+    }
+    if (p_db) {
+        p_db->record_deps(tname, std::move(buf));
+        return p_db->deps(tname);
+    }
+    return &buf;
+}
+
+bool make::db_check(
+    string_range tname, std::vector<string_range> const &deps,
+    make_rule const &rl, db_pending &pend
+) {
+    make_hasher ch;
+    ch.update(rl.signature(tname));
+    pend.target = std::string{tname};
+    pend.entry.command = ch.digest();
+    pend.entry.inputs = p_db->files_hash(deps);
+    auto *te = p_db->target(tname);
+    if (!te) {
+        /* nothing known yet, so go by timestamps and remember the state */
+        if (check_exec(tname, deps)) {
+            return true;
+        }
+        pend.entry.output = p_db->file_hash(tname);
+        p_db->record(tname, pend.entry);
+        return false;
+    }
+    if (
+        (te->command != pend.entry.command) ||
+        (te->inputs != pend.entry.inputs)
+    ) {
+        return true;
+    }
+    /* rebuild targets that are gone or were modified by something else */
+    auto out = p_db->file_hash(tname);
+    return !out || (out != te->output);
+}
+
+make::rule_list &make::resolve(string_range target) {
+    std::vector<rule_list *> cur;
+    bool claimed;
+    auto &trl = p_cache.get(target, &claimed);
+    if (claimed) {
+        cur.push_back(&trl);
+    }
+    /* targets that are few enough are not worth the pool */
+    std::size_t nthr = p_serial ? 1 : threads();
+    std::size_t const min_chunk = 64;
+    std::vector<resolve_buf> bufs(std::max(nthr, std::size_t(1)));
+    std::vector<std::future<void>> futs;
+    while (!cur.empty()) {
+        /* expand a whole level of the graph at a time; every dependency
+         * is taken by the first one to find it, so it's only put in the
+         * next level once
+         */
+        std::size_t nchunks = std::min(nthr, cur.size() / min_chunk);
+        if (nchunks <= 1) {
+            nchunks = 1;
+            for (auto *rl: cur) {
+                find_rules(*rl, bufs[0]);
+            }
+        } else {
+            std::size_t csize = (cur.size() + nchunks - 1) / nchunks;
+            futs.clear();
+            for (std::size_t i = 0; i < nchunks; ++i) {
+                auto b = std::min(i * csize, cur.size());
+                auto e = std::min(b + csize, cur.size());
+                futs.push_back(p_tpool.push([this, &cur, &bufs, i, b, e]() {
+                    for (auto j = b; j < e; ++j) {
+                        find_rules(*cur[j], bufs[i]);
+                    }
+                }));
+            }
+            /* the chunks refer to the locals, so let all of them finish */
+            for (auto &f: futs) {
+                f.wait();
+            }
+            for (auto &f: futs) {
+                f.get();
+            }
+        }
+        cur.clear();
+        for (std::size_t i = 0; i < nchunks; ++i) {
+            auto &next = bufs[i].next;
+            cur.insert(cur.end(), next.begin(), next.end());
+            next.clear();
+        }
+    }
+    return trl;
+}
+
+void make::find_rules(rule_list &rl, resolve_buf &buf) {
+    /* errors are kept for plan(), so that they come in the same order as
+     * they would when resolving a target at a time
+     */
+    rl.rules.clear();
+    rl.error = nullptr;
+    try {
+        find_rules_impl(rl.name, rl.rules, buf);
+    } catch (make_error const &) {
+        rl.rules.clear();
+        rl.error = std::current_exception();
+    }
+    rl.resolved = true;
+}
+
+void make::find_rules_impl(
+    string_range target, std::vector<rule_inst> &rlist, resolve_buf &buf
+) {
+    /* an index, as adding more rules may move the list */
+    std::size_t frule = 0;
+    bool has_frule = false;
     std::size_t pfnl = 0, psubl = 0;
-    for (auto &rule: p_rules) {
+    /* the same as trying all the rules in order, but only the ones
+     * that have a chance to match are tried
+     */
+    buf.cands.clear();
+    p_index.find(target, buf.cands);
+    for (std::size_t idx: buf.cands) {
+        auto &rule = p_rules[idx];
         if (!rule.cond(target)) {
             continue;
         }
         auto &tgt = rule.target();
-        auto [fnl, subl] = tgt.match(target);
+        string_range sub;
+        auto [fnl, subl] = tgt.match(target, sub);
         if ((fnl + subl) > 0) {
             rlist.emplace_back();
             rule_inst &sr = rlist.back();
             sr.rule = &rule;
-            rule.depends(target, [&sr, &tgt](string_range d) {
-                sr.deps.push_back(tgt.replace(d));
+            rule.depends(target, buf.deps, [&](string_range d) {
+                bool claimed;
+                auto &drl = p_cache.get(
+                    tgt.replace(d, sub, buf.name), &claimed
+                );
+                if (claimed) {
+                    buf.next.push_back(&drl);
+                }
+                sr.deps.push_back(&drl);
             });
             if (!rule.has_body()) {
                 if (fnl != target.size()) {
@@ -194,18 +852,19 @@ void make::find_rules(string_range target, std::vector<rule_inst> &rlist) {
                 }
                 continue;
             }
-            if (frule) {
+            if (has_frule) {
                 if ((pfnl == fnl) && (psubl == subl)) {
                     throw make_error{"redefinition of rule '%s'", target};
                 }
                 if ((fnl > pfnl) || ((fnl == pfnl) && (subl < psubl))) {
-                    *frule = sr;
+                    rlist[frule] = sr;
                     pfnl = fnl;
                     psubl = subl;
                     rlist.pop_back();
                 }
             } else {
-                frule = &sr;
+                frule = rlist.size() - 1;
+                has_frule = true;
                 pfnl = fnl;
                 psubl = subl;
             }
@@ -213,76 +872,280 @@ void make::find_rules(string_range target, std::vector<rule_inst> &rlist) {
     }
 }
 
-void make::wait_rest(std::queue<std::unique_ptr<make_task>> &tasks) {
-    if (tasks.empty()) {
-        /* nothing to wait for, so return */
-        return;
+void make::run_build(
+    string_range target, std::vector<bool> const *affected
+) {
+    using clock = std::chrono::steady_clock;
+    auto start = clock::now();
+    p_stats = make_stats{};
+    p_stats.threads = threads();
+    p_busy = 0;
+    auto finish = [this, start, target]() {
+        p_stats.wall = clock::now() - start;
+        p_stats.busy = std::chrono::nanoseconds{p_busy.load()};
+        p_ready = decltype(p_ready){};
+        p_lanes.clear();
+        /* a failed target may leave some of its pushed tasks behind */
+        std::unique_lock<std::mutex> lk{p_mtx};
+        while (p_inflight) {
+            p_cond.wait(lk);
+        }
+        p_woken.clear();
+        lk.unlock();
+        if (p_trace) {
+            p_trace->complete("make", target, start, clock::now());
+            p_trace->flush();
+        }
+    };
+    try {
+        if (!affected) {
+            plan(resolve(target), nullptr);
+        }
+        prioritize(affected);
+        queue_nodes(affected);
+        if (p_trace) {
+            p_trace->complete("make", "plan", start, clock::now());
+        }
+        run_graph();
+    } catch (...) {
+        finish();
+        if (p_db) {
+            try {
+                p_db->flush();
+            } catch (...) {}
+        }
+        throw;
     }
-    /* cycle until tasks are done */
-    std::unique_lock<std::mutex> lk{p_mtx};
-    while (!p_avail) {
-        p_cond.wait(lk);
+    finish();
+    if (p_db) {
+        p_db->flush();
     }
-    std::queue<std::unique_ptr<make_task>> atasks;
-    while (!tasks.empty()) {
-        p_avail = false;
-        while (!tasks.empty()) {
-            try {
-                auto t = std::move(tasks.front());
-                tasks.pop();
-                p_current = t.get();
-                t->resume();
-                if (!t->done()) {
-                    /* still not dead, re-push */
-                    atasks.push(std::move(t));
-                }
-            } catch (make_error const &) {
-                writeln("waiting for the remaining tasks to finish...");
-                for (; !tasks.empty(); tasks.pop()) {
-                    try {
-                        auto t = std::move(tasks.front());
-                        tasks.pop();
-                        while (!t->done()) {
-                            p_current = t.get();
-                            t->resume();
-                        }
-                    } catch (make_error const &) {
-                        /* no rethrow */
-                    }
-                }
-                throw;
-            }
+    if (p_stats.cache_stored) {
+        p_acache->trim();
+    }
+}
+
+void make::clear_graph() {
+    p_nodes.clear();
+    p_nodemap.clear();
+    p_order.clear();
+}
+
+void make::watch_inputs(
+    make_watcher &w, watch_map &inputs, std::vector<bool> const &affected,
+    std::vector<std::string> *fresh
+) {
+    /* added again every time, as the watcher forgets the files of
+     * directories that were removed, which may have been recreated;
+     * after a build only the files it discovered are new to the watcher
+     */
+    auto add = [&w, &inputs, fresh](string_range name, std::size_t idx) {
+        auto [it, added] = inputs.try_emplace(std::string{name});
+        if (!fresh || added) {
+            w.add(name);
         }
-        if (atasks.empty()) {
-            break;
+        if (fresh && added) {
+            fresh->emplace_back(name);
         }
-        tasks.swap(atasks);
-        /* so we're not busylooping */
-        while (!p_avail) {
-            p_cond.wait(lk);
+        auto &nodes = it->second;
+        if (std::find(nodes.begin(), nodes.end(), idx) == nodes.end()) {
+            nodes.push_back(idx);
+        }
+    };
+    std::vector<std::string> buf;
+    for (auto idx: p_order) {
+        if (!affected[idx]) {
+            continue;
+        }
+        auto &nd = p_nodes[idx];
+        if (!nd.rlist) {
+            add(nd.name, idx);
+            continue;
+        }
+        auto *rl = body_rule(nd);
+        if (!rl) {
+            continue;
+        }
+        auto df = rl->depfile(nd.name);
+        buf.clear();
+        auto *found = found_deps(nd.name, df, buf);
+        if (!found) {
+            continue;
+        }
+        for (auto &d: *found) {
+            /* generated files change with the build itself */
+            auto it = p_nodemap.find(d);
+            if ((it != p_nodemap.end()) && p_nodes[it->second].rlist) {
+                continue;
+            }
+            add(d, idx);
         }
     }
 }
 
 OSTD_EXPORT void make::exec(string_range target) {
-    wait_for([&target, this]() {
-        exec_rule(target);
-    });
+    if (p_acache && !p_db) {
+        throw make_error{"the action cache needs a database"};
+    }
+    try {
+        run_build(target, nullptr);
+    } catch (...) {
+        clear_graph();
+        throw;
+    }
+    clear_graph();
+}
+
+OSTD_EXPORT void make::watch(
+    string_range target, std::function<bool(std::exception_ptr)> on_build,
+    std::chrono::milliseconds quiet
+) {
+    if (p_acache && !p_db) {
+        throw make_error{"the action cache needs a database"};
+    }
+    make_watcher w;
+    watch_map inputs;
+    std::vector<std::string> changed;
+    std::vector<std::string> fresh;
+    try {
+        plan(resolve(target), nullptr);
+        std::vector<bool> affected(p_nodes.size(), true);
+        for (;;) {
+            /* watched before building, so that the inputs edited while
+             * the build is running are not missed
+             */
+            watch_inputs(w, inputs, affected, nullptr);
+            auto start = std::chrono::system_clock::now();
+            std::exception_ptr err;
+            try {
+                run_build(target, &affected);
+            } catch (...) {
+                err = std::current_exception();
+            }
+            fresh.clear();
+            watch_inputs(w, inputs, affected, &fresh);
+            if (!on_build(err)) {
+                break;
+            }
+            /* a failed build may not have got to some of the targets,
+             * so they are checked again along with the changed ones
+             */
+            if (!err) {
+                std::fill(affected.begin(), affected.end(), false);
+            }
+            /* the build found out about these as it went, so the watcher
+             * did not see them change before now, but their times do
+             */
+            bool any = false;
+            for (auto &f: fresh) {
+                auto st = fs::status(path{f});
+                if (
+                    fs::exists(st.mode()) && (st.last_write_time() < start)
+                ) {
+                    continue;
+                }
+                for (auto idx: inputs[f]) {
+                    affected[idx] = true;
+                    any = true;
+                }
+            }
+            while (!any) {
+                w.wait(changed, quiet);
+                for (auto &f: changed) {
+                    auto it = inputs.find(f);
+                    if (it == inputs.end()) {
+                        continue;
+                    }
+                    for (auto idx: it->second) {
+                        affected[idx] = true;
+                        any = true;
+                    }
+                }
+            }
+            /* everything downstream, dependents come later in the order */
+            for (auto idx: p_order) {
+                if (!affected[idx]) {
+                    continue;
+                }
+                for (auto didx: p_nodes[idx].dependents) {
+                    affected[didx] = true;
+                }
+            }
+        }
+    } catch (...) {
+        clear_graph();
+        throw;
+    }
+    clear_graph();
 }
 
 OSTD_EXPORT std::shared_future<void> make::push_task(
     std::function<void()> func
 ) {
-    return p_current->add_task(
-        p_tpool.push([func = std::move(func), this]() {
-            func();
-            {
-                std::lock_guard<std::mutex> l{p_mtx};
-                p_avail = true;
+    using clock = std::chrono::steady_clock;
+    auto *t = p_current;
+    auto *js = p_jobs.get();
+    auto *tr = p_trace.get();
+    /* only copied when tracing, the pushing target may finish first */
+    std::string tname;
+    clock::time_point queued{};
+    if (tr) {
+        tname = std::string{p_current_name};
+        queued = clock::now();
+    }
+    /* the future has to be ready by the time the task is woken up, which
+     * is not the case with the one of the pool until the function returns
+     */
+    std::promise<void> pr;
+    auto f = pr.get_future();
+    {
+        std::lock_guard<std::mutex> l{p_mtx};
+        ++p_inflight;
+    }
+    try {
+        p_tpool.push([
+            func = std::move(func), pr = std::move(pr), t, js, tr,
+            tname = std::move(tname), queued, this
+        ]() mutable {
+            auto start = clock::now();
+            try {
+                /* with a jobserver, the pool threads only ever run as many
+                 * tasks at once as the tokens we manage to get
+                 */
+                int tok = js ? js->acquire() : 0;
+                start = clock::now();
+                try {
+                    func();
+                } catch (...) {
+                    if (js) {
+                        js->release(tok);
+                    }
+                    throw;
+                }
+                if (js) {
+                    js->release(tok);
+                }
+                pr.set_value();
+            } catch (...) {
+                pr.set_exception(std::current_exception());
+            }
+            auto end = clock::now();
+            p_busy += (end - start).count();
+            if (tr) {
+                tr->complete("task", tname, queued, start, end);
             }
+            /* notify under the lock, exec() may return right after */
+            std::lock_guard<std::mutex> l{p_mtx};
+            p_woken.push_back(t);
+            --p_inflight;
             p_cond.notify_one();
-        })
-    );
+        });
+    } catch (...) {
+        std::lock_guard<std::mutex> l{p_mtx};
+        --p_inflight;
+        throw;
+    }
+    return t->add_task(std::move(f));
 }
 
 } /* namespace build */
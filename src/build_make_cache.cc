@@ -0,0 +1,332 @@
+/* Build cache implementation bits.
+ *
+ * This file is part of libostd. See COPYING.md for futher information.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cerrno>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "ostd/platform.hh"
+
+#ifdef OSTD_PLATFORM_POSIX
+#  include <fcntl.h>
+#  include <unistd.h>
+#  include <sys/ioctl.h>
+#  include <sys/stat.h>
+#  ifdef __linux__
+#    include <linux/fs.h>
+#  endif
+#endif
+
+#include "ostd/format.hh"
+#include "ostd/io.hh"
+#include "ostd/serialize.hh"
+#include "ostd/build/make_cache.hh"
+
+namespace ostd {
+namespace build {
+
+static constexpr std::uint32_t cache_version = 1;
+/* the results kept for every invocation */
+static constexpr std::size_t cache_max_entries = 8;
+
+/* makes dst a new file with the contents of src, sharing the data with
+ * it where possible; links are only used when asked for, as the files
+ * then share everything including their metadata
+ */
+static bool cache_clone(
+    std::string const &src, std::string const &dst, bool use_link
+) {
+#ifdef OSTD_PLATFORM_POSIX
+    int sfd = ::open(src.data(), O_RDONLY | O_CLOEXEC);
+    if (sfd < 0) {
+        return false;
+    }
+    struct stat sb;
+    int dfd = -1;
+    if (!fstat(sfd, &sb)) {
+        dfd = ::open(
+            dst.data(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+            sb.st_mode & 0777
+        );
+    }
+    if (dfd < 0) {
+        ::close(sfd);
+        return false;
+    }
+    bool ok = false;
+#  ifdef FICLONE
+    ok = !ioctl(dfd, FICLONE, sfd);
+#  endif
+    if (!ok && use_link) {
+        ::close(dfd);
+        ::unlink(dst.data());
+        if (!::link(src.data(), dst.data())) {
+            ::close(sfd);
+            return true;
+        }
+        dfd = ::open(
+            dst.data(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+            sb.st_mode & 0777
+        );
+        if (dfd < 0) {
+            ::close(sfd);
+            return false;
+        }
+    }
+    char buf[64 * 1024];
+    while (!ok) {
+        auto n = ::read(sfd, buf, sizeof(buf));
+        if (!n) {
+            ok = true;
+            break;
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        char const *p = buf;
+        while (n > 0) {
+            auto w = ::write(dfd, p, std::size_t(n));
+            if (w < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+            p += w;
+            n -= w;
+        }
+        if (n) {
+            break;
+        }
+    }
+    ::close(sfd);
+    if (::close(dfd)) {
+        ok = false;
+    }
+    if (!ok) {
+        ::unlink(dst.data());
+    }
+    return ok;
+#else
+    static_cast<void>(use_link);
+    file_stream sf{src};
+    if (!sf.is_open()) {
+        return false;
+    }
+    try {
+        file_stream df{dst, stream_mode::WRITE};
+        if (!df.is_open()) {
+            return false;
+        }
+        char buf[64 * 1024];
+        for (std::size_t n; (n = sf.read_bytes(buf, sizeof(buf)));) {
+            df.write_bytes(buf, n);
+        }
+    } catch (stream_error const &) {
+        fs::remove(ostd::path{dst});
+        return false;
+    }
+    return true;
+#endif
+}
+
+OSTD_EXPORT make_cache::make_cache(string_range dir, std::uint64_t max_size):
+    p_dir{dir}, p_max{max_size}
+{
+    fs::create_directories(p_dir);
+}
+
+ostd::path make_cache::object_path(std::uint64_t hash) const {
+    auto name = format_to_string("%016x", hash);
+    return p_dir / "o" / name.substr(0, 2) / name;
+}
+
+ostd::path make_cache::manifest_path(std::uint64_t key) const {
+    auto name = format_to_string("%016x", key);
+    return p_dir / "a" / name.substr(0, 2) / name;
+}
+
+std::string make_cache::temp_name(ostd::path const &p) {
+    /* unique enough for other processes sharing the cache */
+    auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+    return format_to_string(
+        "%s.%x.%d.tmp", p.string(), std::uint64_t(now), ++p_ntemp
+    );
+}
+
+bool make_cache::read_manifest(
+    ostd::path const &p, std::vector<entry> &ents
+) {
+    file_stream f{p.string()};
+    if (!f.is_open()) {
+        return false;
+    }
+    try {
+        binary_reader rd{f};
+        if (rd.get<std::uint32_t>() != cache_version) {
+            return false;
+        }
+        auto n = rd.get<std::uint64_t>();
+        for (; n; --n) {
+            entry e;
+            rd.get(e.deps, e.deps_hash, e.output);
+            ents.push_back(std::move(e));
+        }
+    } catch (stream_error const &) {
+        ents.clear();
+        return false;
+    }
+    return true;
+}
+
+OSTD_EXPORT bool make_cache::restore(
+    std::uint64_t key, make_db &db, string_range target,
+    std::vector<std::string> &deps
+) {
+    std::vector<entry> ents;
+    if (!read_manifest(manifest_path(key), ents)) {
+        return false;
+    }
+    /* the most recent results are at the end */
+    for (auto it = ents.rbegin(); it != ents.rend(); ++it) {
+        if (db.files_hash(it->deps) != it->deps_hash) {
+            continue;
+        }
+        auto obj = object_path(it->output);
+        std::string tname{target};
+        auto tmp = temp_name(tname);
+        /* it may have been evicted */
+        if (!cache_clone(obj.string(), tmp, true)) {
+            return false;
+        }
+        try {
+            fs::rename(tmp, tname);
+            /* the times are used for eviction */
+            fs::last_write_time(obj, std::chrono::system_clock::now());
+        } catch (fs::fs_error const &) {
+            fs::remove(tmp);
+            return false;
+        }
+        deps = it->deps;
+        return true;
+    }
+    return false;
+}
+
+OSTD_EXPORT bool make_cache::store(
+    std::uint64_t key, make_db &db, string_range target,
+    std::vector<std::string> const &deps
+) {
+    auto out = db.file_hash(target);
+    if (!out) {
+        return false;
+    }
+    try {
+        auto obj = object_path(out);
+        if (!fs::exists(fs::status(obj).mode())) {
+            fs::create_directories(obj.parent());
+            auto tmp = temp_name(obj);
+            if (!cache_clone(std::string{target}, tmp, false)) {
+                return false;
+            }
+            fs::rename(tmp, obj);
+        }
+        auto mpath = manifest_path(key);
+        std::vector<entry> ents;
+        read_manifest(mpath, ents);
+        auto dh = db.files_hash(deps);
+        ents.erase(std::remove_if(
+            ents.begin(), ents.end(), [&deps, dh](entry const &e) {
+                return (e.deps_hash == dh) && (e.deps == deps);
+            }
+        ), ents.end());
+        ents.push_back(entry{deps, dh, out});
+        if (ents.size() > cache_max_entries) {
+            ents.erase(
+                ents.begin(), ents.end() - std::ptrdiff_t(cache_max_entries)
+            );
+        }
+        fs::create_directories(mpath.parent());
+        auto tmp = temp_name(mpath);
+        {
+            file_stream f{tmp, stream_mode::WRITE};
+            if (!f.is_open()) {
+                return false;
+            }
+            binary_writer w{f};
+            w.put(cache_version, std::uint64_t(ents.size()));
+            for (auto &e: ents) {
+                w.put(e.deps, e.deps_hash, e.output);
+            }
+            w.flush();
+        }
+        fs::rename(tmp, mpath);
+    } catch (fs::fs_error const &) {
+        return false;
+    } catch (stream_error const &) {
+        return false;
+    }
+    return true;
+}
+
+OSTD_EXPORT void make_cache::detach(string_range target) {
+    auto st = fs::status(ostd::path{target});
+    if (fs::is_regular_file(st.mode()) && (st.hard_link_count() > 1)) {
+        fs::remove(ostd::path{target});
+    }
+}
+
+OSTD_EXPORT std::uint64_t make_cache::trim() {
+    struct item {
+        fs::file_time_t time;
+        std::uint64_t size;
+        ostd::path path;
+    };
+    std::vector<item> items;
+    std::uint64_t total = 0;
+    try {
+        for (auto &de: fs::recursive_directory_range{p_dir}) {
+            auto st = fs::status(de.path());
+            if (!fs::is_regular_file(st.mode())) {
+                continue;
+            }
+            items.push_back(item{st.last_write_time(), st.size(), de.path()});
+            total += st.size();
+        }
+    } catch (fs::fs_error const &) {
+        return 0;
+    }
+    if (total <= p_max) {
+        return 0;
+    }
+    std::sort(items.begin(), items.end(), [](item const &a, item const &b) {
+        return a.time < b.time;
+    });
+    std::uint64_t goal = p_max / 10 * 9, removed = 0;
+    for (auto &it: items) {
+        if (total <= goal) {
+            break;
+        }
+        try {
+            fs::remove(it.path);
+        } catch (fs::fs_error const &) {
+            continue;
+        }
+        total -= it.size;
+        removed += it.size;
+    }
+    return removed;
+}
+
+} /* namespace build */
+} /* namespace ostd */
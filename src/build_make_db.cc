@@ -0,0 +1,565 @@
+/* Build database implementation bits.
+ *
+ * This file is part of libostd. See COPYING.md for futher information.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <chrono>
+#include <string>
+
+#include "ostd/platform.hh"
+
+#ifdef OSTD_PLATFORM_POSIX
+#  include <fcntl.h>
+#  include <unistd.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#endif
+
+#include "ostd/path.hh"
+#include "ostd/memory_stream.hh"
+#include "ostd/build/make_db.hh"
+
+namespace ostd {
+namespace build {
+
+/* xxhash64 */
+
+static constexpr std::uint64_t xxh_p1 = 0x9E3779B185EBCA87ULL;
+static constexpr std::uint64_t xxh_p2 = 0xC2B2AE3D27D4EB4FULL;
+static constexpr std::uint64_t xxh_p3 = 0x165667B19E3779F9ULL;
+static constexpr std::uint64_t xxh_p4 = 0x85EBCA77C2B2AE63ULL;
+static constexpr std::uint64_t xxh_p5 = 0x27D4EB2F165667C5ULL;
+
+static inline std::uint64_t xxh_rotl(std::uint64_t x, int r) noexcept {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline std::uint64_t xxh_read64(unsigned char const *p) noexcept {
+    std::uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return from_lil_endian<std::uint64_t>{}(v);
+}
+
+static inline std::uint32_t xxh_read32(unsigned char const *p) noexcept {
+    std::uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return from_lil_endian<std::uint32_t>{}(v);
+}
+
+static inline std::uint64_t xxh_round(
+    std::uint64_t acc, std::uint64_t in
+) noexcept {
+    return xxh_rotl(acc + in * xxh_p2, 31) * xxh_p1;
+}
+
+static inline std::uint64_t xxh_merge(
+    std::uint64_t h, std::uint64_t v
+) noexcept {
+    return (h ^ xxh_round(0, v)) * xxh_p1 + xxh_p4;
+}
+
+static inline void xxh_stripe(
+    std::uint64_t *acc, unsigned char const *p
+) noexcept {
+    acc[0] = xxh_round(acc[0], xxh_read64(p));
+    acc[1] = xxh_round(acc[1], xxh_read64(p + 8));
+    acc[2] = xxh_round(acc[2], xxh_read64(p + 16));
+    acc[3] = xxh_round(acc[3], xxh_read64(p + 24));
+}
+
+OSTD_EXPORT make_hasher::make_hasher(std::uint64_t seed) noexcept:
+    p_acc{seed + xxh_p1 + xxh_p2, seed + xxh_p2, seed, seed - xxh_p1}
+{}
+
+OSTD_EXPORT void make_hasher::update(
+    void const *data, std::size_t size
+) noexcept {
+    auto *p = static_cast<unsigned char const *>(data);
+    p_total += size;
+    if ((p_len + size) < sizeof(p_buf)) {
+        std::memcpy(p_buf + p_len, p, size);
+        p_len += size;
+        return;
+    }
+    if (p_len) {
+        std::size_t n = sizeof(p_buf) - p_len;
+        std::memcpy(p_buf + p_len, p, n);
+        xxh_stripe(p_acc, p_buf);
+        p += n;
+        size -= n;
+        p_len = 0;
+    }
+    for (; size >= sizeof(p_buf); size -= sizeof(p_buf)) {
+        xxh_stripe(p_acc, p);
+        p += sizeof(p_buf);
+    }
+    std::memcpy(p_buf, p, size);
+    p_len = size;
+}
+
+OSTD_EXPORT std::uint64_t make_hasher::digest() const noexcept {
+    std::uint64_t h;
+    if (p_total >= sizeof(p_buf)) {
+        h = xxh_rotl(p_acc[0], 1) + xxh_rotl(p_acc[1], 7) +
+            xxh_rotl(p_acc[2], 12) + xxh_rotl(p_acc[3], 18);
+        for (auto v: p_acc) {
+            h = xxh_merge(h, v);
+        }
+    } else {
+        /* the third lane is the plain seed */
+        h = p_acc[2] + xxh_p5;
+    }
+    h += p_total;
+    unsigned char const *p = p_buf;
+    std::size_t n = p_len;
+    for (; n >= 8; n -= 8, p += 8) {
+        h ^= xxh_round(0, xxh_read64(p));
+        h = xxh_rotl(h, 27) * xxh_p1 + xxh_p4;
+    }
+    if (n >= 4) {
+        h ^= std::uint64_t(xxh_read32(p)) * xxh_p1;
+        h = xxh_rotl(h, 23) * xxh_p2 + xxh_p3;
+        n -= 4;
+        p += 4;
+    }
+    for (; n; --n, ++p) {
+        h ^= (*p) * xxh_p5;
+        h = xxh_rotl(h, 11) * xxh_p1;
+    }
+    h ^= h >> 33;
+    h *= xxh_p2;
+    h ^= h >> 29;
+    h *= xxh_p3;
+    h ^= h >> 32;
+    return h;
+}
+
+/* the contents of a file, mapped into memory where possible */
+
+template<typename F>
+static bool with_file_data(std::string const &fname, F func) {
+#ifdef OSTD_PLATFORM_POSIX
+    int fd = ::open(fname.data(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat sb;
+    if (fstat(fd, &sb)) {
+        ::close(fd);
+        return false;
+    }
+    auto sz = std::size_t(sb.st_size);
+    void *m = sz ? mmap(nullptr, sz, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+    ::close(fd);
+    if (m == MAP_FAILED) {
+        return false;
+    }
+    auto *p = static_cast<char const *>(m);
+    try {
+        func(string_range{p, p + sz});
+    } catch (...) {
+        if (sz) {
+            munmap(m, sz);
+        }
+        throw;
+    }
+    if (sz) {
+        munmap(m, sz);
+    }
+    return true;
+#else
+    file_stream f{fname};
+    if (!f.is_open()) {
+        return false;
+    }
+    std::string buf(std::size_t(f.size()), '\0');
+    buf.resize(f.read_bytes(buf.data(), buf.size()));
+    func(string_range{buf});
+    return true;
+#endif
+}
+
+/* depfiles */
+
+namespace detail {
+
+static inline bool depfile_space(char c) {
+    return (c == ' ') || (c == '\t') || (c == '\r') || (c == '\n');
+}
+
+/* a backslash followed by a newline continues the line */
+static inline std::size_t depfile_newline(char const *p, char const *e) {
+    if ((p == e) || (*p != '\\')) {
+        return 0;
+    }
+    if (++p == e) {
+        return 1;
+    }
+    if (*p == '\n') {
+        return 2;
+    }
+    return ((*p == '\r') && ((p + 1) != e) && (p[1] == '\n')) ? 3 : 0;
+}
+
+OSTD_EXPORT void parse_depfile_impl(
+    string_range data, void (*func)(string_range, void *), void *fdata
+) {
+    std::string buf;
+    char const *p = data.data(), *e = p + data.size();
+    /* whether we're past the colon of a rule */
+    bool deps = false;
+    while (p != e) {
+        if (auto n = depfile_newline(p, e); n) {
+            p += n;
+            continue;
+        }
+        if (*p == '\n') {
+            deps = false;
+            ++p;
+            continue;
+        }
+        if (depfile_space(*p)) {
+            ++p;
+            continue;
+        }
+        if (*p == '#') {
+            while ((p != e) && (*p != '\n')) {
+                ++p;
+            }
+            continue;
+        }
+        /* names only need copying when they contain escapes */
+        char const *beg = p;
+        bool esc = false, colon = false;
+        for (; p != e; ++p) {
+            char c = *p;
+            if (depfile_space(c) || depfile_newline(p, e)) {
+                break;
+            }
+            char n = ((p + 1) != e) ? p[1] : '\0';
+            if (
+                ((c == '\\') && ((n == ' ') || (n == '#'))) ||
+                ((c == '$') && (n == '$'))
+            ) {
+                if (!esc) {
+                    buf.assign(beg, p);
+                    esc = true;
+                }
+                buf += n;
+                ++p;
+                continue;
+            }
+            /* except for drive letters like in C:\foo */
+            if (
+                (c == ':') &&
+                (((p - beg) != 1) || ((n != '\\') && (n != '/')))
+            ) {
+                colon = true;
+                break;
+            }
+            if (esc) {
+                buf += c;
+            }
+        }
+        string_range name = esc ? string_range{buf} : string_range{beg, p};
+        if (colon) {
+            deps = true;
+            ++p;
+        } else if (deps) {
+            func(name, fdata);
+        }
+    }
+}
+
+} /* namespace detail */
+
+OSTD_EXPORT bool read_depfile(
+    string_range path, std::vector<std::string> &deps
+) {
+    return with_file_data(std::string{path}, [&deps](string_range data) {
+        parse_depfile([&deps](string_range dep) {
+            deps.emplace_back(dep);
+        }, data);
+    });
+}
+
+/* the log is a header followed by records, each being a kind byte, a name
+ * and the fields of the entry; later records override earlier ones
+ */
+
+static char const db_magic[8] = {'O', 'S', 'T', 'D', 'M', 'K', 'D', 'B'};
+static constexpr std::uint32_t db_version = 1;
+static constexpr std::size_t db_hdrsize = sizeof(db_magic) + 4;
+
+static constexpr unsigned char db_file = 1;
+static constexpr unsigned char db_target = 2;
+static constexpr unsigned char db_time = 3;
+static constexpr unsigned char db_deps = 4;
+
+OSTD_EXPORT make_db::make_db() {}
+
+OSTD_EXPORT make_db::make_db(string_range path) {
+    open(path);
+}
+
+OSTD_EXPORT make_db::~make_db() {
+    try {
+        close();
+    } catch (...) {
+    }
+}
+
+OSTD_EXPORT void make_db::open(string_range path) {
+    close();
+    p_files.clear();
+    p_targets.clear();
+    p_times.clear();
+    p_deps.clear();
+    p_nrecords = 0;
+    p_path = std::string{path};
+    bool valid = false;
+    with_file_data(p_path, [this, &valid](string_range data) {
+        valid = load(data);
+    });
+    std::size_t nlive = p_files.size() + p_targets.size() +
+        p_times.size() + p_deps.size();
+    if (!valid || ((p_nrecords > 1000) && (p_nrecords > nlive * 3))) {
+        rewrite();
+        return;
+    }
+    if (!p_log.open(p_path, stream_mode::APPEND)) {
+        throw stream_error{EIO, std::generic_category()};
+    }
+    p_writer = std::make_unique<binary_writer>(p_log);
+}
+
+OSTD_EXPORT void make_db::close() {
+    if (!p_writer) {
+        return;
+    }
+    auto w = std::move(p_writer);
+    w->flush();
+    p_log.close();
+}
+
+OSTD_EXPORT void make_db::flush() {
+    if (p_writer) {
+        p_writer->flush();
+    }
+}
+
+OSTD_EXPORT std::uint64_t make_db::file_hash(string_range name) {
+    std::string fname{name};
+    auto st = fs::status(path{fname});
+    if (!fs::is_regular_file(st.mode())) {
+        return 0;
+    }
+    auto mtime = std::int64_t(std::chrono::duration_cast<
+        std::chrono::nanoseconds
+    >(st.last_write_time().time_since_epoch()).count());
+    auto it = p_files.find(fname);
+    if (
+        (it != p_files.end()) && (it->second.mtime == mtime) &&
+        (it->second.size == st.size())
+    ) {
+        return it->second.hash;
+    }
+    file_stream f{fname};
+    if (!f.is_open()) {
+        return 0;
+    }
+    make_hasher h;
+    unsigned char buf[64 * 1024];
+    for (std::size_t n; (n = f.read_bytes(buf, sizeof(buf)));) {
+        h.update(buf, n);
+    }
+    /* zero means there is no file */
+    file_entry e{mtime, st.size(), h.digest() | 1};
+    p_files[fname] = e;
+    put_file(fname, e);
+    return e.hash;
+}
+
+OSTD_EXPORT make_db::target_entry const *make_db::target(
+    string_range name
+) const {
+    auto it = p_targets.find(std::string{name});
+    if (it == p_targets.end()) {
+        return nullptr;
+    }
+    return &it->second;
+}
+
+OSTD_EXPORT void make_db::record(string_range name, target_entry const &e) {
+    std::string tname{name};
+    p_targets[tname] = e;
+    put_target(tname, e);
+}
+
+OSTD_EXPORT std::chrono::nanoseconds make_db::time(string_range name) const {
+    auto it = p_times.find(std::string{name});
+    if (it == p_times.end()) {
+        return std::chrono::nanoseconds{0};
+    }
+    return std::chrono::nanoseconds{it->second};
+}
+
+OSTD_EXPORT void make_db::record_time(
+    string_range name, std::chrono::nanoseconds t
+) {
+    std::string tname{name};
+    auto ns = std::int64_t(t.count());
+    p_times[tname] = ns;
+    put_time(tname, ns);
+}
+
+OSTD_EXPORT std::vector<std::string> const *make_db::deps(
+    string_range name
+) const {
+    auto it = p_deps.find(std::string{name});
+    if (it == p_deps.end()) {
+        return nullptr;
+    }
+    return &it->second;
+}
+
+OSTD_EXPORT void make_db::record_deps(
+    string_range name, std::vector<std::string> deps
+) {
+    std::string tname{name};
+    auto it = p_deps.find(tname);
+    /* usually nothing changes, so keep the log small */
+    if ((it != p_deps.end()) && (it->second == deps)) {
+        return;
+    }
+    auto &v = p_deps[tname];
+    v = std::move(deps);
+    put_deps(tname, v);
+}
+
+bool make_db::load(string_range data) {
+    if (
+        (data.size() < db_hdrsize) ||
+        std::memcmp(data.data(), db_magic, sizeof(db_magic))
+    ) {
+        return false;
+    }
+    memory_stream ms{data.slice(sizeof(db_magic), data.size())};
+    binary_reader rd{ms};
+    if (rd.get<std::uint32_t>() != db_version) {
+        return false;
+    }
+    /* a failed build can leave a partial record at the end, so every
+     * record is read whole before any of it is stored, and the caller
+     * drops the rest by rewriting the log from what was stored
+     */
+    try {
+        std::string name;
+        while (!rd.end()) {
+            auto kind = rd.get<unsigned char>();
+            rd.get(name);
+            switch (kind) {
+                case db_file: {
+                    file_entry e;
+                    rd.get(e.mtime, e.size, e.hash);
+                    p_files[name] = e;
+                    break;
+                }
+                case db_target: {
+                    target_entry e;
+                    rd.get(e.command, e.inputs, e.output);
+                    p_targets[name] = e;
+                    break;
+                }
+                case db_time: {
+                    auto t = rd.get<std::int64_t>();
+                    p_times[name] = t;
+                    break;
+                }
+                case db_deps: {
+                    std::vector<std::string> deps;
+                    rd.get(deps);
+                    p_deps[name] = std::move(deps);
+                    break;
+                }
+                default:
+                    return false;
+            }
+            ++p_nrecords;
+        }
+    } catch (stream_error const &) {
+        return false;
+    }
+    return true;
+}
+
+void make_db::rewrite() {
+    /* write a new log next to the old one, then replace it */
+    std::string tmp = p_path + ".tmp";
+    if (!p_log.open(tmp, stream_mode::WRITE)) {
+        throw stream_error{EIO, std::generic_category()};
+    }
+    p_writer = std::make_unique<binary_writer>(p_log);
+    p_nrecords = 0;
+    p_writer->write_bytes(db_magic, sizeof(db_magic));
+    p_writer->put(db_version);
+    for (auto &p: p_files) {
+        put_file(p.first, p.second);
+    }
+    for (auto &p: p_targets) {
+        put_target(p.first, p.second);
+    }
+    for (auto &p: p_times) {
+        put_time(p.first, p.second);
+    }
+    for (auto &p: p_deps) {
+        put_deps(p.first, p.second);
+    }
+    close();
+    fs::rename(path{tmp}, path{p_path});
+    if (!p_log.open(p_path, stream_mode::APPEND)) {
+        throw stream_error{EIO, std::generic_category()};
+    }
+    p_writer = std::make_unique<binary_writer>(p_log);
+}
+
+void make_db::put_file(std::string const &name, file_entry const &e) {
+    if (!p_writer) {
+        return;
+    }
+    p_writer->put(db_file, name, e.mtime, e.size, e.hash);
+    ++p_nrecords;
+}
+
+void make_db::put_target(std::string const &name, target_entry const &e) {
+    if (!p_writer) {
+        return;
+    }
+    p_writer->put(db_target, name, e.command, e.inputs, e.output);
+    ++p_nrecords;
+}
+
+void make_db::put_time(std::string const &name, std::int64_t t) {
+    if (!p_writer) {
+        return;
+    }
+    p_writer->put(db_time, name, t);
+    ++p_nrecords;
+}
+
+void make_db::put_deps(
+    std::string const &name, std::vector<std::string> const &deps
+) {
+    if (!p_writer) {
+        return;
+    }
+    p_writer->put(db_deps, name, deps);
+    ++p_nrecords;
+}
+
+} /* namespace build */
+} /* namespace ostd */
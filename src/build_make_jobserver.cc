@@ -0,0 +1,297 @@
+/* Jobserver implementation bits.
+ *
+ * This file is part of libostd. See COPYING.md for futher information.
+ */
+
+#include <cstdlib>
+#include <cerrno>
+#include <string>
+#include <system_error>
+#include <utility>
+
+#include "ostd/platform.hh"
+
+#ifdef OSTD_PLATFORM_POSIX
+#  include <fcntl.h>
+#  include <poll.h>
+#  include <unistd.h>
+#  include <sys/stat.h>
+#endif
+
+#include "ostd/environ.hh"
+#include "ostd/format.hh"
+#include "ostd/build/make_jobserver.hh"
+
+namespace ostd {
+namespace build {
+
+#ifdef OSTD_PLATFORM_POSIX
+
+static bool jobserver_fd_valid(int fd) {
+    struct stat sb;
+    /* make closes them for commands it doesn't consider recursive, after
+     * which the numbers may well refer to something else entirely
+     */
+    return (fcntl(fd, F_GETFD) >= 0) && !fstat(fd, &sb) &&
+        S_ISFIFO(sb.st_mode);
+}
+
+/* make flags are separated by whitespace */
+static string_range jobserver_next_flag(string_range &flags) {
+    auto sp = flags.find_first_of(byte_set{" \t"});
+    string_range ret = flags.slice(0, flags.size() - sp.size());
+    flags = sp.empty() ? sp : sp.slice(1);
+    return ret;
+}
+
+static bool jobserver_set_flags(int fd, int get, int set, int flags) {
+    int fl = fcntl(fd, get);
+    return (fl >= 0) && (fcntl(fd, set, fl | flags) >= 0);
+}
+
+static void jobserver_throw() {
+    throw std::system_error{errno, std::generic_category()};
+}
+
+OSTD_EXPORT make_jobserver::make_jobserver(
+    int rfd, int wfd, std::string flags
+):
+    p_flags{std::move(flags)}, p_rfd{rfd}, p_wfd{wfd}
+{
+    if (::pipe(p_wake) < 0) {
+        jobserver_throw();
+    }
+    for (int fd: p_wake) {
+        if (
+            !jobserver_set_flags(fd, F_GETFD, F_SETFD, FD_CLOEXEC) ||
+            !jobserver_set_flags(fd, F_GETFL, F_SETFL, O_NONBLOCK)
+        ) {
+            int err = errno;
+            ::close(p_wake[0]);
+            ::close(p_wake[1]);
+            throw std::system_error{err, std::generic_category()};
+        }
+    }
+    /* the descriptor is shared with other processes, so setting it to
+     * non-blocking would affect them too; a new open of the same pipe
+     * can be set up independently
+     */
+    auto path = format_to_string("/proc/self/fd/%d", rfd);
+    p_nbfd = ::open(path.data(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+}
+
+OSTD_EXPORT make_jobserver::~make_jobserver() {
+    if (p_server) {
+        if (p_oldflags) {
+            env_set("MAKEFLAGS", *p_oldflags);
+        } else {
+            env_unset("MAKEFLAGS");
+        }
+    }
+    if (p_owned) {
+        ::close(p_rfd);
+        if (p_wfd != p_rfd) {
+            ::close(p_wfd);
+        }
+    }
+    if (p_nbfd >= 0) {
+        ::close(p_nbfd);
+    }
+    ::close(p_wake[0]);
+    ::close(p_wake[1]);
+}
+
+OSTD_EXPORT std::unique_ptr<make_jobserver> make_jobserver::connect() {
+    auto flags = env_get("MAKEFLAGS");
+    if (!flags) {
+        return nullptr;
+    }
+    /* the last one wins, just like in make */
+    string_range auth;
+    string_range fl = *flags;
+    while (!fl.empty()) {
+        auto word = jobserver_next_flag(fl);
+        if (starts_with(word, "--jobserver-auth=")) {
+            auth = word.slice(17);
+        } else if (starts_with(word, "--jobserver-fds=")) {
+            auth = word.slice(16);
+        }
+    }
+    if (auth.empty()) {
+        return nullptr;
+    }
+    std::unique_ptr<make_jobserver> ret;
+    if (starts_with(auth, "fifo:")) {
+        std::string path{auth.slice(5)};
+        int fd = ::open(path.data(), O_RDWR | O_CLOEXEC);
+        if (fd < 0) {
+            return nullptr;
+        }
+        try {
+            ret.reset(new make_jobserver{fd, fd, *flags});
+        } catch (...) {
+            ::close(fd);
+            throw;
+        }
+        ret->p_owned = true;
+        return ret;
+    }
+    std::string fds{auth};
+    char *end;
+    long rfd = std::strtol(fds.data(), &end, 10);
+    if (*end != ',') {
+        return nullptr;
+    }
+    long wfd = std::strtol(end + 1, &end, 10);
+    if (
+        *end || (rfd < 0) || (wfd < 0) ||
+        !jobserver_fd_valid(int(rfd)) || !jobserver_fd_valid(int(wfd))
+    ) {
+        return nullptr;
+    }
+    ret.reset(new make_jobserver{int(rfd), int(wfd), *flags});
+    return ret;
+}
+
+OSTD_EXPORT std::unique_ptr<make_jobserver> make_jobserver::create(
+    unsigned int jobs
+) {
+    /* not close-on-exec, the children need to inherit it */
+    int fds[2];
+    if (::pipe(fds) < 0) {
+        jobserver_throw();
+    }
+    std::unique_ptr<make_jobserver> ret;
+    try {
+        /* the other make flags are kept, but not the jobs */
+        auto old = env_get("MAKEFLAGS");
+        std::string flags;
+        if (old) {
+            string_range fl = *old;
+            while (!fl.empty()) {
+                auto word = jobserver_next_flag(fl);
+                if (
+                    word.empty() || starts_with(word, "-j") ||
+                    starts_with(word, "--jobserver-")
+                ) {
+                    continue;
+                }
+                flags.append(word.data(), word.size());
+                flags += ' ';
+            }
+        }
+        flags += format_to_string(
+            "-j%d --jobserver-auth=%d,%d", jobs, fds[0], fds[1]
+        );
+        ret.reset(new make_jobserver{fds[0], fds[1], std::move(flags)});
+        ret->p_owned = true;
+        ret->p_oldflags = std::move(old);
+    } catch (...) {
+        ::close(fds[0]);
+        ::close(fds[1]);
+        throw;
+    }
+    /* one job is the implicit one of every process */
+    for (unsigned int i = 1; i < jobs; ++i) {
+        char c = '+';
+        if (::write(fds[1], &c, 1) != 1) {
+            jobserver_throw();
+        }
+    }
+    if (!env_set("MAKEFLAGS", ret->p_flags)) {
+        jobserver_throw();
+    }
+    ret->p_server = true;
+    return ret;
+}
+
+OSTD_EXPORT int make_jobserver::acquire() {
+    int rfd = (p_nbfd >= 0) ? p_nbfd : p_rfd;
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> l{p_mtx};
+            if (p_implicit) {
+                p_implicit = false;
+                return implicit_token;
+            }
+        }
+        /* the implicit token may come back while we're waiting */
+        pollfd pfd[2] = {{rfd, POLLIN, 0}, {p_wake[0], POLLIN, 0}};
+        if (poll(pfd, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            jobserver_throw();
+        }
+        if (pfd[1].revents) {
+            char c;
+            while (::read(p_wake[0], &c, 1) > 0) {}
+            continue;
+        }
+        if (!pfd[0].revents) {
+            continue;
+        }
+        /* another process may take the token first, in which case we
+         * go back to waiting; without a private descriptor this blocks
+         * until the next token instead, like in make itself
+         */
+        unsigned char c;
+        auto n = ::read(rfd, &c, 1);
+        if (n == 1) {
+            return c;
+        }
+        if ((n < 0) && ((errno == EINTR) || (errno == EAGAIN))) {
+            continue;
+        }
+        if (!n) {
+            errno = EPIPE;
+        }
+        jobserver_throw();
+    }
+}
+
+OSTD_EXPORT void make_jobserver::release(int token) {
+    if (token == implicit_token) {
+        std::lock_guard<std::mutex> l{p_mtx};
+        p_implicit = true;
+        char c = 0;
+        /* the pipe being full is fine, there's a wakeup pending already */
+        [[maybe_unused]] auto n = ::write(p_wake[1], &c, 1);
+        return;
+    }
+    auto c = static_cast<unsigned char>(token);
+    while ((::write(p_wfd, &c, 1) < 0) && (errno == EINTR)) {}
+}
+
+#else /* OSTD_PLATFORM_POSIX */
+
+OSTD_EXPORT make_jobserver::make_jobserver(
+    int rfd, int wfd, std::string flags
+):
+    p_flags{std::move(flags)}, p_rfd{rfd}, p_wfd{wfd}
+{}
+
+OSTD_EXPORT make_jobserver::~make_jobserver() {}
+
+OSTD_EXPORT std::unique_ptr<make_jobserver> make_jobserver::connect() {
+    return nullptr;
+}
+
+OSTD_EXPORT std::unique_ptr<make_jobserver> make_jobserver::create(
+    unsigned int
+) {
+    throw std::system_error{
+        std::make_error_code(std::errc::function_not_supported)
+    };
+}
+
+OSTD_EXPORT int make_jobserver::acquire() {
+    return implicit_token;
+}
+
+OSTD_EXPORT void make_jobserver::release(int) {}
+
+#endif /* OSTD_PLATFORM_POSIX */
+
+} /* namespace build */
+} /* namespace ostd */
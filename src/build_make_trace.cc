@@ -0,0 +1,159 @@
+/* Build tracing implementation bits.
+ *
+ * This file is part of libostd. See COPYING.md for futher information.
+ */
+
+#include <cerrno>
+#include <cstdint>
+#include <system_error>
+
+#include "ostd/build/make_trace.hh"
+
+namespace ostd {
+namespace build {
+
+/* the buffer is written out once it gets this large */
+static constexpr std::size_t trace_flush_size = 64 * 1024;
+
+/* threads and lanes are shown as separate processes */
+static constexpr int trace_threads_pid = 1;
+static constexpr int trace_lanes_pid = 2;
+
+OSTD_EXPORT make_trace::make_trace(string_range path):
+    p_start{clock::now()}
+{
+    if (!p_file.open(path, stream_mode::WRITE)) {
+        throw stream_error{EIO, std::generic_category()};
+    }
+    format(
+        p_buf, "[\n{\"ph\":\"M\",\"pid\":%d,\"name\":\"process_name\","
+        "\"args\":{\"name\":\"threads\"}},"
+        "\n{\"ph\":\"M\",\"pid\":%d,\"name\":\"process_name\","
+        "\"args\":{\"name\":\"targets\"}}",
+        trace_threads_pid, trace_lanes_pid
+    );
+    /* the creating thread is the first one */
+    thread_index();
+}
+
+OSTD_EXPORT make_trace::~make_trace() {
+    try {
+        std::lock_guard<std::mutex> l{p_mtx};
+        range_put_all(p_buf, string_range{"\n]\n"});
+        p_file.write_bytes(p_buf.data(), p_buf.size());
+    } catch (...) {}
+}
+
+std::size_t make_trace::thread_index() {
+    auto id = std::this_thread::get_id();
+    for (std::size_t i = 0; i < p_threads.size(); ++i) {
+        if (p_threads[i] == id) {
+            return i;
+        }
+    }
+    p_threads.push_back(id);
+    auto idx = p_threads.size() - 1;
+    /* metadata so that the viewers show a name for the thread */
+    format(
+        p_buf, ",\n{\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+        "\"name\":\"thread_name\",\"args\":{\"name\":\"",
+        trace_threads_pid, idx
+    );
+    if (!idx) {
+        format(p_buf, "make\"}}");
+    } else {
+        format(p_buf, "worker %d\"}}", idx);
+    }
+    return idx;
+}
+
+void make_trace::put_time(clock::duration d) {
+    /* microseconds, with the precision of nanoseconds */
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+    if (ns < 0) {
+        ns = 0;
+    }
+    format(p_buf, "%d.%03d", ns / 1000, ns % 1000);
+}
+
+void make_trace::put_string(string_range s) {
+    p_buf.put('"');
+    for (char c: s) {
+        switch (c) {
+            case '"':
+            case '\\':
+                p_buf.put('\\');
+                p_buf.put(c);
+                break;
+            case '\n':
+                range_put_all(p_buf, string_range{"\\n"});
+                break;
+            case '\t':
+                range_put_all(p_buf, string_range{"\\t"});
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    format(p_buf, "\\u%04x", int(c));
+                } else {
+                    p_buf.put(c);
+                }
+                break;
+        }
+    }
+    p_buf.put('"');
+}
+
+void make_trace::put_event(
+    int pid, std::size_t tid, string_range cat, string_range name,
+    clock::time_point ready, clock::time_point start, clock::time_point end
+) {
+    format(p_buf, ",\n{\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"cat\":", pid, tid);
+    put_string(cat);
+    range_put_all(p_buf, string_range{",\"name\":"});
+    put_string(name);
+    range_put_all(p_buf, string_range{",\"ts\":"});
+    put_time(start - p_start);
+    range_put_all(p_buf, string_range{",\"dur\":"});
+    put_time(end - start);
+    range_put_all(p_buf, string_range{",\"args\":{\"wait_us\":"});
+    put_time(start - ready);
+    range_put_all(p_buf, string_range{"}}"});
+    if (p_buf.size() >= trace_flush_size) {
+        p_file.write_bytes(p_buf.data(), p_buf.size());
+        p_buf.clear();
+    }
+}
+
+OSTD_EXPORT void make_trace::complete(
+    string_range cat, string_range name, clock::time_point ready,
+    clock::time_point start, clock::time_point end
+) {
+    std::lock_guard<std::mutex> l{p_mtx};
+    auto tid = thread_index();
+    put_event(trace_threads_pid, tid, cat, name, ready, start, end);
+}
+
+OSTD_EXPORT void make_trace::complete(
+    std::size_t lane, string_range cat, string_range name,
+    clock::time_point ready, clock::time_point start, clock::time_point end
+) {
+    std::lock_guard<std::mutex> l{p_mtx};
+    for (; p_nlanes <= lane; ++p_nlanes) {
+        format(
+            p_buf, ",\n{\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+            "\"name\":\"thread_name\",\"args\":{\"name\":\"lane %d\"}}",
+            trace_lanes_pid, p_nlanes, p_nlanes
+        );
+    }
+    put_event(trace_lanes_pid, lane, cat, name, ready, start, end);
+}
+
+OSTD_EXPORT void make_trace::flush() {
+    std::lock_guard<std::mutex> l{p_mtx};
+    p_file.write_bytes(p_buf.data(), p_buf.size());
+    p_file.flush();
+    p_buf.clear();
+}
+
+} /* namespace build */
+} /* namespace ostd */
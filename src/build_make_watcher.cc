@@ -0,0 +1,161 @@
+/* File watcher implementation bits.
+ *
+ * This file is part of libostd. See COPYING.md for futher information.
+ */
+
+#include <cerrno>
+#include <cstdint>
+#include <algorithm>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "ostd/platform.hh"
+
+#ifdef __linux__
+#  include <poll.h>
+#  include <unistd.h>
+#  include <sys/inotify.h>
+#endif
+
+#include "ostd/path.hh"
+#include "ostd/build/make_watcher.hh"
+
+namespace ostd {
+namespace build {
+
+#ifdef __linux__
+
+static void watcher_throw() {
+    throw std::system_error{errno, std::generic_category()};
+}
+
+/* everything that can change what the file is, except the writes that
+ * have yet to be finished, which the close tells about
+ */
+static constexpr std::uint32_t watcher_mask =
+    IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE |
+    IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+
+OSTD_EXPORT make_watcher::make_watcher() {
+    p_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (p_fd < 0) {
+        watcher_throw();
+    }
+}
+
+OSTD_EXPORT make_watcher::~make_watcher() {
+    ::close(p_fd);
+}
+
+OSTD_EXPORT bool make_watcher::add(string_range file) {
+    ostd::path fp{file};
+    std::string dname = fp.has_parent() ? fp.parent().string() : ".";
+    /* the same directory always gets the same descriptor */
+    int wd = inotify_add_watch(p_fd, dname.data(), watcher_mask);
+    if (wd < 0) {
+        return false;
+    }
+    auto &names = p_dirs[wd][std::string{fp.name()}];
+    std::string fname{file};
+    if (std::find(names.begin(), names.end(), fname) == names.end()) {
+        names.push_back(std::move(fname));
+    }
+    return true;
+}
+
+OSTD_EXPORT void make_watcher::wait(
+    std::vector<std::string> &changed, std::chrono::milliseconds quiet
+) {
+    changed.clear();
+    alignas(inotify_event) char buf[64 * 1024];
+    for (;;) {
+        /* block until the first change, then until things settle */
+        pollfd pfd = {p_fd, POLLIN, 0};
+        int ret = poll(&pfd, 1, changed.empty() ? -1 : int(quiet.count()));
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            watcher_throw();
+        }
+        if (!ret) {
+            break;
+        }
+        auto n = ::read(p_fd, buf, sizeof(buf));
+        if (n < 0) {
+            if ((errno == EINTR) || (errno == EAGAIN)) {
+                continue;
+            }
+            watcher_throw();
+        }
+        for (char *p = buf; p < (buf + n);) {
+            auto *ev = reinterpret_cast<inotify_event *>(p);
+            p += sizeof(inotify_event) + ev->len;
+            if (ev->mask & IN_Q_OVERFLOW) {
+                /* changes were lost, so everything may have changed */
+                for (auto &d: p_dirs) {
+                    for (auto &f: d.second) {
+                        changed.insert(
+                            changed.end(), f.second.begin(), f.second.end()
+                        );
+                    }
+                }
+                continue;
+            }
+            auto it = p_dirs.find(ev->wd);
+            if (it == p_dirs.end()) {
+                continue;
+            }
+            if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+                /* the whole directory is gone */
+                for (auto &f: it->second) {
+                    changed.insert(
+                        changed.end(), f.second.begin(), f.second.end()
+                    );
+                }
+                if (ev->mask & IN_IGNORED) {
+                    p_dirs.erase(it);
+                }
+                continue;
+            }
+            if (!ev->len) {
+                continue;
+            }
+            auto fit = it->second.find(std::string{ev->name});
+            if (fit != it->second.end()) {
+                changed.insert(
+                    changed.end(), fit->second.begin(), fit->second.end()
+                );
+            }
+        }
+    }
+    std::sort(changed.begin(), changed.end());
+    changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+}
+
+#else /* __linux__ */
+
+OSTD_EXPORT make_watcher::make_watcher() {
+    throw std::system_error{
+        std::make_error_code(std::errc::function_not_supported)
+    };
+}
+
+OSTD_EXPORT make_watcher::~make_watcher() {}
+
+OSTD_EXPORT bool make_watcher::add(string_range) {
+    return false;
+}
+
+OSTD_EXPORT void make_watcher::wait(
+    std::vector<std::string> &changed, std::chrono::milliseconds
+) {
+    changed.clear();
+}
+
+#endif /* __linux__ */
+
+} /* namespace build */
+} /* namespace ostd */
@@ -0,0 +1,407 @@
+/* Compression stream adapters implementation.
+ *
+ * This file is part of libostd. See COPYING.md for futher information.
+ */
+
+#include <cstddef>
+#include <cerrno>
+#include <climits>
+#include <algorithm>
+#include <memory>
+
+#include "ostd/compress.hh"
+
+#ifdef OSTD_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef OSTD_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace ostd {
+
+#if defined(OSTD_HAVE_ZSTD) || defined(OSTD_HAVE_ZLIB)
+[[noreturn]] static void compress_throw(int err) {
+    throw stream_error{err, std::generic_category()};
+}
+#endif
+
+#ifdef OSTD_HAVE_ZSTD
+
+namespace detail {
+    struct zstd_stream_impl {
+        zstd_stream_impl(stream &s, compress_mode mode):
+            p_stream{&s}, p_mode{mode}
+        {}
+
+        ~zstd_stream_impl() {
+            ZSTD_freeCCtx(p_cctx);
+            ZSTD_freeDCtx(p_dctx);
+        }
+
+        void check(std::size_t r) {
+            if (!ZSTD_isError(r)) {
+                return;
+            }
+            switch (ZSTD_getErrorCode(r)) {
+                case ZSTD_error_memory_allocation:
+                    compress_throw(ENOMEM);
+                case ZSTD_error_prefix_unknown:
+                case ZSTD_error_frameParameter_unsupported:
+                case ZSTD_error_corruption_detected:
+                case ZSTD_error_checksum_wrong:
+                case ZSTD_error_dictionary_corrupted:
+                case ZSTD_error_dictionary_wrong:
+                    compress_throw(EILSEQ);
+                default:
+                    break;
+            }
+            compress_throw(EIO);
+        }
+
+        /* runs the compressor until it consumes the input and, unless
+         * continuing, until it has nothing more to output
+         */
+        void compress(
+            void const *buf, std::size_t count, ZSTD_EndDirective op
+        ) {
+            ZSTD_inBuffer in{buf, count, 0};
+            for (;;) {
+                ZSTD_outBuffer out{p_buf.get(), p_bufsize, 0};
+                std::size_t r = ZSTD_compressStream2(p_cctx, &out, &in, op);
+                check(r);
+                if (out.pos) {
+                    p_stream->write_bytes(p_buf.get(), out.pos);
+                }
+                if (op == ZSTD_e_continue) {
+                    if (in.pos == in.size) {
+                        break;
+                    }
+                } else if (!r) {
+                    break;
+                }
+            }
+        }
+
+        stream *p_stream;
+        compress_mode p_mode;
+        ZSTD_CCtx *p_cctx = nullptr;
+        ZSTD_DCtx *p_dctx = nullptr;
+        std::unique_ptr<unsigned char[]> p_buf;
+        std::size_t p_bufsize = 0;
+        ZSTD_inBuffer p_in{nullptr, 0, 0};
+        /* the last decompression result, nonzero inside a frame */
+        std::size_t p_hint = 0;
+        bool p_eof = false;
+        bool p_end = false;
+    };
+} /* namespace detail */
+
+OSTD_EXPORT zstd_stream::zstd_stream(
+    stream &s, compress_mode mode, int level, int threads
+):
+    p_impl{std::make_unique<detail::zstd_stream_impl>(s, mode)}
+{
+    auto &im = *p_impl;
+    if (mode == compress_mode::COMPRESS) {
+        im.p_cctx = ZSTD_createCCtx();
+        if (!im.p_cctx) {
+            compress_throw(ENOMEM);
+        }
+        im.check(ZSTD_CCtx_setParameter(
+            im.p_cctx, ZSTD_c_compressionLevel, level
+        ));
+        if (threads > 0) {
+            /* fails when the library is built without threading support,
+             * in which case it keeps compressing in the calling thread
+             */
+            ZSTD_CCtx_setParameter(im.p_cctx, ZSTD_c_nbWorkers, threads);
+        }
+        im.p_bufsize = ZSTD_CStreamOutSize();
+    } else {
+        im.p_dctx = ZSTD_createDCtx();
+        if (!im.p_dctx) {
+            compress_throw(ENOMEM);
+        }
+        im.p_bufsize = ZSTD_DStreamInSize();
+    }
+    im.p_buf = std::make_unique<unsigned char[]>(im.p_bufsize);
+}
+
+OSTD_EXPORT zstd_stream::~zstd_stream() {
+    try {
+        close();
+    } catch (...) {
+    }
+}
+
+OSTD_EXPORT void zstd_stream::close() {
+    if (!p_impl) {
+        return;
+    }
+    /* release the state even if finishing the frame fails */
+    auto im = std::move(p_impl);
+    if (im->p_cctx) {
+        im->compress(nullptr, 0, ZSTD_e_end);
+    }
+}
+
+OSTD_EXPORT bool zstd_stream::end() const {
+    return !p_impl || p_impl->p_end;
+}
+
+OSTD_EXPORT void zstd_stream::flush() {
+    if (!p_impl || !p_impl->p_cctx) {
+        return;
+    }
+    p_impl->compress(nullptr, 0, ZSTD_e_flush);
+    p_impl->p_stream->flush();
+}
+
+OSTD_EXPORT std::size_t zstd_stream::read_bytes(void *buf, std::size_t count) {
+    if (!p_impl || !p_impl->p_dctx) {
+        compress_throw(EINVAL);
+    }
+    auto &im = *p_impl;
+    ZSTD_outBuffer out{buf, count, 0};
+    while (out.pos < out.size) {
+        if (im.p_in.pos == im.p_in.size) {
+            /* the output was not filled, so everything decoded so far
+             * has been flushed and more input is needed
+             */
+            if (!im.p_eof) {
+                std::size_t n = im.p_stream->read_bytes(
+                    im.p_buf.get(), im.p_bufsize
+                );
+                im.p_in = ZSTD_inBuffer{im.p_buf.get(), n, 0};
+                im.p_eof = !n;
+            }
+            if (im.p_eof) {
+                if (im.p_hint) {
+                    /* truncated frame */
+                    compress_throw(EILSEQ);
+                }
+                im.p_end = true;
+                break;
+            }
+        }
+        im.p_hint = ZSTD_decompressStream(im.p_dctx, &out, &im.p_in);
+        im.check(im.p_hint);
+    }
+    return out.pos;
+}
+
+OSTD_EXPORT void zstd_stream::write_bytes(void const *buf, std::size_t count) {
+    if (!p_impl || !p_impl->p_cctx) {
+        compress_throw(EINVAL);
+    }
+    p_impl->compress(buf, count, ZSTD_e_continue);
+}
+
+#endif /* OSTD_HAVE_ZSTD */
+
+#ifdef OSTD_HAVE_ZLIB
+
+namespace detail {
+    static constexpr std::size_t zlib_bufsize = 64 * 1024;
+
+    struct zlib_stream_impl {
+        zlib_stream_impl(stream &s, compress_mode mode, zlib_format fmt):
+            p_stream{&s}, p_mode{mode}, p_fmt{fmt},
+            p_buf{std::make_unique<unsigned char[]>(zlib_bufsize)}
+        {}
+
+        ~zlib_stream_impl() {
+            if (!p_init) {
+                return;
+            }
+            if (p_mode == compress_mode::COMPRESS) {
+                deflateEnd(&p_z);
+            } else {
+                inflateEnd(&p_z);
+            }
+        }
+
+        void check(int r) {
+            switch (r) {
+                case Z_OK:
+                case Z_STREAM_END:
+                /* no progress possible, dealt with by the callers */
+                case Z_BUF_ERROR:
+                    return;
+                case Z_MEM_ERROR:
+                    compress_throw(ENOMEM);
+                case Z_DATA_ERROR:
+                case Z_NEED_DICT:
+                    compress_throw(EILSEQ);
+                default:
+                    break;
+            }
+            compress_throw(EIO);
+        }
+
+        /* zlib counts in uInt, so bigger writes go in pieces */
+        void compress(unsigned char const *buf, std::size_t count, int op) {
+            do {
+                auto n = std::min(count, std::size_t(UINT_MAX));
+                /* zlib never writes through next_in */
+                p_z.next_in = const_cast<unsigned char *>(buf);
+                p_z.avail_in = uInt(n);
+                buf += n;
+                count -= n;
+                int fop = count ? Z_NO_FLUSH : op;
+                int r;
+                do {
+                    p_z.next_out = p_buf.get();
+                    p_z.avail_out = uInt(zlib_bufsize);
+                    r = deflate(&p_z, fop);
+                    check(r);
+                    std::size_t nout = zlib_bufsize - p_z.avail_out;
+                    if (nout) {
+                        p_stream->write_bytes(p_buf.get(), nout);
+                    }
+                } while (
+                    p_z.avail_in || !p_z.avail_out ||
+                    ((fop == Z_FINISH) && (r != Z_STREAM_END))
+                );
+            } while (count);
+        }
+
+        stream *p_stream;
+        compress_mode p_mode;
+        zlib_format p_fmt;
+        std::unique_ptr<unsigned char[]> p_buf;
+        z_stream p_z{};
+        bool p_init = false;
+        /* inside of a compressed member when decompressing */
+        bool p_member = false;
+        bool p_eof = false;
+        bool p_end = false;
+    };
+} /* namespace detail */
+
+OSTD_EXPORT zlib_stream::zlib_stream(
+    stream &s, compress_mode mode, int level, zlib_format fmt
+):
+    p_impl{std::make_unique<detail::zlib_stream_impl>(s, mode, fmt)}
+{
+    auto &im = *p_impl;
+    int wbits = 15;
+    switch (fmt) {
+        case zlib_format::GZIP:
+            wbits += 16;
+            break;
+        case zlib_format::RAW:
+            wbits = -wbits;
+            break;
+        default:
+            break;
+    }
+    int r;
+    if (mode == compress_mode::COMPRESS) {
+        r = deflateInit2(
+            &im.p_z, level, Z_DEFLATED, wbits, 8, Z_DEFAULT_STRATEGY
+        );
+    } else {
+        /* automatic detection of zlib and gzip headers */
+        if (wbits > 0) {
+            wbits = 15 + 32;
+        }
+        r = inflateInit2(&im.p_z, wbits);
+    }
+    if (r != Z_OK) {
+        compress_throw((r == Z_MEM_ERROR) ? ENOMEM : EINVAL);
+    }
+    im.p_init = true;
+}
+
+OSTD_EXPORT zlib_stream::~zlib_stream() {
+    try {
+        close();
+    } catch (...) {
+    }
+}
+
+OSTD_EXPORT void zlib_stream::close() {
+    if (!p_impl) {
+        return;
+    }
+    auto im = std::move(p_impl);
+    if (im->p_mode == compress_mode::COMPRESS) {
+        im->compress(nullptr, 0, Z_FINISH);
+    }
+}
+
+OSTD_EXPORT bool zlib_stream::end() const {
+    return !p_impl || p_impl->p_end;
+}
+
+OSTD_EXPORT void zlib_stream::flush() {
+    if (!p_impl || (p_impl->p_mode != compress_mode::COMPRESS)) {
+        return;
+    }
+    p_impl->compress(nullptr, 0, Z_SYNC_FLUSH);
+    p_impl->p_stream->flush();
+}
+
+OSTD_EXPORT std::size_t zlib_stream::read_bytes(void *buf, std::size_t count) {
+    if (!p_impl || (p_impl->p_mode != compress_mode::DECOMPRESS)) {
+        compress_throw(EINVAL);
+    }
+    auto &im = *p_impl;
+    auto *obuf = static_cast<unsigned char *>(buf);
+    std::size_t nread = 0;
+    while ((nread < count) && !im.p_end) {
+        if (!im.p_z.avail_in && !im.p_eof) {
+            std::size_t n = im.p_stream->read_bytes(
+                im.p_buf.get(), detail::zlib_bufsize
+            );
+            im.p_z.next_in = im.p_buf.get();
+            im.p_z.avail_in = uInt(n);
+            im.p_eof = !n;
+        }
+        if (!im.p_z.avail_in) {
+            if (im.p_member) {
+                /* truncated member */
+                compress_throw(EILSEQ);
+            }
+            im.p_end = true;
+            break;
+        }
+        if (!im.p_member) {
+            if (im.p_z.total_in) {
+                /* another member follows, raw data have no such thing */
+                if (im.p_fmt == zlib_format::RAW) {
+                    im.p_end = true;
+                    break;
+                }
+                im.check(inflateReset(&im.p_z));
+            }
+            im.p_member = true;
+        }
+        auto n = std::min(count - nread, std::size_t(UINT_MAX));
+        im.p_z.next_out = obuf + nread;
+        im.p_z.avail_out = uInt(n);
+        int r = inflate(&im.p_z, Z_NO_FLUSH);
+        im.check(r);
+        nread += n - im.p_z.avail_out;
+        if (r == Z_STREAM_END) {
+            im.p_member = false;
+        }
+    }
+    return nread;
+}
+
+OSTD_EXPORT void zlib_stream::write_bytes(void const *buf, std::size_t count) {
+    if (!p_impl || (p_impl->p_mode != compress_mode::COMPRESS)) {
+        compress_throw(EINVAL);
+    }
+    p_impl->compress(
+        static_cast<unsigned char const *>(buf), count, Z_NO_FLUSH
+    );
+}
+
+#endif /* OSTD_HAVE_ZLIB */
+
+} /* namespace ostd */
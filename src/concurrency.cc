@@ -27,6 +27,7 @@ namespace detail {
 
     OSTD_EXPORT scheduler *current_scheduler = nullptr;
     OSTD_EXPORT thread_local csched_task *current_csched_task = nullptr;
+    OSTD_EXPORT thread_local std::size_t current_csched_node = 0;
 } /* namespace detail */
 
 scheduler::~scheduler() {}
@@ -0,0 +1,115 @@
+/* Futex and futex emulation for scheduler-aware mutexes.
+ *
+ * This file is part of libostd. See COPYING.md for futher information.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+
+#include "ostd/mutex.hh"
+
+#ifdef OSTD_PLATFORM_LINUX
+#  include <ctime>
+#  include <unistd.h>
+#  include <sys/syscall.h>
+#  include <linux/futex.h>
+#endif
+
+namespace ostd {
+namespace detail {
+
+#ifdef OSTD_PLATFORM_LINUX
+
+static_assert(
+    sizeof(std::atomic<int>) == sizeof(int),
+    "futexes require lock-free plain integer atomics"
+);
+
+static long futex_call(
+    std::atomic<int> *addr, int op, int val, timespec const *ts = nullptr
+) noexcept {
+    return syscall(
+        SYS_futex, reinterpret_cast<int *>(addr), op | FUTEX_PRIVATE_FLAG,
+        val, ts, nullptr, 0
+    );
+}
+
+OSTD_EXPORT void futex_wait(std::atomic<int> *addr, int val) noexcept {
+    futex_call(addr, FUTEX_WAIT, val);
+}
+
+OSTD_EXPORT void futex_wait_until(
+    std::atomic<int> *addr, int val, std::chrono::steady_clock::time_point tp
+) noexcept {
+    /* the timeout of FUTEX_WAIT is relative, on the monotonic clock */
+    auto now = std::chrono::steady_clock::now();
+    if (tp <= now) {
+        return;
+    }
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        tp - now
+    ).count();
+    timespec ts;
+    ts.tv_sec = static_cast<time_t>(ns / 1000000000);
+    ts.tv_nsec = static_cast<long>(ns % 1000000000);
+    futex_call(addr, FUTEX_WAIT, val, &ts);
+}
+
+OSTD_EXPORT void futex_wake(std::atomic<int> *addr, int n) noexcept {
+    futex_call(addr, FUTEX_WAKE, n);
+}
+
+#else
+
+/* no futexes, so emulate them with a small table of buckets hashed by
+ * address, each protected by a standard mutex and condition variable
+ */
+namespace {
+    struct futex_bucket {
+        std::mutex lock;
+        std::condition_variable cond;
+    };
+
+    constexpr std::size_t FUTEX_BUCKETS = 64;
+
+    futex_bucket &futex_get_bucket(std::atomic<int> *addr) noexcept {
+        static futex_bucket buckets[FUTEX_BUCKETS];
+        auto h = reinterpret_cast<std::uintptr_t>(addr);
+        return buckets[(h >> 4) % FUTEX_BUCKETS];
+    }
+}
+
+OSTD_EXPORT void futex_wait(std::atomic<int> *addr, int val) noexcept {
+    auto &b = futex_get_bucket(addr);
+    std::unique_lock<std::mutex> l{b.lock};
+    if (addr->load() != val) {
+        return;
+    }
+    b.cond.wait(l);
+}
+
+OSTD_EXPORT void futex_wait_until(
+    std::atomic<int> *addr, int val, std::chrono::steady_clock::time_point tp
+) noexcept {
+    auto &b = futex_get_bucket(addr);
+    std::unique_lock<std::mutex> l{b.lock};
+    if (addr->load() != val) {
+        return;
+    }
+    b.cond.wait_until(l, tp);
+}
+
+OSTD_EXPORT void futex_wake(std::atomic<int> *addr, int) noexcept {
+    auto &b = futex_get_bucket(addr);
+    /* the bucket is shared, so everyone has to recheck */
+    { std::lock_guard<std::mutex> l{b.lock}; }
+    b.cond.notify_all();
+}
+
+#endif
+
+} /* namespace detail */
+} /* namespace ostd */
@@ -288,16 +288,17 @@ struct rdir_range_impl {
         /* didn't recurse into a directory, go to next file */
         dir_read_next(static_cast<DIR *>(p_handles.top()), curd, tp, p_dir);
         p_current = directory_entry{std::move(curd), tp};
-        /* end of dir, pop while at it */
-        if (p_current.path().empty()) {
+        /* end of dir, pop while at it; the parents may be at the end too */
+        while (p_current.path().empty()) {
             closedir(static_cast<DIR *>(p_handles.top()));
             p_handles.pop();
-            if (!p_handles.empty()) {
-                /* got back to another dir, read next so it's valid */
-                p_dir.remove_name();
-                dir_read_next(static_cast<DIR *>(p_handles.top()), curd, tp, p_dir);
-                p_current = directory_entry{std::move(curd), tp};
+            if (p_handles.empty()) {
+                break;
             }
+            /* got back to another dir, read next so it's valid */
+            p_dir.remove_name();
+            dir_read_next(static_cast<DIR *>(p_handles.top()), curd, tp, p_dir);
+            p_current = directory_entry{std::move(curd), tp};
         }
     }
 
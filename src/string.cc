@@ -6,6 +6,7 @@
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <algorithm>
 #include <limits>
 #include <type_traits>
 
@@ -13,6 +14,10 @@
 #include "ostd/string.hh"
 #include "ostd/format.hh"
 
+#if defined(OSTD_TOOLCHAIN_GNU) && defined(__SSE2__)
+#  include <immintrin.h>
+#endif
+
 namespace ostd {
 namespace detail {
 
@@ -69,6 +74,384 @@ OSTD_EXPORT std::size_t tstrlen(wchar_t const *p) noexcept {
     return tstrlen_impl(p);
 }
 
+/* string search kernels
+ *
+ * the vector width is picked when building the library; the kernels are
+ * written in terms of the str_vec operations, with scalar loops for the
+ * remainders and for when no vector instructions are available
+ */
+
+#if defined(OSTD_TOOLCHAIN_GNU) && defined(__AVX2__)
+struct str_vec {
+    using type = __m256i;
+    static constexpr std::size_t size = 32;
+    static constexpr std::uint32_t full = 0xFFFFFFFFU;
+
+    static type load(char const *p) noexcept {
+        return _mm256_loadu_si256(reinterpret_cast<type const *>(p));
+    }
+    static type table(unsigned char const *p) noexcept {
+        return _mm256_broadcastsi128_si256(
+            _mm_loadu_si128(reinterpret_cast<__m128i const *>(p))
+        );
+    }
+    static type splat(char c) noexcept { return _mm256_set1_epi8(c); }
+    static type eq(type a, type b) noexcept { return _mm256_cmpeq_epi8(a, b); }
+    static type band(type a, type b) noexcept { return _mm256_and_si256(a, b); }
+    static type bor(type a, type b) noexcept { return _mm256_or_si256(a, b); }
+    static type hi_nibbles(type a) noexcept {
+        return _mm256_and_si256(_mm256_srli_epi16(a, 4), splat(0xF));
+    }
+    static type lookup(type t, type idx) noexcept {
+        return _mm256_shuffle_epi8(t, idx);
+    }
+    static std::uint32_t mask(type a) noexcept {
+        return std::uint32_t(_mm256_movemask_epi8(a));
+    }
+};
+#  define OSTD_STR_SIMD 1
+#  define OSTD_STR_LOOKUP 1
+#elif defined(OSTD_TOOLCHAIN_GNU) && defined(__SSE2__)
+struct str_vec {
+    using type = __m128i;
+    static constexpr std::size_t size = 16;
+    static constexpr std::uint32_t full = 0xFFFFU;
+
+    static type load(char const *p) noexcept {
+        return _mm_loadu_si128(reinterpret_cast<type const *>(p));
+    }
+    static type table(unsigned char const *p) noexcept {
+        return _mm_loadu_si128(reinterpret_cast<type const *>(p));
+    }
+    static type splat(char c) noexcept { return _mm_set1_epi8(c); }
+    static type eq(type a, type b) noexcept { return _mm_cmpeq_epi8(a, b); }
+    static type band(type a, type b) noexcept { return _mm_and_si128(a, b); }
+    static type bor(type a, type b) noexcept { return _mm_or_si128(a, b); }
+    static type hi_nibbles(type a) noexcept {
+        return _mm_and_si128(_mm_srli_epi16(a, 4), splat(0xF));
+    }
+#  ifdef __SSSE3__
+    static type lookup(type t, type idx) noexcept {
+        return _mm_shuffle_epi8(t, idx);
+    }
+#  endif
+    static std::uint32_t mask(type a) noexcept {
+        return std::uint32_t(_mm_movemask_epi8(a));
+    }
+};
+#  define OSTD_STR_SIMD 1
+#  ifdef __SSSE3__
+#    define OSTD_STR_LOOKUP 1
+#  endif
+#endif
+
+#ifdef OSTD_STR_SIMD
+static inline unsigned int str_ctz(std::uint32_t v) noexcept {
+    return unsigned(__builtin_ctz(v));
+}
+
+static inline unsigned int str_msb(std::uint32_t v) noexcept {
+    return 31 - unsigned(__builtin_clz(v));
+}
+#endif
+
+/* the Two-Way algorithm by Crochemore and Perrin, guaranteed linear */
+static char const *str_twoway(
+    char const *hs, std::size_t hn, char const *ns, std::size_t l
+) noexcept {
+    auto *h = reinterpret_cast<unsigned char const *>(hs);
+    auto *n = reinterpret_cast<unsigned char const *>(ns);
+    auto *z = h + hn;
+    std::size_t byteset[256 / (8 * sizeof(std::size_t))] = {};
+    std::size_t shift[256];
+    constexpr std::size_t bits = 8 * sizeof(std::size_t);
+
+    for (std::size_t i = 0; i < l; ++i) {
+        byteset[n[i] / bits] |= std::size_t(1) << (n[i] % bits);
+        shift[n[i]] = i + 1;
+    }
+
+    /* maximal suffix */
+    std::size_t ip = std::size_t(-1), jp = 0, k = 1, p = 1;
+    while ((jp + k) < l) {
+        if (n[ip + k] == n[jp + k]) {
+            if (k == p) {
+                jp += p;
+                k = 1;
+            } else {
+                ++k;
+            }
+        } else if (n[ip + k] > n[jp + k]) {
+            jp += k;
+            k = 1;
+            p = jp - ip;
+        } else {
+            ip = jp++;
+            k = p = 1;
+        }
+    }
+    std::size_t ms = ip, p0 = p;
+
+    /* and with the opposite comparison */
+    ip = std::size_t(-1);
+    jp = 0;
+    k = p = 1;
+    while ((jp + k) < l) {
+        if (n[ip + k] == n[jp + k]) {
+            if (k == p) {
+                jp += p;
+                k = 1;
+            } else {
+                ++k;
+            }
+        } else if (n[ip + k] < n[jp + k]) {
+            jp += k;
+            k = 1;
+            p = jp - ip;
+        } else {
+            ip = jp++;
+            k = p = 1;
+        }
+    }
+    if ((ip + 1) > (ms + 1)) {
+        ms = ip;
+    } else {
+        p = p0;
+    }
+
+    /* periodic needle? */
+    std::size_t mem0;
+    if (std::memcmp(n, n + p, ms + 1)) {
+        mem0 = 0;
+        p = std::max(ms, l - ms - 1) + 1;
+    } else {
+        mem0 = l - p;
+    }
+    std::size_t mem = 0;
+
+    for (;;) {
+        if (std::size_t(z - h) < l) {
+            return nullptr;
+        }
+        /* check the last byte first and skip by the shift table */
+        unsigned char c = h[l - 1];
+        if (byteset[c / bits] & (std::size_t(1) << (c % bits))) {
+            k = l - shift[c];
+            if (k) {
+                if (k < mem) {
+                    k = mem;
+                }
+                h += k;
+                mem = 0;
+                continue;
+            }
+        } else {
+            h += l;
+            mem = 0;
+            continue;
+        }
+        /* right half */
+        for (k = std::max(ms + 1, mem); (k < l) && (n[k] == h[k]); ++k) {}
+        if (k < l) {
+            h += k - ms;
+            mem = 0;
+            continue;
+        }
+        /* left half */
+        for (k = ms + 1; (k > mem) && (n[k - 1] == h[k - 1]); --k) {}
+        if (k <= mem) {
+            return reinterpret_cast<char const *>(h);
+        }
+        h += p;
+        mem = mem0;
+    }
+}
+
+/* when verifying candidates has cost this much, switch to two-way */
+static inline bool str_over_budget(std::size_t work, std::size_t pos) noexcept {
+    return work > ((pos + 256) * 4);
+}
+
+OSTD_EXPORT char const *str_find(
+    char const *h, std::size_t hn, char const *n, std::size_t nn
+) noexcept {
+    if (!nn) {
+        return h;
+    }
+    if (nn > hn) {
+        return nullptr;
+    }
+    if (nn == 1) {
+        return static_cast<char const *>(std::memchr(h, n[0], hn));
+    }
+    /* the number of positions the needle can be at */
+    std::size_t npos = hn - nn + 1;
+    std::size_t i = 0, work = 0;
+#ifdef OSTD_STR_SIMD
+    /* candidates have both the first and the last byte matching */
+    auto vf = str_vec::splat(n[0]);
+    auto vl = str_vec::splat(n[nn - 1]);
+    for (; (i + str_vec::size) <= npos; i += str_vec::size) {
+        auto m = str_vec::mask(str_vec::band(
+            str_vec::eq(str_vec::load(h + i), vf),
+            str_vec::eq(str_vec::load(h + i + nn - 1), vl)
+        ));
+        while (m) {
+            std::size_t j = i + str_ctz(m);
+            if (!std::memcmp(h + j + 1, n + 1, nn - 2)) {
+                return h + j;
+            }
+            work += nn;
+            if (str_over_budget(work, j)) {
+                return str_twoway(h + j + 1, hn - j - 1, n, nn);
+            }
+            m &= m - 1;
+        }
+    }
+#endif
+    while (i < npos) {
+        auto *p = static_cast<char const *>(std::memchr(h + i, n[0], npos - i));
+        if (!p) {
+            return nullptr;
+        }
+        i = std::size_t(p - h);
+        if ((h[i + nn - 1] == n[nn - 1]) && !std::memcmp(h + i, n, nn)) {
+            return h + i;
+        }
+        work += nn;
+        if (str_over_budget(work, i)) {
+            return str_twoway(h + i + 1, hn - i - 1, n, nn);
+        }
+        ++i;
+    }
+    return nullptr;
+}
+
+OSTD_EXPORT char const *str_rfind(
+    char const *h, std::size_t hn, char const *n, std::size_t nn
+) noexcept {
+    if (!nn) {
+        return h + hn;
+    }
+    if (nn > hn) {
+        return nullptr;
+    }
+    /* positions below this one remain to be checked */
+    std::size_t end = hn - nn + 1;
+#ifdef OSTD_STR_SIMD
+    auto vf = str_vec::splat(n[0]);
+    auto vl = str_vec::splat(n[nn - 1]);
+    while (end >= str_vec::size) {
+        std::size_t i = end - str_vec::size;
+        auto m = str_vec::mask(str_vec::band(
+            str_vec::eq(str_vec::load(h + i), vf),
+            str_vec::eq(str_vec::load(h + i + nn - 1), vl)
+        ));
+        while (m) {
+            unsigned int b = str_msb(m);
+            std::size_t j = i + b;
+            if ((nn <= 2) || !std::memcmp(h + j + 1, n + 1, nn - 2)) {
+                return h + j;
+            }
+            m &= ~(std::uint32_t(1) << b);
+        }
+        end = i;
+    }
+#endif
+    while (end--) {
+        if ((h[end] == n[0]) && !std::memcmp(h + end, n, nn)) {
+            return h + end;
+        }
+    }
+    return nullptr;
+}
+
+#ifdef OSTD_STR_LOOKUP
+/* for a high nibble, its bit in the low nibble tables of a byte set */
+alignas(16) static unsigned char const str_sel_lo[16] = {
+    1, 2, 4, 8, 16, 32, 64, 128, 0, 0, 0, 0, 0, 0, 0, 0
+};
+alignas(16) static unsigned char const str_sel_hi[16] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 4, 8, 16, 32, 64, 128
+};
+#endif
+
+OSTD_EXPORT char const *str_find_first_of(
+    char const *h, std::size_t hn, byte_set const &set
+) noexcept {
+    std::size_t i = 0;
+#ifdef OSTD_STR_LOOKUP
+    /* look up the bit of every byte in the set, works for any set */
+    auto lot = str_vec::table(set.p_lo);
+    auto hit = str_vec::table(set.p_hi);
+    auto slo = str_vec::table(str_sel_lo);
+    auto shi = str_vec::table(str_sel_hi);
+    auto nib = str_vec::splat(0xF);
+    auto zero = str_vec::splat(0);
+    for (; (i + str_vec::size) <= hn; i += str_vec::size) {
+        auto v = str_vec::load(h + i);
+        auto lo = str_vec::band(v, nib);
+        auto hi = str_vec::hi_nibbles(v);
+        auto t = str_vec::bor(
+            str_vec::band(
+                str_vec::lookup(lot, lo), str_vec::lookup(slo, hi)
+            ),
+            str_vec::band(
+                str_vec::lookup(hit, lo), str_vec::lookup(shi, hi)
+            )
+        );
+        auto m = ~str_vec::mask(str_vec::eq(t, zero)) & str_vec::full;
+        if (m) {
+            return h + i + str_ctz(m);
+        }
+    }
+#elif defined(OSTD_STR_SIMD)
+    /* compare against each member, only worth it for small sets */
+    std::size_t nc = set.p_nchars;
+    if (nc && (nc <= 8)) {
+        str_vec::type vc[8];
+        for (std::size_t j = 0; j < nc; ++j) {
+            vc[j] = str_vec::splat(set.p_chars[j]);
+        }
+        for (; (i + str_vec::size) <= hn; i += str_vec::size) {
+            auto v = str_vec::load(h + i);
+            auto acc = str_vec::eq(v, vc[0]);
+            for (std::size_t j = 1; j < nc; ++j) {
+                acc = str_vec::bor(acc, str_vec::eq(v, vc[j]));
+            }
+            auto m = str_vec::mask(acc);
+            if (m) {
+                return h + i + str_ctz(m);
+            }
+        }
+    }
+#endif
+    for (; i < hn; ++i) {
+        if (set.contains(h[i])) {
+            return h + i;
+        }
+    }
+    return nullptr;
+}
+
+OSTD_EXPORT std::size_t str_count(
+    char const *h, std::size_t hn, char c
+) noexcept {
+    std::size_t ret = 0, i = 0;
+#ifdef OSTD_STR_SIMD
+    auto vc = str_vec::splat(c);
+    for (; (i + str_vec::size) <= hn; i += str_vec::size) {
+        ret += std::size_t(__builtin_popcount(
+            str_vec::mask(str_vec::eq(str_vec::load(h + i), vc))
+        ));
+    }
+#endif
+    for (; i < hn; ++i) {
+        ret += (h[i] == c);
+    }
+    return ret;
+}
+
 } /* namespace detail */
 } /* namespace ostd */
 
@@ -0,0 +1,241 @@
+/* CPU topology discovery and thread placement.
+ *
+ * This file is part of libostd. See COPYING.md for futher information.
+ */
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ostd/topology.hh"
+
+#ifdef OSTD_PLATFORM_LINUX
+#  include <pthread.h>
+#  include <sched.h>
+#  include <unistd.h>
+#  include <sys/syscall.h>
+#endif
+
+namespace ostd {
+
+namespace detail {
+#ifdef OSTD_PLATFORM_LINUX
+    static bool topo_read_line(char const *path, std::string &out) {
+        FILE *f = std::fopen(path, "r");
+        if (!f) {
+            return false;
+        }
+        out.clear();
+        char buf[256];
+        while (std::fgets(buf, sizeof(buf), f)) {
+            out += buf;
+        }
+        std::fclose(f);
+        while (!out.empty() && ((out.back() == '\n') || (out.back() == ' '))) {
+            out.pop_back();
+        }
+        return true;
+    }
+
+    /* parses the kernel's list format, e.g. "0-3,8-11" */
+    static std::vector<unsigned int> topo_parse_list(std::string const &s) {
+        std::vector<unsigned int> ret;
+        char const *p = s.data();
+        while (*p) {
+            char *end;
+            unsigned long lo = std::strtoul(p, &end, 10);
+            if (end == p) {
+                break;
+            }
+            unsigned long hi = lo;
+            p = end;
+            if (*p == '-') {
+                hi = std::strtoul(p + 1, &end, 10);
+                p = end;
+            }
+            for (unsigned long i = lo; i <= hi; ++i) {
+                ret.push_back(static_cast<unsigned int>(i));
+            }
+            if (*p == ',') {
+                ++p;
+            }
+        }
+        return ret;
+    }
+
+    static void topo_discover(cpu_topology &topo) {
+        /* only the cpus we're actually allowed to run on */
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        bool has_allowed = !sched_getaffinity(0, sizeof(allowed), &allowed);
+        auto usable = [&](std::vector<unsigned int> cpus) {
+            if (has_allowed) {
+                cpus.erase(std::remove_if(
+                    cpus.begin(), cpus.end(), [&allowed](unsigned int c) {
+                        return (c >= CPU_SETSIZE) || !CPU_ISSET(c, &allowed);
+                    }
+                ), cpus.end());
+            }
+            return cpus;
+        };
+
+        std::string line;
+        std::vector<std::size_t> ids;
+        if (topo_read_line("/sys/devices/system/node/online", line)) {
+            for (auto id: topo_parse_list(line)) {
+                ids.push_back(id);
+            }
+        }
+        std::vector<std::vector<unsigned int>> dists;
+        for (auto id: ids) {
+            char path[128];
+            std::snprintf(
+                path, sizeof(path), "/sys/devices/system/node/node%zu/cpulist",
+                id
+            );
+            if (!topo_read_line(path, line)) {
+                continue;
+            }
+            auto cpus = usable(topo_parse_list(line));
+            if (cpus.empty()) {
+                /* memory-only node or not allowed */
+                continue;
+            }
+            cpu_node nd;
+            nd.id = id;
+            nd.cpus = std::move(cpus);
+            std::snprintf(
+                path, sizeof(path), "/sys/devices/system/node/node%zu/distance",
+                id
+            );
+            std::vector<unsigned int> dist;
+            if (topo_read_line(path, line)) {
+                char const *p = line.data();
+                char *end;
+                for (;;) {
+                    unsigned long d = std::strtoul(p, &end, 10);
+                    if (end == p) {
+                        break;
+                    }
+                    dist.push_back(static_cast<unsigned int>(d));
+                    p = end;
+                }
+            }
+            dists.push_back(std::move(dist));
+            topo.nodes.push_back(std::move(nd));
+        }
+        /* distances are listed for all online nodes, remap to ours */
+        for (std::size_t i = 0; i < topo.nodes.size(); ++i) {
+            auto &nd = topo.nodes[i];
+            for (auto &ond: topo.nodes) {
+                auto pos = std::find(
+                    ids.begin(), ids.end(), ond.id
+                ) - ids.begin();
+                if (std::size_t(pos) < dists[i].size()) {
+                    nd.distances.push_back(dists[i][pos]);
+                } else {
+                    nd.distances.push_back((ond.id == nd.id) ? 10 : 20);
+                }
+            }
+        }
+        if (!topo.nodes.empty()) {
+            return;
+        }
+        /* no numa info, treat all online cpus as a single node */
+        if (topo_read_line("/sys/devices/system/cpu/online", line)) {
+            auto cpus = usable(topo_parse_list(line));
+            if (!cpus.empty()) {
+                cpu_node nd;
+                nd.cpus = std::move(cpus);
+                nd.distances.push_back(10);
+                topo.nodes.push_back(std::move(nd));
+            }
+        }
+    }
+#else
+    static void topo_discover(cpu_topology &) {}
+#endif
+} /* namespace detail */
+
+OSTD_EXPORT cpu_topology const &cpu_topology::system() {
+    static cpu_topology topo = []() {
+        cpu_topology ret;
+        detail::topo_discover(ret);
+        if (ret.nodes.empty()) {
+            cpu_node nd;
+            unsigned int n = std::max(std::thread::hardware_concurrency(), 1u);
+            for (unsigned int i = 0; i < n; ++i) {
+                nd.cpus.push_back(i);
+            }
+            nd.distances.push_back(10);
+            ret.nodes.push_back(std::move(nd));
+        }
+        return ret;
+    }();
+    return topo;
+}
+
+OSTD_EXPORT std::vector<std::size_t> cpu_topology::node_order(
+    std::size_t node
+) const {
+    std::vector<std::size_t> ret;
+    for (std::size_t i = 0; i < nodes.size(); ++i) {
+        ret.push_back(i);
+    }
+    auto &dist = nodes[node].distances;
+    std::stable_sort(
+        ret.begin(), ret.end(), [node, &dist](std::size_t a, std::size_t b) {
+            if (a == node) {
+                return b != node;
+            }
+            if (b == node) {
+                return false;
+            }
+            return dist[a] < dist[b];
+        }
+    );
+    return ret;
+}
+
+OSTD_EXPORT bool pin_current_thread(
+    [[maybe_unused]] unsigned int cpu
+) noexcept {
+#ifdef OSTD_PLATFORM_LINUX
+    if (cpu >= CPU_SETSIZE) {
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return !pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    return false;
+#endif
+}
+
+OSTD_EXPORT bool bind_memory_node(
+    [[maybe_unused]] void *p, [[maybe_unused]] std::size_t size,
+    [[maybe_unused]] std::size_t node
+) noexcept {
+#if defined(OSTD_PLATFORM_LINUX) && defined(SYS_mbind)
+    /* MPOL_PREFERRED, so that we still get memory when the node is full */
+    constexpr int ostd_mpol_preferred = 1;
+    constexpr std::size_t bits = 8 * sizeof(unsigned long);
+    unsigned long mask[4] = {0, 0, 0, 0};
+    if (node >= (bits * 4)) {
+        return false;
+    }
+    mask[node / bits] |= 1UL << (node % bits);
+    return !syscall(
+        SYS_mbind, p, size, ostd_mpol_preferred, mask, bits * 4 + 1, 0
+    );
+#else
+    return false;
+#endif
+}
+
+} /* namespace ostd */
@@ -4,6 +4,15 @@ int main(int argc, char **argv) {
     if (argc < 3) {
         return 1;
     }
+    /* the headers in subdirectories are named like build/make, with the
+     * module name using underscores in place of the slashes
+     */
+    char modname[256];
+    size_t i = 0;
+    for (; argv[1][i] && (i < (sizeof(modname) - 1)); ++i) {
+        modname[i] = (argv[1][i] == '/') ? '_' : argv[1][i];
+    }
+    modname[i] = '\0';
     FILE *f = fopen(argv[2], "w");
     if (!f) {
         return 1;
@@ -20,7 +29,7 @@ int main(int argc, char **argv) {
         "    ostd::writeln(succ, \" \", fail);\n"
         "    return 0;\n"
         "}\n",
-        argv[1], argv[1]
+        modname, argv[1]
     );
     fclose(f);
     return 0;